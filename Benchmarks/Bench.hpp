@@ -0,0 +1,188 @@
+#pragma once
+
+// Minimal benchmark harness for BStash headers.
+// Case body runs state.Batch() operations per call. Batch is calibrated to ~c_TargetBatch.
+// p50 / p99 come from per operation samples when body reports them (state.Time() / state.Sample()),
+// otherwise from batch averages: those show run to run jitter, not latency of single operation.
+// Allocations are counted by global operator new replacement in BenchMain.cpp.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Common.h"
+
+namespace Bench
+{
+    inline std::atomic<uint64_t> g_Allocations      = 0;
+    inline std::atomic<uint64_t> g_AllocatedBytes   = 0;
+
+    class State
+    {
+        size_t              m_Batch = 1;
+        std::vector<double> m_Samples;
+
+    public:
+        explicit State(size_t batch) : m_Batch(batch) {}
+
+        size_t Batch(void) const { return m_Batch; }
+
+        // Explicit latency of single operation, replaces batch average samples.
+        void Sample(std::chrono::nanoseconds latency) { m_Samples.push_back(static_cast<double>(latency.count())); }
+
+        // Runs one operation & samples its latency. For cases of a microsecond & more, clock read costs ~20 ns.
+        template <typename Op>
+        void Time(Op &&op)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            op();
+            Sample(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start));
+        }
+
+        std::vector<double> &Samples(void) { return m_Samples; }
+    };
+
+    struct Case
+    {
+        std::string                  Name;
+        size_t                       BytesPerOp = 0;     // Throughput in MB/s when set.
+        std::function<void(State&)>  Body;
+    };
+
+    struct Result
+    {
+        std::string Name;
+        uint64_t    Iterations       = 0;
+        double      NsPerOp          = 0;
+        double      P50Ns            = 0;
+        double      P99Ns            = 0;
+        bool        PerOpPercentiles = false;   // false - percentiles of batch averages.
+        double      OpsPerSec        = 0;
+        double      MBPerSec         = 0;
+        double      AllocsPerOp      = 0;
+        double      AllocBytesPerOp  = 0;
+    };
+
+    inline std::vector<Case> &Registry(void)
+    {
+        static std::vector<Case> cases;
+        return cases;
+    }
+
+    inline bool Register(std::string name, size_t bytesPerOp, std::function<void(State&)> body)
+    {
+        Registry().push_back({ std::move(name), bytesPerOp, std::move(body) });
+        return true;
+    }
+
+    // Keeps compiler from dropping computation whose result is unused.
+    template <typename T>
+    inline void DoNotOptimize(const T &value)
+    {
+#if defined COMPILER_MSVC
+        static volatile const void *sink;
+        sink = &value;
+#else
+        asm volatile("" : : "g"(&value) : "memory");
+#endif
+    }
+
+    // Fixed datasets: same bytes on every run & machine.
+    inline std::vector<uint8_t> FixedBytes(size_t size, uint64_t seed = 0x42)
+    {
+        std::vector<uint8_t> data(size);
+        uint64_t state = seed;
+        for (auto &byte : data)
+        {
+            // splitmix64
+            state += 0x9E3779B97F4A7C15ULL;
+            uint64_t z = state;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            byte = static_cast<uint8_t>(z ^ (z >> 31));
+        }
+        return data;
+    }
+
+    inline Result Run(const Case &benchCase, std::chrono::milliseconds minTime)
+    {
+        using Clock = std::chrono::steady_clock;
+        constexpr auto c_TargetBatch = std::chrono::microseconds(50);
+        constexpr size_t c_MinSamples = 20;
+        constexpr size_t c_MaxBatch   = size_t(1) << 24;
+
+        // Warm up: case datasets, pools & caches are touched before calibration.
+        {
+            State state(1);
+            benchCase.Body(state);
+        }
+        size_t batch = 1;
+        for (;;)
+        {
+            State state(batch);
+            const auto start = Clock::now();
+            benchCase.Body(state);
+            if (Clock::now() - start >= c_TargetBatch || batch >= c_MaxBatch)
+            {
+                break;
+            }
+            batch *= 2;
+        }
+
+        std::vector<double> samples;
+        bool     per_op     = true;
+        uint64_t iterations = 0;
+        Clock::duration total = {};
+        const uint64_t allocs_before = g_Allocations.load();
+        const uint64_t bytes_before  = g_AllocatedBytes.load();
+        while (total < minTime || samples.size() < c_MinSamples)
+        {
+            State state(batch);
+            const auto start = Clock::now();
+            benchCase.Body(state);
+            const auto elapsed = Clock::now() - start;
+            total      += elapsed;
+            iterations += batch;
+            if (state.Samples().empty())
+            {
+                per_op = false;
+                samples.push_back(static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / batch);
+            }
+            else
+            {
+                samples.insert(samples.end(), state.Samples().begin(), state.Samples().end());
+            }
+        }
+        const uint64_t allocs = g_Allocations.load()    - allocs_before;
+        const uint64_t bytes  = g_AllocatedBytes.load() - bytes_before;
+
+        const auto percentile = [&samples](double p)
+        {
+            const size_t idx = std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()));
+            std::nth_element(samples.begin(), samples.begin() + idx, samples.end());
+            return samples[idx];
+        };
+        Result result;
+        result.Name            = benchCase.Name;
+        result.Iterations      = iterations;
+        result.NsPerOp         = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(total).count()) / iterations;
+        result.P50Ns           = percentile(0.50);
+        result.P99Ns           = percentile(0.99);
+        result.PerOpPercentiles = per_op;
+        result.OpsPerSec       = result.NsPerOp > 0 ? 1e9 / result.NsPerOp : 0;
+        result.MBPerSec        = benchCase.BytesPerOp ? result.OpsPerSec * benchCase.BytesPerOp / (1024.0 * 1024.0) : 0;
+        result.AllocsPerOp     = static_cast<double>(allocs) / iterations;
+        result.AllocBytesPerOp = static_cast<double>(bytes)  / iterations;
+        return result;
+    }
+}
+
+// BENCH_CASE("Group/Name", bytesPerOp) { for (size_t i = 0; i < state.Batch(); i++) { ... } }
+#define BENCH_CASE(name, bytesPerOp) \
+    static void CONCAT(bench_case_, __LINE__)(Bench::State &state); \
+    static const bool CONCAT(bench_registered_, __LINE__) = Bench::Register(name, bytesPerOp, CONCAT(bench_case_, __LINE__)); \
+    static void CONCAT(bench_case_, __LINE__)(Bench::State &state)
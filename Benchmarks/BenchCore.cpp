@@ -0,0 +1,166 @@
+// ThreadPool, Allocators, Marshall & Trace cases.
+
+#include "Bench.hpp"
+
+#include "Allocators.hpp"
+#include "Marshall.hpp"
+#include "ThreadWrap.hpp"
+#include "Trace.hpp"
+
+namespace
+{
+    ThreadPool &Pool(void)
+    {
+        static ThreadPool pool(4);
+        return pool;
+    }
+
+    using MarshallMap = std::map<uint8_t, std::string>;
+
+    // 64 entries, values 0 .. 252 bytes.
+    const MarshallMap &FixedMap(void)
+    {
+        static const MarshallMap map = []()
+        {
+            MarshallMap result;
+            const auto bytes = Bench::FixedBytes(64 * 256);
+            for (size_t i = 0; i < 64; i++)
+            {
+                result[static_cast<uint8_t>(i)] = std::string(reinterpret_cast<const char*>(&bytes[i * 256]), (i * 4) % 253);
+            }
+            return result;
+        }();
+        return map;
+    }
+
+    const std::vector<uint8_t> &FixedMarshalled(void)
+    {
+        static const std::vector<uint8_t> data = []()
+        {
+            std::vector<uint8_t> result;
+            Marshall::MarshallObject(Marshallable<MarshallMap>(FixedMap()), result);
+            return result;
+        }();
+        return data;
+    }
+}
+
+BENCH_CASE("ThreadPool/AddTask+WaitAll", 0)
+{
+    std::atomic<size_t> done = 0;
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        Pool().AddTask("bench", std::function<void()>([&done]() { done.fetch_add(1, std::memory_order_relaxed); }));
+    }
+    Pool().WaitAllTasks();
+}
+
+// Latency from AddTask to start of task on worker.
+BENCH_CASE("ThreadPool/TaskStartLatency", 0)
+{
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        const auto queued = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point started;
+        const uint64_t id = Pool().AddTask("bench", std::function<void()>([&started]() { started = std::chrono::steady_clock::now(); }));
+        Pool().WaitTask(id);
+        state.Sample(started - queued);
+    }
+}
+
+BENCH_CASE("ThreadPool/ParallelFor(256)", 0)
+{
+    std::vector<uint64_t> sums(256);
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        Pool().ParallelFor("bench", sums.size(), [&sums](size_t idx) { sums[idx] += idx * idx; });
+    }
+    Bench::DoNotOptimize(sums);
+}
+
+BENCH_CASE("Alloc/new+delete(64)", 64)
+{
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        auto *ptr = new uint8_t[64];
+        Bench::DoNotOptimize(ptr);
+        delete[] ptr;
+    }
+}
+
+BENCH_CASE("Alloc/ThreadCachePool(64)", 64)
+{
+    auto *pool = Memory::ThreadCachePool::Instance();
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        void *ptr = pool->allocate(64, 8);
+        Bench::DoNotOptimize(ptr);
+        pool->deallocate(ptr, 64, 8);
+    }
+}
+
+BENCH_CASE("Alloc/RequestArena(32x64)", 32 * 64)
+{
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        Memory::RequestArena arena;
+        for (size_t j = 0; j < 32; j++)
+        {
+            Bench::DoNotOptimize(arena.allocate(64, 8));
+        }
+    }
+}
+
+BENCH_CASE("Marshall/Encode(map64)", FixedMarshalled().size())
+{
+    const auto &map = FixedMap();
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        std::vector<uint8_t> data;
+        Marshall::MarshallObject(Marshallable<MarshallMap>(map), data);
+        Bench::DoNotOptimize(data);
+    }
+}
+
+BENCH_CASE("Marshall/EncodeArena(map64)", FixedMarshalled().size())
+{
+    const auto &map = FixedMap();
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        Memory::RequestArena arena;
+        std::pmr::vector<uint8_t> data(&arena);
+        Marshall::MarshallObject(Marshallable<MarshallMap>(map), data);
+        Bench::DoNotOptimize(data);
+    }
+}
+
+BENCH_CASE("Marshall/Decode(map64)", FixedMarshalled().size())
+{
+    const ByteView data(FixedMarshalled());
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        auto map = Marshall::UnmarshallObject<MarshallMap>(data);
+        Bench::DoNotOptimize(map);
+    }
+}
+
+// Cost left in every instrumented call while tracing is off.
+BENCH_CASE("Trace/Span(off)", 0)
+{
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        TRACE_SCOPE("Bench", "Span");
+        Bench::DoNotOptimize(i);
+    }
+}
+
+BENCH_CASE("Trace/Span(on)", 0)
+{
+    Trace::Start();
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        TRACE_SCOPE("Bench", "Span");
+        Bench::DoNotOptimize(i);
+    }
+    Trace::Stop();
+}
@@ -0,0 +1,201 @@
+// Hashing, RNG & cipher cases. CNG based Hash is Windows only, portable counterparts are measured here.
+
+#include "Bench.hpp"
+
+#include "Cypher.h"
+#include "DirWalker.hpp"
+#include "Random.hpp"
+#include "Sha256.hpp"
+
+namespace
+{
+    const std::vector<uint8_t> &FixedData(size_t size)
+    {
+        static std::map<size_t, std::vector<uint8_t>> cache;
+        auto &data = cache[size];
+        if (data.empty())
+        {
+            data = Bench::FixedBytes(size);
+        }
+        return data;
+    }
+
+    const AES &Aes(void)
+    {
+        static const AES aes = []()
+        {
+            AES result;
+            result.ImportKeys(Bench::FixedBytes(32), Bench::FixedBytes(16));
+            return result;
+        }();
+        return aes;
+    }
+
+    // Key pair is generated once per run, message & ciphertext sizes are fixed.
+    PortableRSA &Rsa(void)
+    {
+        static PortableRSA rsa(true);
+        static const bool generated = rsa.GenerateKeyPair(2048);
+        (void)generated;
+        return rsa;
+    }
+
+    const std::vector<uint8_t> &RsaCiphertext(void)
+    {
+        static const std::vector<uint8_t> ciphertext = []()
+        {
+            std::vector<uint8_t> result;
+            Rsa().Encrypt(FixedData(128), result);
+            return result;
+        }();
+        return ciphertext;
+    }
+}
+
+BENCH_CASE("Sha256/4KiB", 4096)
+{
+    const auto &data = FixedData(4096);
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        Bench::DoNotOptimize(Sha256::Calculate(data.data(), data.size()));
+    }
+}
+
+BENCH_CASE("Sha256/1MiB", 1024 * 1024)
+{
+    const auto &data = FixedData(1024 * 1024);
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        Bench::DoNotOptimize(Sha256::Calculate(data.data(), data.size()));
+    }
+}
+
+BENCH_CASE("Sha256/Batch(8x4KiB)", 8 * 4096)
+{
+    const auto &data = FixedData(8 * 4096);
+    const uint8_t  *ptrs[Sha256::c_Lanes];
+    size_t          lens[Sha256::c_Lanes];
+    Sha256::Digest  digests[Sha256::c_Lanes];
+    for (size_t lane = 0; lane < Sha256::c_Lanes; lane++)
+    {
+        ptrs[lane] = data.data() + lane * 4096;
+        lens[lane] = 4096;
+    }
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        Sha256::CalculateBatch(ptrs, lens, Sha256::c_Lanes, digests);
+        Bench::DoNotOptimize(digests);
+    }
+}
+
+// Keyed pads are compressed once, per message cost is two finalizations.
+BENCH_CASE("HmacSha256/64B", 64)
+{
+    const auto &data = FixedData(64);
+    Sha256::Hmac mac(data.data(), 32);
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        mac.Update(data.data(), data.size());
+        Bench::DoNotOptimize(mac.Final());
+    }
+}
+
+BENCH_CASE("FastHash/1MiB", 1024 * 1024)
+{
+    const ByteView data(FixedData(1024 * 1024));
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        Bench::DoNotOptimize(FastHash::Calculate(data));
+    }
+}
+
+BENCH_CASE("AES256/CTR(1MiB)", 1024 * 1024)
+{
+    std::vector<uint8_t> data = FixedData(1024 * 1024);
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        Aes().EncryptInPlaceCTR(MutableByteView(data), i);
+        Bench::DoNotOptimize(data);
+    }
+}
+
+// Small message path, key schedule setup must not show up here.
+BENCH_CASE("AES256/CTR(64B)", 64)
+{
+    std::vector<uint8_t> data = FixedData(64);
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        Aes().EncryptInPlaceCTR(MutableByteView(data), i);
+        Bench::DoNotOptimize(data);
+    }
+}
+
+BENCH_CASE("AES256/CBC(4KiB)", 4096)
+{
+    const auto &data = FixedData(4096);
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        std::vector<uint8_t> buffer = data;
+        Aes().EncryptInPlace(buffer);
+        Bench::DoNotOptimize(buffer);
+    }
+}
+
+BENCH_CASE("AES256/CBC decrypt(4KiB)", 4096)
+{
+    static const std::vector<uint8_t> sealed = []()
+    {
+        std::vector<uint8_t> result = FixedData(4096);
+        Aes().EncryptInPlace(result);
+        return result;
+    }();
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        std::vector<uint8_t> buffer = sealed;
+        Aes().DecryptInPlace(buffer);
+        Bench::DoNotOptimize(buffer);
+    }
+}
+
+BENCH_CASE("SecureRandom/Fill(4KiB)", 4096)
+{
+    std::vector<uint8_t> data(4096);
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        SecureRandom::Fill(MutableByteView(data));
+        Bench::DoNotOptimize(data);
+    }
+}
+
+BENCH_CASE("RSA2048/Encrypt(OAEP)", 128)
+{
+    const auto &message = FixedData(128);
+    std::vector<uint8_t> ciphertext;
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        state.Time([&]() { Rsa().Encrypt(message, ciphertext); });
+        Bench::DoNotOptimize(ciphertext);
+    }
+}
+
+BENCH_CASE("RSA2048/Decrypt(OAEP,CRT)", 128)
+{
+    const auto &ciphertext = RsaCiphertext();
+    std::vector<uint8_t> message;
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        state.Time([&]() { Rsa().Decrypt(ciphertext, message); });
+        Bench::DoNotOptimize(message);
+    }
+}
+
+BENCH_CASE("RSA2048/Sign", 128)
+{
+    const auto &message = FixedData(128);
+    std::vector<uint8_t> signature;
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        state.Time([&]() { Rsa().Sign(message, signature); });
+        Bench::DoNotOptimize(signature);
+    }
+}
@@ -0,0 +1,166 @@
+// FsLib side & logging cases: MappedFile, AsyncIO, DirWalker, RecordStore & AsyncLog.
+// Files live in temporary directory & are created once per run, results depend on page cache being warm.
+
+#include "Bench.hpp"
+
+#include <fstream>
+
+#include "AsyncIO.hpp"
+#include "AsyncLog.hpp"
+#include "DirWalker.hpp"
+#include "MappedFile.hpp"
+#include "RecordStore.hpp"
+
+namespace
+{
+    constexpr size_t c_FileSize  = 16 * 1024 * 1024;
+    constexpr size_t c_TreeDirs  = 64;
+    constexpr size_t c_TreeFiles = 32;             // Per directory.
+
+    const std::filesystem::path &Workspace(void)
+    {
+        static const std::filesystem::path path = []()
+        {
+            const auto root = std::filesystem::temp_directory_path() / "bstash_bench";
+            std::filesystem::create_directories(root / "tree");
+            // Record logs start empty every run, old ones may be of other format or size.
+            std::filesystem::remove(root / "records.log");
+            std::filesystem::remove(root / "records_mt.log");
+            const auto data = Bench::FixedBytes(c_FileSize);
+            std::ofstream(root / "data.bin", std::ios::binary).write(reinterpret_cast<const char*>(data.data()), data.size());
+            for (size_t dir = 0; dir < c_TreeDirs; dir++)
+            {
+                const auto dir_path = root / "tree" / std::to_string(dir);
+                std::filesystem::create_directories(dir_path);
+                for (size_t file = 0; file < c_TreeFiles; file++)
+                {
+                    std::ofstream(dir_path / std::to_string(file), std::ios::binary).write(reinterpret_cast<const char*>(data.data() + file * 4096), 4096);
+                }
+            }
+            return root;
+        }();
+        return path;
+    }
+
+    AsyncLog::Logger &BenchLogger(void)
+    {
+        static AsyncLog::Logger logger([]()
+        {
+            AsyncLog::Options options;
+            options.RingCapacity = 1 << 16;
+            options.Sink         = [](std::string_view) {};
+            return options;
+        }());
+        return logger;
+    }
+}
+
+BENCH_CASE("MappedFile/Open+FastHash(16MiB)", c_FileSize)
+{
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        state.Time([&]()
+        {
+            MappedFile file;
+            file.Open(Workspace() / "data.bin");
+            file.Advise(MappedFile::Advice::Sequential);
+            Bench::DoNotOptimize(FastHash::Calculate(file.View()));
+        });
+    }
+}
+
+BENCH_CASE("AsyncIO/Read(16x1MiB)", c_FileSize)
+{
+    static AsyncIO::Engine engine;
+    static std::vector<uint8_t> buffer(c_FileSize);
+    const int fd = open((Workspace() / "data.bin").c_str(), O_RDONLY | O_CLOEXEC);
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        std::vector<AsyncIO::Request> requests;
+        for (size_t part = 0; part < 16; part++)
+        {
+            const size_t offset = part * (c_FileSize / 16);
+            requests.push_back(AsyncIO::Request::Read(fd, MutableByteView(buffer.data() + offset, c_FileSize / 16), offset, nullptr));
+        }
+        state.Time([&]()
+        {
+            engine.Submit(requests);
+            engine.Drain();
+        });
+    }
+    close(fd);
+}
+
+BENCH_CASE("DirWalker/Walk(2k files)", 0)
+{
+    DirWalker walker;
+    std::vector<DirWalker::Entry> entries;
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        state.Time([&]() { walker.Walk(Workspace() / "tree", entries); });
+        Bench::DoNotOptimize(entries);
+    }
+}
+
+BENCH_CASE("DirWalker/Fingerprint(2k files)", c_TreeDirs * c_TreeFiles * 4096)
+{
+    DirWalker::Options options;
+    options.Fingerprint = true;
+    DirWalker walker(ThreadPool::GLobalInstance(), options);
+    std::vector<DirWalker::Entry> entries;
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        state.Time([&]() { walker.Walk(Workspace() / "tree", entries); });
+        Bench::DoNotOptimize(entries);
+    }
+}
+
+// One writer, every Put pays its own fsync.
+BENCH_CASE("RecordStore/Put(256B,sync)", 256)
+{
+    static RecordStore store;
+    static const bool opened = store.Open(Workspace() / "records.log", ByteView(Bench::FixedBytes(32)));
+    (void)opened;
+    const auto value = Bench::FixedBytes(256);
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        const std::string key = "key " + std::to_string(i % 1024);
+        state.Time([&]() { store.Put(key, ByteView(value)); });
+    }
+}
+
+// 8 writers share fsyncs through group commit, one op is 64 records.
+BENCH_CASE("RecordStore/Put(64x256B,sync,8 writers)", 64 * 256)
+{
+    static ThreadPool writers(8);
+    static RecordStore store;
+    static const bool opened = store.Open(Workspace() / "records_mt.log", ByteView(Bench::FixedBytes(32)));
+    (void)opened;
+    const auto value = Bench::FixedBytes(256);
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        state.Time([&]() { writers.ParallelFor("bench", 64, [&](size_t idx) { store.Put("key " + std::to_string(idx), ByteView(value)); }); });
+    }
+}
+
+// Producer side cost, consumer thread formats & discards. Runtime format is copied into the record.
+BENCH_CASE("AsyncLog/Push(int,str)", 0)
+{
+    AsyncLog::Logger &logger = BenchLogger();
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        logger.Push(AsyncLog::Level::Info, "request {} served by {}", static_cast<int>(i), "Worker 3");
+    }
+}
+
+// Call site format as Log_*F macros use it, kept as view.
+BENCH_CASE("AsyncLog/PushSite(int,str)", 0)
+{
+    static AsyncLog::Site site(AsyncLog::SiteId(__FILE__, __LINE__, "request {} served by {}"), AsyncLog::Level::Info,
+                               __FILE__, __LINE__, "request {} served by {}");
+    AsyncLog::Logger &logger = BenchLogger();
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        logger.Push(site, static_cast<int>(i), "Worker 3");
+    }
+}
@@ -0,0 +1,250 @@
+// Benchmark runner.
+// Usage: bstash_bench [--filter <substring>] [--min-time <ms>] [--json <out.json>] [--label <text>]
+//                     [--compare <baseline.json>] [--threshold <percent>] [--list]
+// --compare prints change of ns/op against baseline & exits with 2 if any case got slower than threshold.
+
+#include <clocale>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <new>
+#include <sstream>
+
+#include "Bench.hpp"
+
+// Every global allocation is counted, aligned ones included (ThreadCachePool slabs).
+void *operator new(size_t size)
+{
+    Bench::g_Allocations.fetch_add(1, std::memory_order_relaxed);
+    Bench::g_AllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void *ptr = malloc(size ? size : 1))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new(size_t size, std::align_val_t alignment)
+{
+    Bench::g_Allocations.fetch_add(1, std::memory_order_relaxed);
+    Bench::g_AllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    const size_t align = static_cast<size_t>(alignment);
+    if (void *ptr = aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)                               { return operator new(size); }
+void *operator new[](size_t size, std::align_val_t alignment)   { return operator new(size, alignment); }
+void  operator delete(void *ptr) noexcept                                       { free(ptr); }
+void  operator delete(void *ptr, size_t) noexcept                               { free(ptr); }
+void  operator delete(void *ptr, std::align_val_t) noexcept                     { free(ptr); }
+void  operator delete(void *ptr, size_t, std::align_val_t) noexcept             { free(ptr); }
+void  operator delete[](void *ptr) noexcept                                     { free(ptr); }
+void  operator delete[](void *ptr, size_t) noexcept                             { free(ptr); }
+void  operator delete[](void *ptr, std::align_val_t) noexcept                   { free(ptr); }
+void  operator delete[](void *ptr, size_t, std::align_val_t) noexcept           { free(ptr); }
+
+namespace
+{
+    std::string JsonEscape(const std::string &text)
+    {
+        std::string result;
+        for (const char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                result += '\\';
+            }
+            if (static_cast<unsigned char>(c) >= 0x20)
+            {
+                result += c;
+            }
+        }
+        return result;
+    }
+
+    std::string CpuModel(void)
+    {
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        std::string line;
+        while (std::getline(cpuinfo, line))
+        {
+            if (line.rfind("model name", 0) == 0)
+            {
+                const size_t colon = line.find(':');
+                return colon == std::string::npos ? line : line.substr(colon + 2);
+            }
+        }
+        return "unknown";
+    }
+
+    std::string Compiler(void)
+    {
+#if defined __clang__
+        return "clang " __clang_version__;
+#elif defined COMPILER_GNUC
+        return "gcc " __VERSION__;
+#elif defined COMPILER_MSVC
+        return "msvc " + std::to_string(_MSC_VER);
+#else
+        return "unknown";
+#endif
+    }
+
+    // One result object per line, so baseline is read back without JSON library.
+    bool WriteJson(const std::string &path, const std::string &label, const std::vector<Bench::Result> &results)
+    {
+        FILE *out = fopen(path.c_str(), "wb");
+        if (!out)
+        {
+            return false;
+        }
+        fprintf(out, "{\n  \"label\": \"%s\",\n  \"timestamp\": %lld,\n  \"compiler\": \"%s\",\n  \"cpu\": \"%s\",\n  \"results\": [\n",
+                JsonEscape(label).c_str(), static_cast<long long>(time(nullptr)), JsonEscape(Compiler()).c_str(), JsonEscape(CpuModel()).c_str());
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const auto &r = results[i];
+            fprintf(out, "    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.3f, \"p50_ns\": %.3f, \"p99_ns\": %.3f, \"percentiles\": \"%s\", "
+                         "\"ops_per_s\": %.3f, \"mb_per_s\": %.3f, \"allocs_per_op\": %.4f, \"alloc_bytes_per_op\": %.2f}%s\n",
+                    JsonEscape(r.Name).c_str(), static_cast<unsigned long long>(r.Iterations), r.NsPerOp, r.P50Ns, r.P99Ns,
+                    r.PerOpPercentiles ? "op" : "batch", r.OpsPerSec, r.MBPerSec, r.AllocsPerOp, r.AllocBytesPerOp, i + 1 < results.size() ? "," : "");
+        }
+        fprintf(out, "  ]\n}\n");
+        return fclose(out) == 0;
+    }
+
+    bool ReadBaseline(const std::string &path, std::map<std::string, double> &oNsPerOp)
+    {
+        std::ifstream in(path);
+        if (!in)
+        {
+            return false;
+        }
+        std::string line;
+        while (std::getline(in, line))
+        {
+            const size_t name = line.find("\"name\": \"");
+            const size_t ns   = line.find("\"ns_per_op\": ");
+            if (name == std::string::npos || ns == std::string::npos)
+            {
+                continue;
+            }
+            const size_t name_begin = name + 9;
+            const size_t name_end   = line.find('"', name_begin);
+            oNsPerOp[line.substr(name_begin, name_end - name_begin)] = strtod(line.c_str() + ns + 13, nullptr);
+        }
+        return true;
+    }
+
+    std::string Human(double value, const char *const *units, size_t unitsCount, double step)
+    {
+        size_t unit = 0;
+        while (value >= step && unit + 1 < unitsCount)
+        {
+            value /= step;
+            unit++;
+        }
+        char text[32];
+        snprintf(text, sizeof(text), "%.2f %s", value, units[unit]);
+        return text;
+    }
+
+    std::string Nanoseconds(double ns)
+    {
+        static const char *const units[] = { "ns", "us", "ms", "s" };
+        return Human(ns, units, 4, 1000);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::string filter;
+    std::string json_path;
+    std::string label;
+    std::string baseline_path;
+    double      threshold = 10;
+    bool        list_only = false;
+    std::chrono::milliseconds min_time(300);
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if      (arg == "--filter"    && has_value) filter        = argv[++i];
+        else if (arg == "--json"      && has_value) json_path     = argv[++i];
+        else if (arg == "--label"     && has_value) label         = argv[++i];
+        else if (arg == "--compare"   && has_value) baseline_path = argv[++i];
+        else if (arg == "--threshold" && has_value) threshold     = atof(argv[++i]);
+        else if (arg == "--min-time"  && has_value) min_time      = std::chrono::milliseconds(atoll(argv[++i]));
+        else if (arg == "--list")                   list_only     = true;
+        else
+        {
+            fprintf(stderr, "Usage: %s [--filter <substring>] [--min-time <ms>] [--json <out.json>] [--label <text>] "
+                            "[--compare <baseline.json>] [--threshold <percent>] [--list]\n", argv[0]);
+            return 1;
+        }
+    }
+    // ConvertUTF cases need UTF-8 locale.
+    if (!setlocale(LC_ALL, "C.UTF-8"))
+    {
+        setlocale(LC_ALL, "en_US.UTF-8");
+    }
+
+    std::map<std::string, double> baseline;
+    if (!baseline_path.empty() && !ReadBaseline(baseline_path, baseline))
+    {
+        fprintf(stderr, "Can`t read baseline %s.\n", baseline_path.c_str());
+        return 1;
+    }
+
+    std::vector<Bench::Result> results;
+    bool regressed = false;
+    printf("%-40s %12s %12s %12s %6s %12s %10s %10s%s\n", "case", "time/op", "p50", "p99", "of", "ops/s", "MB/s", "allocs/op", baseline.empty() ? "" : "     change");
+    for (const auto &bench_case : Bench::Registry())
+    {
+        if (!filter.empty() && bench_case.Name.find(filter) == std::string::npos)
+        {
+            continue;
+        }
+        if (list_only)
+        {
+            printf("%s\n", bench_case.Name.c_str());
+            continue;
+        }
+        const auto result = Bench::Run(bench_case, min_time);
+        std::string change;
+        const auto base = baseline.find(result.Name);
+        if (base != baseline.end() && base->second > 0)
+        {
+            const double percent = (result.NsPerOp / base->second - 1) * 100;
+            char text[32];
+            snprintf(text, sizeof(text), "%+9.1f%%%s", percent, percent > threshold ? " !" : "");
+            change    = text;
+            regressed = regressed || percent > threshold;
+        }
+        char mb_per_s[32] = "-";
+        if (result.MBPerSec > 0)
+        {
+            snprintf(mb_per_s, sizeof(mb_per_s), "%.1f", result.MBPerSec);
+        }
+        printf("%-40s %12s %12s %12s %6s %12.0f %10s %10.2f %s\n", result.Name.c_str(), Nanoseconds(result.NsPerOp).c_str(),
+               Nanoseconds(result.P50Ns).c_str(), Nanoseconds(result.P99Ns).c_str(), result.PerOpPercentiles ? "op" : "batch", result.OpsPerSec, mb_per_s, result.AllocsPerOp, change.c_str());
+        fflush(stdout);
+        results.push_back(result);
+    }
+    if (!results.empty())
+    {
+        printf("\np50 / p99 of: op - single operations, batch - ~50 us batch averages (jitter, not operation latency).\n");
+    }
+    if (!json_path.empty() && !WriteJson(json_path, label, results))
+    {
+        fprintf(stderr, "Can`t write %s.\n", json_path.c_str());
+        return 1;
+    }
+    return regressed ? 2 : 0;
+}
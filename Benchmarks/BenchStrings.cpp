@@ -0,0 +1,94 @@
+// ConvertUTF, string_format & Base64 cases.
+
+#include "Bench.hpp"
+
+#include "Base64.hpp"
+#include "StringConvertLib.h"
+
+namespace
+{
+    // 4 KiB of UTF-8 text, ASCII mixed with 2 & 3 byte sequences.
+    const std::string &FixedUtf8(void)
+    {
+        static const std::string text = []()
+        {
+            static const char *const words[] = { "stash ", "\xD0\xB4\xD0\xB0\xD0\xBD\xD1\x96 ", "\xE6\x95\xB0\xE6\x8D\xAE ", "bytes ", "\xC3\xA9t\xC3\xA9 " };
+            const auto picks = Bench::FixedBytes(4096);
+            std::string result;
+            for (size_t i = 0; result.size() < 4096; i++)
+            {
+                result += words[picks[i] % 5];
+            }
+            return result;
+        }();
+        return text;
+    }
+
+    const std::wstring &FixedWide(void)
+    {
+        static const std::wstring text = ConvertUTF::UTF8_Decode(FixedUtf8()).c_str();
+        return text;
+    }
+
+    const std::vector<uint8_t> &FixedBinary(void)
+    {
+        static const auto data = Bench::FixedBytes(64 * 1024);
+        return data;
+    }
+
+    const std::string &FixedBase64(void)
+    {
+        static const auto text = Base64::Encode(ByteView(FixedBinary()));
+        return text;
+    }
+}
+
+BENCH_CASE("ConvertUTF/Decode(4KiB)", FixedUtf8().size())
+{
+    const auto &text = FixedUtf8();
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        auto wide = ConvertUTF::UTF8_Decode(text);
+        Bench::DoNotOptimize(wide);
+    }
+}
+
+BENCH_CASE("ConvertUTF/Encode(4KiB)", FixedUtf8().size())
+{
+    const auto &text = FixedWide();
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        auto utf8 = ConvertUTF::UTF8_Encode(text);
+        Bench::DoNotOptimize(utf8);
+    }
+}
+
+BENCH_CASE("string_format/int+double+str", 0)
+{
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        auto text = string_format<char>(std::string_view("task %d of %zu took %.3f ms in %s"), static_cast<int>(i), state.Batch(), 1.25 * i, "Worker 3");
+        Bench::DoNotOptimize(text);
+    }
+}
+
+BENCH_CASE("Base64/Encode(64KiB)", FixedBinary().size())
+{
+    const ByteView data(FixedBinary());
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        auto text = Base64::Encode(data);
+        Bench::DoNotOptimize(text);
+    }
+}
+
+BENCH_CASE("Base64/Decode(64KiB)", FixedBinary().size())
+{
+    const auto &text = FixedBase64();
+    std::vector<uint8_t> data;
+    for (size_t i = 0; i < state.Batch(); i++)
+    {
+        Base64::Decode(text, data);
+        Bench::DoNotOptimize(data);
+    }
+}
@@ -0,0 +1,559 @@
+#pragma once
+
+// Portable AES-256 backend, same interface as CryptoAPI based AES from Cypher.h.
+// Key schedule is expanded once in ImportKeys. Blocks go through AES-NI when CPU has it;
+// portable fallback (and key schedule) computes S-box with bitsliced circuit, 4 blocks at once,
+// so it has no secret dependent memory access or branch, at cost of speed. Legacy EncryptInPlace /
+// DecryptInPlace are CBC with PKCS#7 padding (CryptoAPI defaults), CTR output is byte to byte
+// same as AES::EncryptInPlaceCTR. Known answer vectors: Tools/CryptoKat.
+
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Common.h"
+#include "CpuFeatures.hpp"
+#include "ThreadWrap.hpp"
+#include "Trace.hpp"
+
+class LIB_EXPORT PortableAES
+{
+private:
+    static constexpr size_t c_KeySize          = 32;
+    static constexpr size_t c_BlockSize        = 16;
+    static constexpr size_t c_Rounds           = 14;
+    static constexpr size_t c_CtrChunkSize     = 1024UL * 1024;   // Counter range of single pool task.
+    static constexpr size_t c_CtrKeystreamSize = 4096UL;          // Keystream bytes generated per batch.
+    static constexpr size_t c_CbcBatchSize     = 1024UL;          // Ciphertext decrypted at once, CBC decryption does not chain.
+
+    std::array<uint8_t, c_KeySize>      m_Key       = {};
+    std::array<uint8_t, c_BlockSize>    m_IV        = {};
+    alignas(16) uint8_t                 m_RoundKeys[(c_Rounds + 1) * c_BlockSize] = {};
+    alignas(16) uint8_t                 m_InvRoundKeys[(c_Rounds + 1) * c_BlockSize] = {};    // AES-NI equivalent inverse cipher.
+    bool                                m_Ready     = false;
+
+    static uint32_t LoadBE32(const uint8_t *p)
+    {
+        return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+               (static_cast<uint32_t>(p[2]) << 8)  |  static_cast<uint32_t>(p[3]);
+    }
+
+    static void StoreBE32(uint8_t *p, uint32_t v)
+    {
+        p[0] = static_cast<uint8_t>(v >> 24); p[1] = static_cast<uint8_t>(v >> 16);
+        p[2] = static_cast<uint8_t>(v >> 8);  p[3] = static_cast<uint8_t>(v);
+    }
+
+    static uint64_t LoadBE64(const uint8_t *p)  { return (static_cast<uint64_t>(LoadBE32(p)) << 32) | LoadBE32(p + 4); }
+    static void StoreBE64(uint8_t *p, uint64_t v) { StoreBE32(p, static_cast<uint32_t>(v >> 32)); StoreBE32(p + 4, static_cast<uint32_t>(v)); }
+
+    static uint64_t LoadLE64(const uint8_t *p)
+    {
+        uint64_t v = 0;
+        for (size_t i = 0; i < 8; i++)
+        {
+            v |= static_cast<uint64_t>(p[i]) << (8 * i);
+        }
+        return v;
+    }
+
+    static void StoreLE64(uint8_t *p, uint64_t v)
+    {
+        for (size_t i = 0; i < 8; i++)
+        {
+            p[i] = static_cast<uint8_t>(v >> (8 * i));
+        }
+    }
+
+    // GF(2^8) arithmetic on 8 bytes at once, masks instead of branches.
+    static constexpr uint64_t c_Bytes01 = 0x0101010101010101ULL;
+
+    static uint64_t XTime(uint64_t x) { return ((x & (0x7f * c_Bytes01)) << 1) ^ (((x >> 7) & c_Bytes01) * 0x1b); }
+
+    template <int N>
+    static uint64_t RotlBytes(uint64_t x) { return ((x << N) & (((0xff << N) & 0xff) * c_Bytes01)) | ((x >> (8 - N)) & ((0xff >> (8 - N)) * c_Bytes01)); }
+
+    // Inverse of S-box affine map.
+    static uint64_t InvAffine(uint64_t x) { return RotlBytes<1>(x) ^ RotlBytes<3>(x) ^ RotlBytes<6>(x) ^ (0x05 * c_Bytes01); }
+
+    // Transposes bit k of each byte of 8 words into word k (bit plane) and back.
+    static void Ortho(uint64_t (&q)[8])
+    {
+        const auto swap = [](uint64_t &x, uint64_t &y, uint64_t low, int shift)
+        {
+            const uint64_t a = x, b = y;
+            x = (a & low) | ((b & low) << shift);
+            y = ((a >> shift) & low) | (b & ~low);
+        };
+        for (size_t i = 0; i < 8; i += 2)
+        {
+            swap(q[i], q[i + 1], 0x5555555555555555ULL, 1);
+        }
+        for (size_t i : { 0, 1, 4, 5 })
+        {
+            swap(q[i], q[i + 2], 0x3333333333333333ULL, 2);
+        }
+        for (size_t i = 0; i < 4; i++)
+        {
+            swap(q[i], q[i + 4], 0x0f0f0f0f0f0f0f0fULL, 4);
+        }
+    }
+
+    // S-box of 64 bytes at once: Boyar & Peralta circuit on bit planes, q[7] is most significant bit.
+    static void SubBytes(uint64_t (&q)[8])
+    {
+        Ortho(q);
+        const uint64_t x0 = q[7], x1 = q[6], x2 = q[5], x3 = q[4], x4 = q[3], x5 = q[2], x6 = q[1], x7 = q[0];
+
+        // Top linear transformation.
+        const uint64_t y14 = x3 ^ x5, y13 = x0 ^ x6, y9 = x0 ^ x3, y8 = x0 ^ x5, t0 = x1 ^ x2;
+        const uint64_t y1 = t0 ^ x7, y4 = y1 ^ x3, y12 = y13 ^ y14, y2 = y1 ^ x0, y5 = y1 ^ x6;
+        const uint64_t y3 = y5 ^ y8, t1 = x4 ^ y12, y15 = t1 ^ x5, y20 = t1 ^ x1, y6 = y15 ^ x7;
+        const uint64_t y10 = y15 ^ t0, y11 = y20 ^ y9, y7 = x7 ^ y11, y17 = y10 ^ y11, y19 = y10 ^ y8;
+        const uint64_t y16 = t0 ^ y11, y21 = y13 ^ y16, y18 = x0 ^ y16;
+
+        // Non-linear section, inversion in GF(2^8).
+        const uint64_t t2 = y12 & y15, t3 = y3 & y6, t4 = t3 ^ t2, t5 = y4 & x7, t6 = t5 ^ t2;
+        const uint64_t t7 = y13 & y16, t8 = y5 & y1, t9 = t8 ^ t7, t10 = y2 & y7, t11 = t10 ^ t7;
+        const uint64_t t12 = y9 & y11, t13 = y14 & y17, t14 = t13 ^ t12, t15 = y8 & y10, t16 = t15 ^ t12;
+        const uint64_t t17 = t4 ^ t14, t18 = t6 ^ t16, t19 = t9 ^ t14, t20 = t11 ^ t16;
+        const uint64_t t21 = t17 ^ y20, t22 = t18 ^ y19, t23 = t19 ^ y21, t24 = t20 ^ y18;
+        const uint64_t t25 = t21 ^ t22, t26 = t21 & t23, t27 = t24 ^ t26, t28 = t25 & t27, t29 = t28 ^ t22;
+        const uint64_t t30 = t23 ^ t24, t31 = t22 ^ t26, t32 = t31 & t30, t33 = t32 ^ t24, t34 = t23 ^ t33;
+        const uint64_t t35 = t27 ^ t33, t36 = t24 & t35, t37 = t36 ^ t34, t38 = t27 ^ t36, t39 = t29 & t38;
+        const uint64_t t40 = t25 ^ t39, t41 = t40 ^ t37, t42 = t29 ^ t33, t43 = t29 ^ t40, t44 = t33 ^ t37, t45 = t42 ^ t41;
+        const uint64_t z0 = t44 & y15, z1 = t37 & y6, z2 = t33 & x7, z3 = t43 & y16, z4 = t40 & y1, z5 = t29 & y7;
+        const uint64_t z6 = t42 & y11, z7 = t45 & y17, z8 = t41 & y10, z9 = t44 & y12, z10 = t37 & y3, z11 = t33 & y4;
+        const uint64_t z12 = t43 & y13, z13 = t40 & y5, z14 = t29 & y2, z15 = t42 & y9, z16 = t45 & y14, z17 = t41 & y8;
+
+        // Bottom linear transformation, includes affine map.
+        const uint64_t t46 = z15 ^ z16, t47 = z10 ^ z11, t48 = z5 ^ z13, t49 = z9 ^ z10, t50 = z2 ^ z12;
+        const uint64_t t51 = z2 ^ z5, t52 = z7 ^ z8, t53 = z0 ^ z3, t54 = z6 ^ z7, t55 = z16 ^ z17;
+        const uint64_t t56 = z12 ^ t48, t57 = t50 ^ t53, t58 = z4 ^ t46, t59 = z3 ^ t54, t60 = t46 ^ t57;
+        const uint64_t t61 = z14 ^ t57, t62 = t52 ^ t58, t63 = t49 ^ t58, t64 = z4 ^ t59, t65 = t61 ^ t62;
+        const uint64_t t66 = z1 ^ t63, t67 = t64 ^ t65;
+        const uint64_t s3 = t53 ^ t66;
+        q[7] = t59 ^ t63;
+        q[6] = t64 ^ ~s3;
+        q[5] = t55 ^ ~t67;
+        q[4] = s3;
+        q[3] = t51 ^ t66;
+        q[2] = t47 ^ t65;
+        q[1] = t56 ^ ~t62;
+        q[0] = t48 ^ ~t60;
+        Ortho(q);
+    }
+
+    // Columns 0, 1 are in lo & 2, 3 in hi, row r is byte r of 32 bit lane. Row 2 swaps halves,
+    // rows 1 and 3 take whole word rotated by one column, inverse swaps their directions.
+    template <bool Inverse>
+    static void ShiftRows(uint64_t &lo, uint64_t &hi)
+    {
+        constexpr uint64_t row0 = 0x000000ff000000ffULL, row1 = row0 << 8, row2 = row0 << 16, row3 = row0 << 24;
+        constexpr uint64_t left = Inverse ? row3 : row1, right = Inverse ? row1 : row3;
+        const uint64_t cols12 = (lo >> 32) | (hi << 32), cols30 = (hi >> 32) | (lo << 32);
+        const uint64_t new_lo = (lo & row0) | (hi & row2) | (cols12 & left) | (cols30 & right);
+        hi = (hi & row0) | (lo & row2) | (cols30 & left) | (cols12 & right);
+        lo = new_lo;
+    }
+
+    static uint64_t Rot8(uint64_t v)  { return ((v >> 8)  & 0x00ffffff00ffffffULL) | ((v << 24) & 0xff000000ff000000ULL); }
+    static uint64_t Rot16(uint64_t v) { return ((v >> 16) & 0x0000ffff0000ffffULL) | ((v << 16) & 0xffff0000ffff0000ULL); }
+
+    // Two columns per word, row r of column is byte r of its 32 bit lane.
+    static uint64_t MixColumns(uint64_t x)
+    {
+        const uint64_t pairs = x ^ Rot8(x);
+        return x ^ pairs ^ Rot16(pairs) ^ XTime(pairs);
+    }
+
+    // InvMixColumns = MixColumns after adding {04}(a0 + a2) to rows 0, 2 and {04}(a1 + a3) to rows 1, 3.
+    static uint64_t InvMixColumns(uint64_t x)
+    {
+        return MixColumns(x ^ XTime(XTime(x ^ Rot16(x))));
+    }
+
+    void ExpandKey()
+    {
+        const auto sub_word = [](uint32_t w)
+        {
+            uint64_t q[8] = { w };
+            SubBytes(q);
+            return static_cast<uint32_t>(q[0]);
+        };
+        uint32_t words[(c_Rounds + 1) * 4];
+        uint32_t rcon = 0x01;
+        for (size_t i = 0; i < c_KeySize / 4; i++)
+        {
+            words[i] = LoadBE32(m_Key.data() + i * 4);
+        }
+        for (size_t i = c_KeySize / 4; i < std::size(words); i++)
+        {
+            uint32_t temp = words[i - 1];
+            if (i % 8 == 0)
+            {
+                temp = sub_word((temp << 8) | (temp >> 24)) ^ (rcon << 24);
+                rcon = static_cast<uint8_t>(XTime(rcon));
+            }
+            else if (i % 8 == 4)
+            {
+                temp = sub_word(temp);
+            }
+            words[i] = words[i - 8] ^ temp;
+        }
+        for (size_t i = 0; i < std::size(words); i++)
+        {
+            StoreBE32(m_RoundKeys + i * 4, words[i]);
+        }
+#if defined CPU_X86
+        if (CpuFeatures::HasAes())
+        {
+            InvertRoundKeysNi(m_RoundKeys, m_InvRoundKeys);
+        }
+#endif
+    }
+
+#if defined CPU_X86
+    // Round keys of equivalent inverse cipher: reversed order, InvMixColumns applied to inner ones.
+    CPU_TARGET("aes,sse2")
+    static void InvertRoundKeysNi(const uint8_t *roundKeys, uint8_t *oInvRoundKeys)
+    {
+        for (size_t i = 0; i <= c_Rounds; i++)
+        {
+            __m128i rk = _mm_load_si128(reinterpret_cast<const __m128i*>(roundKeys + (c_Rounds - i) * c_BlockSize));
+            if (i != 0 && i != c_Rounds)
+            {
+                rk = _mm_aesimc_si128(rk);
+            }
+            _mm_store_si128(reinterpret_cast<__m128i*>(oInvRoundKeys + i * c_BlockSize), rk);
+        }
+    }
+
+    template <bool Inverse>
+    CPU_TARGET("aes,sse2")
+    static __m128i RoundNi(__m128i x, __m128i key)
+    {
+        if constexpr (Inverse)
+        {
+            return _mm_aesdec_si128(x, key);
+        }
+        return _mm_aesenc_si128(x, key);
+    }
+
+    template <bool Inverse>
+    CPU_TARGET("aes,sse2")
+    static __m128i LastRoundNi(__m128i x, __m128i key)
+    {
+        if constexpr (Inverse)
+        {
+            return _mm_aesdeclast_si128(x, key);
+        }
+        return _mm_aesenclast_si128(x, key);
+    }
+
+    // Inverse - roundKeys are from InvertRoundKeysNi.
+    template <bool Inverse>
+    CPU_TARGET("aes,sse2")
+    static void CryptBlocksNi(const uint8_t *roundKeys, const uint8_t *iData, uint8_t *oData, size_t blocks)
+    {
+        __m128i rk[c_Rounds + 1];
+        for (size_t i = 0; i <= c_Rounds; i++)
+        {
+            rk[i] = _mm_load_si128(reinterpret_cast<const __m128i*>(roundKeys + i * c_BlockSize));
+        }
+        size_t b = 0;
+        // 8 independent blocks keep AES unit pipeline busy.
+        for (; b + 8 <= blocks; b += 8)
+        {
+            __m128i x[8];
+            for (size_t i = 0; i < 8; i++)
+            {
+                x[i] = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(iData + (b + i) * c_BlockSize)), rk[0]);
+            }
+            for (size_t round = 1; round < c_Rounds; round++)
+            {
+                for (size_t i = 0; i < 8; i++)
+                {
+                    x[i] = RoundNi<Inverse>(x[i], rk[round]);
+                }
+            }
+            for (size_t i = 0; i < 8; i++)
+            {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(oData + (b + i) * c_BlockSize), LastRoundNi<Inverse>(x[i], rk[c_Rounds]));
+            }
+        }
+        for (; b < blocks; b++)
+        {
+            __m128i x = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(iData + b * c_BlockSize)), rk[0]);
+            for (size_t round = 1; round < c_Rounds; round++)
+            {
+                x = RoundNi<Inverse>(x, rk[round]);
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(oData + b * c_BlockSize), LastRoundNi<Inverse>(x, rk[c_Rounds]));
+        }
+    }
+#endif
+
+    // Cipher without tables on up to 4 blocks, missing ones are zero filled. Inverse cipher gets
+    // inverse S-box from forward one: InvSbox(x) = InvAffine(Sbox(InvAffine(x))).
+    template <bool Inverse>
+    void CryptQuadPortable(const uint8_t *iData, uint8_t *oData, size_t blocks) const
+    {
+        const auto round_key = [this](uint64_t (&q)[8], size_t round)
+        {
+            const uint64_t lo = LoadLE64(m_RoundKeys + round * c_BlockSize), hi = LoadLE64(m_RoundKeys + round * c_BlockSize + 8);
+            for (size_t i = 0; i < 8; i += 2)
+            {
+                q[i] ^= lo;
+                q[i + 1] ^= hi;
+            }
+        };
+        uint64_t q[8] = {};
+        for (size_t b = 0; b < blocks; b++)
+        {
+            q[2 * b]     = LoadLE64(iData + b * c_BlockSize);
+            q[2 * b + 1] = LoadLE64(iData + b * c_BlockSize + 8);
+        }
+        round_key(q, Inverse ? c_Rounds : 0);
+        for (size_t step = 1; step <= c_Rounds; step++)
+        {
+            const size_t round = Inverse ? c_Rounds - step : step;
+            for (size_t i = 0; i < 8; i += 2)
+            {
+                ShiftRows<Inverse>(q[i], q[i + 1]);
+            }
+            if constexpr (Inverse)
+            {
+                for (uint64_t &word : q)
+                {
+                    word = InvAffine(word);
+                }
+            }
+            SubBytes(q);
+            for (uint64_t &word : q)
+            {
+                if constexpr (Inverse)
+                {
+                    word = InvAffine(word);
+                }
+                else if (round != c_Rounds)
+                {
+                    word = MixColumns(word);
+                }
+            }
+            round_key(q, round);
+            if (Inverse && round)
+            {
+                for (uint64_t &word : q)
+                {
+                    word = InvMixColumns(word);
+                }
+            }
+        }
+        for (size_t b = 0; b < blocks; b++)
+        {
+            StoreLE64(oData + b * c_BlockSize,     q[2 * b]);
+            StoreLE64(oData + b * c_BlockSize + 8, q[2 * b + 1]);
+        }
+    }
+
+    template <bool Inverse>
+    void CryptBlocksPortable(const uint8_t *iData, uint8_t *oData, size_t blocks) const
+    {
+        for (size_t b = 0; b < blocks; b += 4)
+        {
+            CryptQuadPortable<Inverse>(iData + b * c_BlockSize, oData + b * c_BlockSize, std::min<size_t>(4, blocks - b));
+        }
+    }
+
+    void EncryptBlocks(const uint8_t *iData, uint8_t *oData, size_t blocks) const
+    {
+#if defined CPU_X86
+        if (CpuFeatures::HasAes())
+        {
+            CryptBlocksNi<false>(m_RoundKeys, iData, oData, blocks);
+            return;
+        }
+#endif
+        CryptBlocksPortable<false>(iData, oData, blocks);
+    }
+
+    void DecryptBlocks(const uint8_t *iData, uint8_t *oData, size_t blocks) const
+    {
+#if defined CPU_X86
+        if (CpuFeatures::HasAes())
+        {
+            CryptBlocksNi<true>(m_InvRoundKeys, iData, oData, blocks);
+            return;
+        }
+#endif
+        CryptBlocksPortable<true>(iData, oData, blocks);
+    }
+
+    bool CryptRangeCTR(uint8_t *iData, size_t iLen, uint64_t firstBlock, uint64_t nonce) const
+    {
+        const uint64_t iv_hi = LoadBE64(m_IV.data()) ^ nonce;
+        const uint64_t iv_lo = LoadBE64(m_IV.data() + 8);
+        alignas(16) std::array<uint8_t, c_CtrKeystreamSize> keystream;
+        uint64_t block_idx = firstBlock;
+        for (size_t offset = 0; offset < iLen; offset += keystream.size())
+        {
+            const size_t part   = std::min(keystream.size(), iLen - offset);
+            const size_t blocks = (part + c_BlockSize - 1) / c_BlockSize;
+            for (size_t i = 0; i < blocks; i++, block_idx++)
+            {
+                // Counter block = IV + block index, carried over whole 128 bits.
+                const uint64_t lo = iv_lo + block_idx;
+                StoreBE64(keystream.data() + i * c_BlockSize,     iv_hi + (lo < iv_lo ? 1 : 0));
+                StoreBE64(keystream.data() + i * c_BlockSize + 8, lo);
+            }
+            EncryptBlocks(keystream.data(), keystream.data(), blocks);
+            size_t i = 0;
+            for (; i + sizeof(uint64_t) <= part; i += sizeof(uint64_t))
+            {
+                uint64_t data, stream;
+                memcpy(&data, iData + offset + i, sizeof(data));
+                memcpy(&stream, keystream.data() + i, sizeof(stream));
+                data ^= stream;
+                memcpy(iData + offset + i, &data, sizeof(data));
+            }
+            for (; i < part; i++)
+            {
+                iData[offset + i] ^= keystream[i];
+            }
+        }
+        return true;
+    }
+
+    bool CryptInPlaceCTR(MutableByteView iData, uint64_t nonce, ThreadPool *pool) const
+    {
+        TRACE_SCOPE("Crypto", "AES CTR");
+        if (!m_Ready)
+        {
+            return false;
+        }
+        const size_t chunks = (iData.size() + c_CtrChunkSize - 1) / c_CtrChunkSize;
+        if (!pool || chunks <= 1)
+        {
+            return CryptRangeCTR(iData.data(), iData.size(), 0, nonce);
+        }
+        pool->ParallelFor("AES CTR chunk", chunks, [&](size_t idx)
+        {
+            const size_t offset = idx * c_CtrChunkSize;
+            CryptRangeCTR(iData.data() + offset, std::min(c_CtrChunkSize, iData.size() - offset), offset / c_BlockSize, nonce);
+        });
+        return true;
+    }
+
+    template <typename T>
+    bool EncryptCBC(T &iData) const
+    {
+        TRACE_SCOPE("Crypto", "AES CBC encrypt");
+        if (!m_Ready)
+        {
+            return false;
+        }
+        const size_t pad = c_BlockSize - iData.size() % c_BlockSize;
+        iData.resize(iData.size() + pad, static_cast<typename T::value_type>(pad));
+        uint8_t *data = reinterpret_cast<uint8_t*>(&iData[0]);
+        const uint8_t *prev = m_IV.data();
+        for (size_t offset = 0; offset < iData.size(); offset += c_BlockSize)
+        {
+            for (size_t i = 0; i < c_BlockSize; i++)
+            {
+                data[offset + i] ^= prev[i];
+            }
+            EncryptBlocks(data + offset, data + offset, 1);
+            prev = data + offset;
+        }
+        return true;
+    }
+
+    template <typename T>
+    bool DecryptCBC(T &iData) const
+    {
+        TRACE_SCOPE("Crypto", "AES CBC decrypt");
+        if (!m_Ready || iData.empty() || iData.size() % c_BlockSize)
+        {
+            return false;
+        }
+        uint8_t *data = reinterpret_cast<uint8_t*>(&iData[0]);
+        uint8_t prev[c_BlockSize];
+        alignas(16) uint8_t cipher[c_CbcBatchSize];
+        memcpy(prev, m_IV.data(), c_BlockSize);
+        for (size_t offset = 0; offset < iData.size(); offset += sizeof(cipher))
+        {
+            const size_t part = std::min(sizeof(cipher), iData.size() - offset);
+            memcpy(cipher, data + offset, part);
+            DecryptBlocks(cipher, data + offset, part / c_BlockSize);
+            for (size_t i = 0; i < part; i++)
+            {
+                data[offset + i] ^= i < c_BlockSize ? prev[i] : cipher[i - c_BlockSize];
+            }
+            memcpy(prev, cipher + part - c_BlockSize, c_BlockSize);
+        }
+        // Padding is checked without branches on plaintext: all of last block is read, mismatches are or-ed.
+        const uint32_t pad = data[iData.size() - 1];
+        uint32_t bad = ((pad - 1) >> 31) | ((static_cast<uint32_t>(c_BlockSize) - pad) >> 31);
+        for (uint32_t i = 1; i <= c_BlockSize; i++)
+        {
+            const uint32_t in_pad   = 1 ^ ((pad - i) >> 31);
+            const uint32_t mismatch = 1 ^ (((data[iData.size() - i] ^ pad) - 1) >> 31);
+            bad |= in_pad & mismatch;
+        }
+        if (bad)
+        {
+            return false;
+        }
+        iData.resize(iData.size() - pad);
+        return true;
+    }
+
+public:
+                        PortableAES(void) = default;
+
+    bool                EncryptInPlace(std::vector<uint8_t> &iData) const { return EncryptCBC(iData); }
+    bool                EncryptInPlace(std::string &iData) const          { return EncryptCBC(iData); }
+
+    bool                DecryptInPlace(std::vector<uint8_t> &iData) const { return DecryptCBC(iData); }
+    bool                DecryptInPlace(std::string &iData) const          { return DecryptCBC(iData); }
+
+    // AES-256-CTR, IV is initial 128 bit big endian counter. No padding, output size equals input.
+    // Nonce is xored into high half of IV and must never repeat for one key.
+    bool                EncryptInPlaceCTR(MutableByteView iData, uint64_t nonce, ThreadPool *pool = nullptr) const { return CryptInPlaceCTR(iData, nonce, pool); }
+    bool                DecryptInPlaceCTR(MutableByteView iData, uint64_t nonce, ThreadPool *pool = nullptr) const { return CryptInPlaceCTR(iData, nonce, pool); }
+
+    bool                ImportKeys(const std::vector<uint8_t> &key, const std::vector<uint8_t> &iv)
+    {
+        if (key.size() != c_KeySize || iv.size() != c_BlockSize)
+        {
+            return false;
+        }
+        std::copy(key.begin(), key.end(), m_Key.begin());
+        std::copy(iv.begin(), iv.end(), m_IV.begin());
+        ExpandKey();
+        m_Ready = true;
+        return true;
+    }
+
+    // Cheap check whether expanded schedule belongs to given key & IV.
+    bool                HasKeys(ByteView key, ByteView iv) const
+    {
+        return m_Ready && key.size() == c_KeySize && iv.size() == c_BlockSize &&
+               memcmp(key.data(), m_Key.data(), c_KeySize) == 0 && memcmp(iv.data(), m_IV.data(), c_BlockSize) == 0;
+    }
+
+    template <typename T>
+    bool                ExportKeys(T &key, T &iv) const
+    {
+        if (!m_Ready)
+        {
+            return false;
+        }
+        key.assign(m_Key.begin(), m_Key.end());
+        iv.assign(m_IV.begin(), m_IV.end());
+        return true;
+    }
+};
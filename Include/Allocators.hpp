@@ -0,0 +1,264 @@
+#pragma once
+
+// Allocator layer shared by Marshall, ThreadPool & crypto.
+// ThreadCachePool: size classes 16 B .. 64 KiB carved from slabs, free blocks cached per thread,
+//                  surplus goes to shared per class lists. Memory is reused, never returned to OS,
+//                  so heap does not fragment over long uptime. Larger requests go to new/delete.
+// RequestArena:    monotonic arena for one request, everything is released at once. Its chunks come
+//                  from ThreadCachePool, so repeated requests cause no global malloc traffic.
+// Both are std::pmr::memory_resource, pass them to std::pmr containers & *pmr overloads.
+
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "Common.h"
+
+namespace Memory
+{
+    class ThreadCachePool final : public std::pmr::memory_resource
+    {
+        static constexpr size_t c_MinShift   = 4;                          // 16 B
+        static constexpr size_t c_MaxShift   = 16;                         // 64 KiB
+        static constexpr size_t c_Classes    = c_MaxShift - c_MinShift + 1;
+        static constexpr size_t c_SlabSize   = 256 * 1024;
+        static constexpr size_t c_SlabAlign  = 4096;                       // Blocks are aligned to min(class size, page).
+        static constexpr size_t c_CacheLimit = 128;                        // Blocks per class kept by one thread.
+        static constexpr size_t c_Refill     = 32;                         // Blocks taken from shared list at once.
+
+        struct FreeBlock
+        {
+            FreeBlock *next;
+        };
+
+        struct SharedList
+        {
+            std::mutex  mutex;
+            FreeBlock  *head  = nullptr;
+            size_t      count = 0;
+        };
+
+        struct ThreadCache
+        {
+            FreeBlock *head[c_Classes]  = {};
+            size_t     count[c_Classes] = {};
+
+            ~ThreadCache();
+        };
+
+        SharedList          m_Shared[c_Classes];
+        std::mutex          m_SlabMutex;
+        std::vector<void*>  m_Slabs;
+
+        ThreadCachePool(void) = default;
+
+        static size_t ClassOf(size_t bytes, size_t alignment)
+        {
+            size_t size  = std::max(bytes, alignment);
+            size_t shift = c_MinShift;
+            while ((size_t(1) << shift) < size)
+            {
+                shift++;
+            }
+            return shift - c_MinShift;
+        }
+
+        static size_t ClassSize(size_t cls) { return size_t(1) << (cls + c_MinShift); }
+
+        static bool Pooled(size_t bytes, size_t alignment)
+        {
+            return bytes <= ClassSize(c_Classes - 1) && alignment <= c_SlabAlign;
+        }
+
+        // Thread cache is gone during thread exit, late frees go straight to shared lists.
+        static inline thread_local bool t_CacheGone = false;
+
+        static ThreadCache *Cache(void)
+        {
+            if (t_CacheGone)
+            {
+                return nullptr;
+            }
+            thread_local ThreadCache cache;
+            return &cache;
+        }
+
+        void PushShared(size_t cls, FreeBlock *head, FreeBlock *tail, size_t count)
+        {
+            std::lock_guard lock(m_Shared[cls].mutex);
+            tail->next           = m_Shared[cls].head;
+            m_Shared[cls].head   = head;
+            m_Shared[cls].count += count;
+        }
+
+        // Refills thread cache from shared list or new slab, returns one block.
+        FreeBlock *Refill(size_t cls, ThreadCache *cache)
+        {
+            {
+                std::lock_guard lock(m_Shared[cls].mutex);
+                SharedList &shared = m_Shared[cls];
+                if (shared.head)
+                {
+                    FreeBlock *block = shared.head;
+                    shared.head = block->next;
+                    shared.count--;
+                    for (size_t i = 0; cache && i < c_Refill && shared.head; i++)
+                    {
+                        FreeBlock *extra = shared.head;
+                        shared.head = extra->next;
+                        shared.count--;
+                        extra->next       = cache->head[cls];
+                        cache->head[cls]  = extra;
+                        cache->count[cls]++;
+                    }
+                    return block;
+                }
+            }
+            const size_t block_size = ClassSize(cls);
+            const size_t slab_size  = std::max(c_SlabSize, block_size * 4);
+            uint8_t *slab = static_cast<uint8_t*>(::operator new(slab_size, std::align_val_t(c_SlabAlign)));
+            {
+                std::lock_guard lock(m_SlabMutex);
+                m_Slabs.push_back(slab);
+            }
+            // First block goes to caller, next c_Refill to thread cache, rest to shared list.
+            FreeBlock *head  = nullptr;
+            size_t     count = 0;
+            for (size_t offset = slab_size - block_size; offset > 0; offset -= block_size)
+            {
+                FreeBlock *block = reinterpret_cast<FreeBlock*>(slab + offset);
+                block->next = head;
+                head = block;
+                count++;
+            }
+            for (size_t i = 0; cache && head && i < c_Refill; i++, count--)
+            {
+                FreeBlock *block = head;
+                head = block->next;
+                block->next       = cache->head[cls];
+                cache->head[cls]  = block;
+                cache->count[cls]++;
+            }
+            if (head)
+            {
+                // Last block of slab is the tail, list was built from the end.
+                PushShared(cls, head, reinterpret_cast<FreeBlock*>(slab + slab_size - block_size), count);
+            }
+            return reinterpret_cast<FreeBlock*>(slab);
+        }
+
+    protected:
+        void *do_allocate(size_t bytes, size_t alignment) override
+        {
+            if (!Pooled(bytes, alignment))
+            {
+                return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+            }
+            const size_t cls   = ClassOf(bytes, alignment);
+            ThreadCache *cache = Cache();
+            if (cache && cache->head[cls])
+            {
+                FreeBlock *block = cache->head[cls];
+                cache->head[cls] = block->next;
+                cache->count[cls]--;
+                return block;
+            }
+            return Refill(cls, cache);
+        }
+
+        void do_deallocate(void *ptr, size_t bytes, size_t alignment) override
+        {
+            if (!Pooled(bytes, alignment))
+            {
+                std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+                return;
+            }
+            const size_t cls   = ClassOf(bytes, alignment);
+            FreeBlock   *block = static_cast<FreeBlock*>(ptr);
+            ThreadCache *cache = Cache();
+            if (!cache)
+            {
+                PushShared(cls, block, block, 1);
+                return;
+            }
+            block->next      = cache->head[cls];
+            cache->head[cls] = block;
+            if (++cache->count[cls] <= c_CacheLimit)
+            {
+                return;
+            }
+            // Producer / consumer threads would pile blocks up on consumer side, hand half of them over.
+            FreeBlock *head = cache->head[cls];
+            FreeBlock *tail = head;
+            for (size_t i = 1; i < c_CacheLimit / 2; i++)
+            {
+                tail = tail->next;
+            }
+            cache->head[cls]   = tail->next;
+            cache->count[cls] -= c_CacheLimit / 2;
+            PushShared(cls, head, tail, c_CacheLimit / 2);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+        {
+            return this == &other;
+        }
+
+    public:
+        ThreadCachePool(const ThreadCachePool&)            = delete;
+        ThreadCachePool &operator=(const ThreadCachePool&) = delete;
+
+        // Never destroyed, blocks may be freed by static & thread_local destructors at exit.
+        static ThreadCachePool *Instance(void)
+        {
+            static ThreadCachePool *instance = new ThreadCachePool();
+            return instance;
+        }
+    };
+
+    inline ThreadCachePool::ThreadCache::~ThreadCache()
+    {
+        t_CacheGone = true;
+        ThreadCachePool *pool = Instance();
+        for (size_t cls = 0; cls < c_Classes; cls++)
+        {
+            if (!head[cls])
+            {
+                continue;
+            }
+            FreeBlock *tail = head[cls];
+            while (tail->next)
+            {
+                tail = tail->next;
+            }
+            pool->PushShared(cls, head[cls], tail, count[cls]);
+        }
+    }
+
+    // Monotonic arena scoped to one request. Deallocation is no-op, memory is released on destruction.
+    // Usage: Memory::RequestArena arena; std::pmr::vector<uint8_t> data(&arena); ...
+    class RequestArena final : public std::pmr::memory_resource
+    {
+        static constexpr size_t c_InitialSize = 16 * 1024;
+
+        std::pmr::monotonic_buffer_resource m_Resource;
+
+    protected:
+        void *do_allocate(size_t bytes, size_t alignment) override          { return m_Resource.allocate(bytes, alignment); }
+        void  do_deallocate(void *ptr, size_t bytes, size_t alignment) override { m_Resource.deallocate(ptr, bytes, alignment); }
+        bool  do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+
+    public:
+        explicit RequestArena(size_t initialSize = c_InitialSize, std::pmr::memory_resource *upstream = ThreadCachePool::Instance()) :
+            m_Resource(initialSize, upstream) {}
+
+        RequestArena(const RequestArena&)            = delete;
+        RequestArena &operator=(const RequestArena&) = delete;
+
+        // Frees everything allocated so far, arena may serve next request.
+        void Release(void) { m_Resource.release(); }
+    };
+}
@@ -0,0 +1,736 @@
+#pragma once
+
+// Asynchronous file I/O engine.
+// Linux: io_uring over raw syscalls (no liburing), batched submission & registered (fixed) buffers.
+// Elsewhere, or when io_uring is unavailable: blocking positional I/O on ThreadPool workers.
+// Completions are delivered as continuations on ThreadPool, several per task.
+// Short transfers are resubmitted until request is complete, EOF or error.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Common.h"
+#include "ThreadWrap.hpp"
+
+#if defined PLATFORM_LINUX
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#elif defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+namespace AsyncIO
+{
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+    using NativeFile = HANDLE;
+#else
+    using NativeFile = int;
+#endif
+
+    enum class Operation : uint8_t
+    {
+        Read,
+        Write,
+        Fsync
+    };
+
+    enum class Backend : uint8_t
+    {
+        Auto,       // io_uring when kernel allows it, Threads otherwise.
+        IoUring,
+        Threads
+    };
+
+    // Bytes transferred, or negative errno.
+    using Completion = std::function<void(int64_t result)>;
+
+    struct Request
+    {
+        Operation   Op               = Operation::Read;
+        NativeFile  File             = {};
+        uint8_t    *Buffer           = nullptr;
+        size_t      Length           = 0;
+        uint64_t    Offset           = 0;
+        int32_t     RegisteredBuffer = -1;      // Index from Engine::RegisterBuffers, buffer must lie inside it.
+        Completion  OnComplete;
+
+        static Request Read(NativeFile file, MutableByteView oData, uint64_t offset, Completion onComplete)
+        {
+            return { Operation::Read, file, oData.data(), oData.size(), offset, -1, std::move(onComplete) };
+        }
+
+        static Request Write(NativeFile file, ByteView iData, uint64_t offset, Completion onComplete)
+        {
+            return { Operation::Write, file, const_cast<uint8_t*>(iData.data()), iData.size(), offset, -1, std::move(onComplete) };
+        }
+
+        static Request Fsync(NativeFile file, Completion onComplete)
+        {
+            return { Operation::Fsync, file, nullptr, 0, 0, -1, std::move(onComplete) };
+        }
+    };
+
+    namespace Detail
+    {
+        // One blocking transfer, may be short.
+        inline int64_t PositionalIO(const Request &request, size_t done)
+        {
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+            if (request.Op == Operation::Fsync)
+            {
+                return FlushFileBuffers(request.File) ? 0 : -static_cast<int64_t>(GetLastError());
+            }
+            OVERLAPPED overlapped = {};
+            const uint64_t offset = request.Offset + done;
+            overlapped.Offset     = static_cast<DWORD>(offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            const DWORD length = static_cast<DWORD>(std::min<size_t>(request.Length - done, 1u << 30));
+            DWORD transferred = 0;
+            const BOOL result = request.Op == Operation::Read ?
+                ReadFile(request.File, request.Buffer + done, length, &transferred, &overlapped) :
+                WriteFile(request.File, request.Buffer + done, length, &transferred, &overlapped);
+            if (!result)
+            {
+                const DWORD error = GetLastError();
+                return error == ERROR_HANDLE_EOF ? 0 : -static_cast<int64_t>(error);
+            }
+            return transferred;
+#else
+            ssize_t result = 0;
+            do
+            {
+                switch (request.Op)
+                {
+                case Operation::Read:
+                    result = pread(request.File, request.Buffer + done, request.Length - done, static_cast<off_t>(request.Offset + done));
+                    break;
+                case Operation::Write:
+                    result = pwrite(request.File, request.Buffer + done, request.Length - done, static_cast<off_t>(request.Offset + done));
+                    break;
+                case Operation::Fsync:
+                    result = fsync(request.File);
+                    break;
+                }
+            } while (result < 0 && errno == EINTR);
+            return result < 0 ? -static_cast<int64_t>(errno) : static_cast<int64_t>(result);
+#endif
+        }
+
+        // Whole request, looping over short transfers.
+        inline int64_t CompleteIO(const Request &request)
+        {
+            if (request.Op == Operation::Fsync)
+            {
+                return PositionalIO(request, 0);
+            }
+            size_t done = 0;
+            while (done < request.Length)
+            {
+                const int64_t result = PositionalIO(request, done);
+                if (result < 0)
+                {
+                    return done ? static_cast<int64_t>(done) : result;
+                }
+                if (result == 0)
+                {
+                    break;
+                }
+                done += static_cast<size_t>(result);
+            }
+            return static_cast<int64_t>(done);
+        }
+
+#if defined PLATFORM_LINUX
+        // Minimal io_uring: one submission queue guarded by caller, completions reaped by one thread.
+        class Uring
+        {
+            int         m_Fd        = -1;
+            void       *m_SqRing    = MAP_FAILED;
+            void       *m_CqRing    = MAP_FAILED;
+            size_t      m_SqRingSize = 0;
+            size_t      m_CqRingSize = 0;
+            io_uring_sqe *m_Sqes    = static_cast<io_uring_sqe*>(MAP_FAILED);
+            size_t      m_SqesSize  = 0;
+
+            unsigned   *m_SqHead    = nullptr;
+            unsigned   *m_SqTail    = nullptr;
+            unsigned   *m_SqMask    = nullptr;
+            unsigned   *m_SqArray   = nullptr;
+            unsigned    m_SqEntries = 0;
+            unsigned    m_SqLocalTail = 0;
+            unsigned   *m_CqHead    = nullptr;
+            unsigned   *m_CqTail    = nullptr;
+            unsigned   *m_CqMask    = nullptr;
+            io_uring_cqe *m_Cqes    = nullptr;
+            unsigned    m_CqEntries = 0;
+
+        public:
+            Uring() = default;
+            Uring(const Uring&)            = delete;
+            Uring &operator=(const Uring&) = delete;
+
+            ~Uring()
+            {
+                if (m_Sqes != MAP_FAILED)
+                {
+                    munmap(m_Sqes, m_SqesSize);
+                }
+                if (m_CqRing != MAP_FAILED && m_CqRing != m_SqRing)
+                {
+                    munmap(m_CqRing, m_CqRingSize);
+                }
+                if (m_SqRing != MAP_FAILED)
+                {
+                    munmap(m_SqRing, m_SqRingSize);
+                }
+                if (m_Fd >= 0)
+                {
+                    close(m_Fd);
+                }
+            }
+
+            bool Init(unsigned entries)
+            {
+                io_uring_params params = {};
+                m_Fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+                // IORING_OP_READ / WRITE came along with RW_CUR_POS (5.6), older kernels use thread fallback.
+                if (m_Fd < 0 || !(params.features & IORING_FEAT_RW_CUR_POS))
+                {
+                    return false;
+                }
+                m_SqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+                m_CqRingSize = params.cq_off.cqes  + params.cq_entries * sizeof(io_uring_cqe);
+                const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+                if (single_mmap)
+                {
+                    m_SqRingSize = m_CqRingSize = std::max(m_SqRingSize, m_CqRingSize);
+                }
+                m_SqRing = mmap(nullptr, m_SqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_Fd, IORING_OFF_SQ_RING);
+                if (m_SqRing == MAP_FAILED)
+                {
+                    return false;
+                }
+                m_CqRing = single_mmap ? m_SqRing :
+                           mmap(nullptr, m_CqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_Fd, IORING_OFF_CQ_RING);
+                if (m_CqRing == MAP_FAILED)
+                {
+                    return false;
+                }
+                m_SqesSize = params.sq_entries * sizeof(io_uring_sqe);
+                m_Sqes = static_cast<io_uring_sqe*>(mmap(nullptr, m_SqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_Fd, IORING_OFF_SQES));
+                if (m_Sqes == MAP_FAILED)
+                {
+                    return false;
+                }
+                auto *sq = static_cast<uint8_t*>(m_SqRing);
+                auto *cq = static_cast<uint8_t*>(m_CqRing);
+                m_SqHead    = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+                m_SqTail    = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+                m_SqMask    = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+                m_SqArray   = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+                m_SqEntries = params.sq_entries;
+                m_SqLocalTail = *m_SqTail;
+                m_CqHead    = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+                m_CqTail    = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+                m_CqMask    = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+                m_Cqes      = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+                m_CqEntries = params.cq_entries;
+                return true;
+            }
+
+            unsigned SqEntries() const { return m_SqEntries; }
+            unsigned CqEntries() const { return m_CqEntries; }
+
+            bool RegisterBuffers(const std::vector<iovec> &buffers)
+            {
+                return syscall(__NR_io_uring_register, m_Fd, IORING_REGISTER_BUFFERS, buffers.data(), static_cast<unsigned>(buffers.size())) == 0;
+            }
+
+            // Next free sqe, nullptr if submission queue is full.
+            io_uring_sqe *NextSqe()
+            {
+                const unsigned head = __atomic_load_n(m_SqHead, __ATOMIC_ACQUIRE);
+                if (m_SqLocalTail - head >= m_SqEntries)
+                {
+                    return nullptr;
+                }
+                const unsigned idx = m_SqLocalTail & *m_SqMask;
+                io_uring_sqe *sqe = &m_Sqes[idx];
+                memset(sqe, 0, sizeof(*sqe));
+                m_SqArray[idx] = idx;
+                m_SqLocalTail++;
+                return sqe;
+            }
+
+            // Publishes prepared sqes & enters kernel once for all of them.
+            // On error sqes kernel did not take are withdrawn from queue, their count goes to oWithdrawn.
+            int Submit(unsigned *oWithdrawn = nullptr)
+            {
+                const unsigned pending = m_SqLocalTail - *m_SqTail;
+                __atomic_store_n(m_SqTail, m_SqLocalTail, __ATOMIC_RELEASE);
+                unsigned submitted = 0;
+                while (submitted < pending)
+                {
+                    const long result = syscall(__NR_io_uring_enter, m_Fd, pending - submitted, 0, 0, nullptr, 0);
+                    if (result < 0)
+                    {
+                        if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                        {
+                            std::this_thread::yield();
+                            continue;
+                        }
+                        const int error = -errno;
+                        const unsigned head = __atomic_load_n(m_SqHead, __ATOMIC_ACQUIRE);
+                        if (oWithdrawn)
+                        {
+                            *oWithdrawn = m_SqLocalTail - head;
+                        }
+                        m_SqLocalTail = head;
+                        __atomic_store_n(m_SqTail, head, __ATOMIC_RELEASE);
+                        return error;
+                    }
+                    submitted += static_cast<unsigned>(result);
+                }
+                return static_cast<int>(submitted);
+            }
+
+            // Blocks until at least one completion, then hands out all available ones.
+            template <typename Handler>
+            bool WaitCompletions(const Handler &handler)
+            {
+                unsigned head = *m_CqHead;
+                if (head == __atomic_load_n(m_CqTail, __ATOMIC_ACQUIRE))
+                {
+                    const long result = syscall(__NR_io_uring_enter, m_Fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+                    if (result < 0 && errno != EINTR)
+                    {
+                        return false;
+                    }
+                }
+                const unsigned tail = __atomic_load_n(m_CqTail, __ATOMIC_ACQUIRE);
+                for (; head != tail; head++)
+                {
+                    const io_uring_cqe &cqe = m_Cqes[head & *m_CqMask];
+                    handler(cqe.user_data, cqe.res);
+                }
+                __atomic_store_n(m_CqHead, head, __ATOMIC_RELEASE);
+                return true;
+            }
+        };
+#endif
+    }
+
+    class Engine
+    {
+        static constexpr size_t c_CompletionsPerTask = 32;
+
+        struct Pending
+        {
+            Request Req;
+            size_t  Done = 0;
+        };
+
+        ThreadPool                     *m_Pool       = nullptr;
+        uint32_t                        m_QueueDepth = 0;
+        Backend                         m_Backend    = Backend::Threads;
+        std::vector<MutableByteView>    m_Registered;
+
+        std::mutex                      m_Mutex;
+        std::condition_variable         m_Changed;
+        size_t                          m_InFlight   = 0;       // Requests in kernel or on workers.
+        size_t                          m_Unfinished = 0;       // Requests whose continuation did not finish yet.
+
+#if defined PLATFORM_LINUX
+        Detail::Uring                   m_Ring;
+        std::mutex                      m_SubmitMutex;
+        std::thread                     m_Reaper;
+        std::atomic<bool>               m_Stop       = false;
+#endif
+
+        bool ValidRegistered(const Request &request) const
+        {
+            if (request.RegisteredBuffer < 0)
+            {
+                return true;
+            }
+            if (static_cast<size_t>(request.RegisteredBuffer) >= m_Registered.size())
+            {
+                return false;
+            }
+            const MutableByteView &region = m_Registered[request.RegisteredBuffer];
+            return request.Buffer >= region.data() && request.Buffer + request.Length <= region.data() + region.size();
+        }
+
+        // Waits until count more requests fit into queue depth.
+        // Thread backend is bounded by pool queue only: continuation blocked here would hold the worker its I/O needs.
+        void Reserve(size_t count)
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_Changed.wait(lock, [&]() { return m_Backend == Backend::Threads || m_InFlight + count <= m_QueueDepth; });
+            m_InFlight   += count;
+            m_Unfinished += count;
+        }
+
+        void Finished(size_t count)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                m_Unfinished -= count;
+            }
+            m_Changed.notify_all();
+        }
+
+        // Runs continuations on pool, grouped to not pay task overhead per request.
+        void Dispatch(std::vector<std::pair<Completion, int64_t>> &&completions, bool inPlace = false)
+        {
+            if (completions.empty())
+            {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                m_InFlight -= completions.size();
+            }
+            m_Changed.notify_all();
+            if (inPlace || !m_Pool)
+            {
+                for (auto &[completion, result] : completions)
+                {
+                    if (completion)
+                    {
+                        completion(result);
+                    }
+                }
+                Finished(completions.size());
+                return;
+            }
+            for (size_t first = 0; first < completions.size(); first += c_CompletionsPerTask)
+            {
+                const size_t last = std::min(completions.size(), first + c_CompletionsPerTask);
+                auto group = std::make_shared<std::vector<std::pair<Completion, int64_t>>>(
+                    std::make_move_iterator(completions.begin() + first), std::make_move_iterator(completions.begin() + last));
+                m_Pool->AddDetachedTask("AsyncIO completion", std::function<void()>([this, group]()
+                {
+                    for (auto &[completion, result] : *group)
+                    {
+                        if (completion)
+                        {
+                            completion(result);
+                        }
+                    }
+                    Finished(group->size());
+                }));
+            }
+        }
+
+        bool SubmitThreads(std::vector<Request> &requests)
+        {
+            for (auto &request : requests)
+            {
+                Reserve(1);
+                auto pending = std::make_shared<Request>(std::move(request));
+                const auto run = [this, pending]()
+                {
+                    std::vector<std::pair<Completion, int64_t>> completion;
+                    completion.emplace_back(std::move(pending->OnComplete), Detail::CompleteIO(*pending));
+                    // Already on worker, continuation runs in place.
+                    Dispatch(std::move(completion), true);
+                };
+                if (m_Pool)
+                {
+                    m_Pool->AddDetachedTask("AsyncIO request", std::function<void()>(run));
+                }
+                else
+                {
+                    run();
+                }
+            }
+            return true;
+        }
+
+#if defined PLATFORM_LINUX
+        // Fills sqe for remaining part of request. Caller holds m_SubmitMutex.
+        void Prepare(io_uring_sqe *sqe, Pending *pending)
+        {
+            const Request &request = pending->Req;
+            sqe->fd        = request.File;
+            sqe->user_data = reinterpret_cast<uint64_t>(pending);
+            switch (request.Op)
+            {
+            case Operation::Read:
+            case Operation::Write:
+            {
+                const bool fixed = request.RegisteredBuffer >= 0;
+                if (request.Op == Operation::Read)
+                {
+                    sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+                }
+                else
+                {
+                    sqe->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+                }
+                sqe->addr      = reinterpret_cast<uint64_t>(request.Buffer + pending->Done);
+                sqe->len       = static_cast<uint32_t>(std::min<size_t>(request.Length - pending->Done, 1u << 30));
+                sqe->off       = request.Offset + pending->Done;
+                sqe->buf_index = fixed ? static_cast<uint16_t>(request.RegisteredBuffer) : 0;
+                break;
+            }
+            case Operation::Fsync:
+                sqe->opcode = IORING_OP_FSYNC;
+                break;
+            }
+        }
+
+        // Queues all pendings, one io_uring_enter per filled submission queue.
+        // Returns 0 or -errno of failed submission, pendings keeps only ones kernel never got then.
+        int Enqueue(std::vector<Pending*> &pendings)
+        {
+            std::lock_guard<std::mutex> lock(m_SubmitMutex);
+            int      error     = 0;
+            unsigned withdrawn = 0;
+            size_t   prepared  = 0;
+            for (; prepared < pendings.size(); prepared++)
+            {
+                io_uring_sqe *sqe = m_Ring.NextSqe();
+                if (!sqe)
+                {
+                    if ((error = m_Ring.Submit(&withdrawn)) < 0)
+                    {
+                        break;
+                    }
+                    sqe = m_Ring.NextSqe();
+                    while (!sqe)
+                    {
+                        std::this_thread::yield();
+                        sqe = m_Ring.NextSqe();
+                    }
+                }
+                Prepare(sqe, pendings[prepared]);
+            }
+            if (error >= 0 && prepared && (error = m_Ring.Submit(&withdrawn)) >= 0)
+            {
+                pendings.clear();
+                return 0;
+            }
+            // Earlier submits took everything queued before, so withdrawn sqes are the last prepared ones.
+            pendings.erase(pendings.begin(), pendings.begin() + (prepared - withdrawn));
+            return error;
+        }
+
+        // Requests which never reached kernel: continuation gets error (or bytes already moved),
+        // Dispatch gives back counts taken by Reserve.
+        void Fail(std::vector<Pending*> &pendings, int error)
+        {
+            std::vector<std::pair<Completion, int64_t>> completions;
+            for (Pending *pending : pendings)
+            {
+                completions.emplace_back(std::move(pending->Req.OnComplete), pending->Done ? static_cast<int64_t>(pending->Done) : error);
+                delete pending;
+            }
+            pendings.clear();
+            Dispatch(std::move(completions));
+        }
+
+        void ReaperLoop()
+        {
+            std::vector<std::pair<Completion, int64_t>> completions;
+            std::vector<Pending*> resubmit;
+            while (true)
+            {
+                bool wakeup = false;
+                const bool alive = m_Ring.WaitCompletions([&](uint64_t userData, int32_t result)
+                {
+                    if (!userData)
+                    {
+                        wakeup = true;
+                        return;
+                    }
+                    auto *pending = reinterpret_cast<Pending*>(userData);
+                    const Request &request = pending->Req;
+                    if (result > 0 && request.Op != Operation::Fsync)
+                    {
+                        pending->Done += static_cast<size_t>(result);
+                        if (pending->Done < request.Length)
+                        {
+                            resubmit.push_back(pending);
+                            return;
+                        }
+                    }
+                    const int64_t total = result < 0 && !pending->Done ? result : static_cast<int64_t>(pending->Done);
+                    completions.emplace_back(std::move(pending->Req.OnComplete), total);
+                    delete pending;
+                });
+                if (!resubmit.empty())
+                {
+                    if (const int error = Enqueue(resubmit))
+                    {
+                        Fail(resubmit, error);
+                    }
+                    resubmit.clear();
+                }
+                Dispatch(std::move(completions));
+                completions.clear();
+                if (!alive || (wakeup && m_Stop))
+                {
+                    break;
+                }
+            }
+        }
+
+        bool SubmitUring(std::vector<Request> &requests)
+        {
+            std::vector<Pending*> pendings;
+            const size_t chunk = std::min<size_t>(m_QueueDepth, m_Ring.SqEntries());
+            for (size_t first = 0; first < requests.size(); first += chunk)
+            {
+                const size_t last = std::min(requests.size(), first + chunk);
+                Reserve(last - first);
+                pendings.clear();
+                for (size_t i = first; i < last; i++)
+                {
+                    pendings.push_back(new Pending{ std::move(requests[i]) });
+                }
+                if (const int error = Enqueue(pendings))
+                {
+                    // Rest of batch is not tried, it gets same error as if it was taken.
+                    {
+                        std::lock_guard<std::mutex> lock(m_Mutex);
+                        m_InFlight   += requests.size() - last;
+                        m_Unfinished += requests.size() - last;
+                    }
+                    for (size_t i = last; i < requests.size(); i++)
+                    {
+                        pendings.push_back(new Pending{ std::move(requests[i]) });
+                    }
+                    Fail(pendings, error);
+                    return false;
+                }
+            }
+            return true;
+        }
+#endif
+
+    public:
+        // queueDepth bounds requests in flight, Submit blocks while it is reached.
+        explicit Engine(ThreadPool *pool = ThreadPool::GLobalInstance(), uint32_t queueDepth = 256, Backend backend = Backend::Auto) :
+            m_Pool(pool), m_QueueDepth(std::max<uint32_t>(queueDepth, 1))
+        {
+#if defined PLATFORM_LINUX
+            if (backend != Backend::Threads && m_Ring.Init(m_QueueDepth))
+            {
+                // Completion queue is twice as large as submission one, in flight limit keeps it from overflowing.
+                m_QueueDepth = std::min<uint32_t>(m_QueueDepth, m_Ring.CqEntries());
+                m_Backend = Backend::IoUring;
+                m_Reaper  = std::thread(&Engine::ReaperLoop, this);
+            }
+#endif
+        }
+
+        Engine(const Engine&)            = delete;
+        Engine &operator=(const Engine&) = delete;
+
+        ~Engine()
+        {
+            Drain();
+#if defined PLATFORM_LINUX
+            if (m_Reaper.joinable())
+            {
+                m_Stop = true;
+                {
+                    std::lock_guard<std::mutex> lock(m_SubmitMutex);
+                    io_uring_sqe *sqe = nullptr;
+                    while (!(sqe = m_Ring.NextSqe()))
+                    {
+                        std::this_thread::yield();
+                    }
+                    sqe->opcode = IORING_OP_NOP;
+                    m_Ring.Submit();
+                }
+                m_Reaper.join();
+            }
+#endif
+        }
+
+        Backend ActiveBackend() const { return m_Backend; }
+
+        // Pins buffers for fixed reads / writes. Call once, before submitting requests that reference them.
+        bool RegisterBuffers(const std::vector<MutableByteView> &buffers)
+        {
+            if (!m_Registered.empty() || buffers.empty())
+            {
+                return false;
+            }
+#if defined PLATFORM_LINUX
+            if (m_Backend == Backend::IoUring)
+            {
+                std::vector<iovec> iovecs;
+                for (const auto &buffer : buffers)
+                {
+                    iovecs.push_back({ buffer.data(), buffer.size() });
+                }
+                if (!m_Ring.RegisterBuffers(iovecs))
+                {
+                    return false;
+                }
+            }
+#endif
+            m_Registered = buffers;
+            return true;
+        }
+
+        // Whole batch goes to kernel with as few syscalls as queue size allows.
+        // Requests are moved from, false if any is invalid (nothing submitted then) or submission failed.
+        // In second case requests kernel did not get are completed with the error, so Drain still returns.
+        bool Submit(std::vector<Request> &requests)
+        {
+            for (const auto &request : requests)
+            {
+                if (!ValidRegistered(request) || (request.Op != Operation::Fsync && !request.Buffer && request.Length))
+                {
+                    return false;
+                }
+            }
+#if defined PLATFORM_LINUX
+            if (m_Backend == Backend::IoUring)
+            {
+                return SubmitUring(requests);
+            }
+#endif
+            return SubmitThreads(requests);
+        }
+
+        bool Submit(Request request)
+        {
+            std::vector<Request> requests;
+            requests.push_back(std::move(request));
+            return Submit(requests);
+        }
+
+        // Waits until every submitted request completed & its continuation returned.
+        // Must not be called from continuation.
+        void Drain()
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_Changed.wait(lock, [this]() { return m_Unfinished == 0; });
+        }
+
+        size_t InFlight()
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            return m_InFlight;
+        }
+    };
+}
@@ -0,0 +1,1030 @@
+#pragma once
+
+// Asynchronous logging backend.
+// Producers copy arguments into a per thread lock free ring (single producer / single consumer),
+// background consumer formats records, batches them & hands batch to the sink with one write.
+// Enabled for Log_*F macros by defining LOG_ASYNC before including LogLib.h.
+// Binary mode (LOG_BINARY or Options::Mode): consumer writes format id, timestamp & raw arguments
+// instead of text, format strings are written once per call site. Tools/LogDecoder turns it back into text.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "Common.h"
+
+namespace AsyncLog
+{
+    enum class Level : uint8_t
+    {
+        Debug = 0,
+        Info,
+        Warning,
+        Error,
+        None
+    };
+
+    // What producer does when its ring is full.
+    enum class OverflowPolicy : uint8_t
+    {
+        Drop,       // Record is discarded & counted.
+        Block,      // Producer waits for consumer to free a slot.
+        Sample      // After ring is 3/4 full only every SampleRate record is kept, then Drop.
+    };
+
+    enum class Encoding : uint8_t
+    {
+        Text,
+        Binary
+    };
+
+    struct Options
+    {
+        size_t                                  RingCapacity  = 1024;                           // Records per thread, rounded up to power of 2.
+        OverflowPolicy                          Policy        = OverflowPolicy::Drop;
+        uint32_t                                SampleRate    = 16;
+        std::chrono::milliseconds               FlushInterval = std::chrono::milliseconds(5);
+        Level                                   MinLevel      = Level::Debug;
+#if defined LOG_BINARY
+        Encoding                                Mode          = Encoding::Binary;
+#else
+        Encoding                                Mode          = Encoding::Text;
+#endif
+        std::string                             Path;                                           // Append to file, if no Sink.
+        std::function<void(std::string_view)>   Sink;                                           // Default: Path or stderr.
+    };
+
+    // Call site of Log_*F macro. Id is computed at compile time from file, line & format.
+    struct Site
+    {
+        const uint32_t          Id;
+        const Level             Severity;
+        const char *const       File;
+        const uint32_t          Line;
+        const char *const       Format;
+        std::atomic<uint64_t>   RegisteredWith = 0;     // Serial of logger which already has this format.
+
+        constexpr Site(uint32_t id, Level severity, const char *file, uint32_t line, const char *format) :
+            Id(id), Severity(severity), File(file), Line(line), Format(format) {}
+    };
+
+    // FNV-1a over file, line & format. 0 is reserved for records without a site.
+    constexpr uint32_t SiteId(const char *file, uint32_t line, const char *format)
+    {
+        uint32_t hash = 2166136261u;
+        for (const char *it = file; *it; it++)
+        {
+            hash = (hash ^ static_cast<uint8_t>(*it)) * 16777619u;
+        }
+        for (int i = 0; i < 4; i++, line >>= 8)
+        {
+            hash = (hash ^ (line & 0xFF)) * 16777619u;
+        }
+        for (const char *it = format; *it; it++)
+        {
+            hash = (hash ^ static_cast<uint8_t>(*it)) * 16777619u;
+        }
+        return hash ? hash : 1;
+    }
+
+    // Binary log layout. Integers are LEB128 varints, signed ones zigzag encoded, strings are varint length + bytes.
+    // Session:  Magic, Version, then entries. Sessions can be appended to the same file.
+    // Format:   'F' id(fixed32) level(u8) line file format signature
+    // Thread:   'T' index name
+    // Record:   'R' id(fixed32) thread timestamp_delta(zigzag, ns) arguments by signature
+    // Text:     'X' level(u8) thread timestamp_delta message    (calls without site or oversized arguments)
+    // Dropped:  'D' thread count
+    // Signature: one code per argument: b bool, c char, i signed, u unsigned, f double, s string, p pointer,
+    //            t text formatted by consumer, D + duration suffix index ('0' + Detail::DurationIndex).
+    namespace Binary
+    {
+        constexpr char    c_Magic[8] = { 'L', 'M', 'B', 'T', 'B', 'L', 'O', 'G' };
+        constexpr uint8_t c_Version  = 1;
+
+        enum EntryKind : uint8_t
+        {
+            Entry_Format  = 'F',
+            Entry_Thread  = 'T',
+            Entry_Record  = 'R',
+            Entry_Text    = 'X',
+            Entry_Dropped = 'D'
+        };
+
+        inline void PutVarint(std::string &out, uint64_t value)
+        {
+            while (value >= 0x80)
+            {
+                out += static_cast<char>(value | 0x80);
+                value >>= 7;
+            }
+            out += static_cast<char>(value);
+        }
+
+        inline void PutZigzag(std::string &out, int64_t value)
+        {
+            PutVarint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+        }
+
+        inline void PutFixed32(std::string &out, uint32_t value)
+        {
+            for (int i = 0; i < 4; i++, value >>= 8)
+            {
+                out += static_cast<char>(value & 0xFF);
+            }
+        }
+
+        inline void PutString(std::string &out, std::string_view value)
+        {
+            PutVarint(out, value.size());
+            out += value;
+        }
+
+        class Reader
+        {
+            const uint8_t *m_Pos = nullptr;
+            const uint8_t *m_End = nullptr;
+            bool           m_Ok  = true;
+
+        public:
+            Reader(const uint8_t *data, size_t size) : m_Pos(data), m_End(data + size) {}
+
+            bool   Ok()        const { return m_Ok; }
+            bool   AtEnd()     const { return m_Pos >= m_End; }
+            size_t Remaining() const { return static_cast<size_t>(m_End - m_Pos); }
+
+            uint8_t Byte()
+            {
+                if (m_Pos >= m_End)
+                {
+                    m_Ok = false;
+                    return 0;
+                }
+                return *m_Pos++;
+            }
+
+            uint64_t Varint()
+            {
+                uint64_t value = 0;
+                for (int shift = 0; shift < 64; shift += 7)
+                {
+                    const uint8_t byte = Byte();
+                    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+                    if (!(byte & 0x80))
+                    {
+                        return value;
+                    }
+                }
+                m_Ok = false;
+                return 0;
+            }
+
+            int64_t Zigzag()
+            {
+                const uint64_t value = Varint();
+                return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+            }
+
+            uint32_t Fixed32()
+            {
+                uint32_t value = 0;
+                for (int i = 0; i < 4; i++)
+                {
+                    value |= static_cast<uint32_t>(Byte()) << (8 * i);
+                }
+                return value;
+            }
+
+            std::string_view String()
+            {
+                const uint64_t size = Varint();
+                if (!m_Ok || size > Remaining())
+                {
+                    m_Ok = false;
+                    return {};
+                }
+                const std::string_view value(reinterpret_cast<const char*>(m_Pos), static_cast<size_t>(size));
+                m_Pos += size;
+                return value;
+            }
+
+            bool Expect(const void *data, size_t size)
+            {
+                if (size > Remaining() || memcmp(m_Pos, data, size))
+                {
+                    return false;
+                }
+                m_Pos += size;
+                return true;
+            }
+        };
+    }
+
+    namespace Detail
+    {
+        // Minimal "{}" formatter, format specs inside braces are ignored, "{{" & "}}" are escapes.
+        template <typename T, typename = void>
+        struct IsStreamable : std::false_type {};
+        template <typename T>
+        struct IsStreamable<T, std::void_t<decltype(std::declval<std::ostream&>() << std::declval<const T&>())>> : std::true_type {};
+
+        template <typename T>
+        struct IsDuration : std::false_type {};
+        template <typename R, typename P>
+        struct IsDuration<std::chrono::duration<R, P>> : std::true_type {};
+
+        // Durations with integral count are stored raw in binary mode, rest goes as text.
+        template <typename T>
+        struct IsIntegralDuration : std::false_type {};
+        template <typename R, typename P>
+        struct IsIntegralDuration<std::chrono::duration<R, P>> : std::is_integral<R> {};
+
+        constexpr const char *c_DurationSuffixes[] = { "ns", "us", "ms", "s", "min", "h", "" };
+
+        template <typename P>
+        constexpr uint8_t DurationIndex()
+        {
+            if constexpr      (std::is_same_v<P, std::nano>)        return 0;
+            else if constexpr (std::is_same_v<P, std::micro>)       return 1;
+            else if constexpr (std::is_same_v<P, std::milli>)       return 2;
+            else if constexpr (std::is_same_v<P, std::ratio<1>>)    return 3;
+            else if constexpr (std::is_same_v<P, std::ratio<60>>)   return 4;
+            else if constexpr (std::is_same_v<P, std::ratio<3600>>) return 5;
+            else                                                    return 6;
+        }
+
+        inline void AppendDouble(std::string &out, double value)
+        {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%g", value);
+            out += buf;
+        }
+
+        inline void AppendPointer(std::string &out, const void *value)
+        {
+            char buf[24];
+            snprintf(buf, sizeof(buf), "%p", value);
+            out += buf;
+        }
+
+        // Text of string like argument, null C string is "(null)" rather than crash inside logging call.
+        template <typename T>
+        inline std::string_view ArgView(const T &value)
+        {
+            if constexpr (std::is_pointer_v<T>)
+            {
+                return value ? std::string_view(value) : std::string_view("(null)");
+            }
+            else
+            {
+                return std::string_view(value);
+            }
+        }
+
+        template <typename T>
+        inline void AppendArg(std::string &out, const T &value)
+        {
+            if constexpr (std::is_same_v<T, bool>)
+            {
+                out += value ? "true" : "false";
+            }
+            else if constexpr (std::is_same_v<T, char>)
+            {
+                out += value;
+            }
+            else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>)
+            {
+                out += std::to_string(static_cast<std::conditional_t<std::is_signed_v<T>, long long, unsigned long long>>(value));
+            }
+            else if constexpr (std::is_floating_point_v<T>)
+            {
+                AppendDouble(out, static_cast<double>(value));
+            }
+            else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+            {
+                out += ArgView(value);
+            }
+            else if constexpr (IsDuration<T>::value)
+            {
+                AppendArg(out, value.count());
+                out += c_DurationSuffixes[DurationIndex<typename T::period>()];
+            }
+            else if constexpr (std::is_pointer_v<T>)
+            {
+                AppendPointer(out, static_cast<const void*>(value));
+            }
+            else if constexpr (IsStreamable<T>::value)
+            {
+                std::ostringstream stream;
+                stream << value;
+                out += stream.str();
+            }
+            else
+            {
+                out += "{?}";
+            }
+        }
+
+        inline void FormatTo(std::string &out, std::string_view format, const std::function<void(std::string&, size_t)> &arg, size_t argCount)
+        {
+            size_t next = 0;
+            for (size_t i = 0; i < format.size(); i++)
+            {
+                const char c = format[i];
+                if ((c == '{' || c == '}') && i + 1 < format.size() && format[i + 1] == c)
+                {
+                    out += c;
+                    i++;
+                    continue;
+                }
+                if (c == '{')
+                {
+                    const size_t close = format.find('}', i);
+                    if (close != std::string_view::npos)
+                    {
+                        if (next < argCount)
+                        {
+                            arg(out, next++);
+                        }
+                        i = close;
+                        continue;
+                    }
+                }
+                out += c;
+            }
+        }
+
+        template <typename ...Args>
+        inline void Format(std::string &out, std::string_view format, const std::tuple<Args...> &args)
+        {
+            FormatTo(out, format, [&args](std::string &o, size_t idx)
+            {
+                size_t cur = 0;
+                std::apply([&](const auto &...values) { ((cur++ == idx ? AppendArg(o, values) : void()), ...); }, args);
+            }, sizeof...(Args));
+        }
+
+        // Arguments are stored by value, C strings & views are copied since caller buffers don`t outlive the call.
+        template <typename T>
+        using Stored = std::conditional_t<std::is_convertible_v<std::decay_t<T>, std::string_view> && !std::is_same_v<std::decay_t<T>, std::nullptr_t>,
+                                          std::string, std::decay_t<T>>;
+
+        template <typename T>
+        inline Stored<T> Store(T &&value)
+        {
+            if constexpr (std::is_pointer_v<std::decay_t<T>> && std::is_same_v<Stored<T>, std::string>)
+            {
+                return Stored<T>(ArgView(value));
+            }
+            else
+            {
+                return Stored<T>(std::forward<T>(value));
+            }
+        }
+
+        template <typename T>
+        inline void AppendTypeCode(std::string &out)
+        {
+            if constexpr      (std::is_same_v<T, bool>)                         out += 'b';
+            else if constexpr (std::is_same_v<T, char>)                         out += 'c';
+            else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)    out += 'i';
+            else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>)      out += 'u';
+            else if constexpr (std::is_floating_point_v<T>)                     out += 'f';
+            else if constexpr (std::is_convertible_v<const T&, std::string_view>) out += 's';
+            else if constexpr (IsIntegralDuration<T>::value)
+            {
+                out += 'D';
+                out += static_cast<char>('0' + DurationIndex<typename T::period>());
+            }
+            else if constexpr (std::is_pointer_v<T>)                            out += 'p';
+            else                                                                out += 't';
+        }
+
+        // Raw argument as described by AppendTypeCode.
+        template <typename T>
+        inline void EncodeArg(std::string &out, const T &value)
+        {
+            if constexpr (std::is_same_v<T, bool> || std::is_same_v<T, char>)
+            {
+                out += static_cast<char>(value);
+            }
+            else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+            {
+                Binary::PutZigzag(out, static_cast<int64_t>(value));
+            }
+            else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>)
+            {
+                Binary::PutVarint(out, static_cast<uint64_t>(value));
+            }
+            else if constexpr (std::is_floating_point_v<T>)
+            {
+                const double number = static_cast<double>(value);
+                char raw[sizeof(double)];
+                memcpy(raw, &number, sizeof(raw));
+                out.append(raw, sizeof(raw));
+            }
+            else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+            {
+                Binary::PutString(out, ArgView(value));
+            }
+            else if constexpr (IsIntegralDuration<T>::value)
+            {
+                Binary::PutZigzag(out, static_cast<int64_t>(value.count()));
+            }
+            else if constexpr (std::is_pointer_v<T>)
+            {
+                Binary::PutVarint(out, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(value)));
+            }
+            else
+            {
+                std::string text;
+                AppendArg(text, value);
+                Binary::PutString(out, text);
+            }
+        }
+
+        template <typename ...Args>
+        inline std::string Signature()
+        {
+            std::string signature;
+            (AppendTypeCode<Args>(signature), ...);
+            return signature;
+        }
+
+        inline const char *LevelName(Level level)
+        {
+            switch (level)
+            {
+            case Level::Debug:   return "DEBUG";
+            case Level::Info:    return "INFO";
+            case Level::Warning: return "WARN";
+            case Level::Error:   return "ERROR";
+            default:             return "?";
+            }
+        }
+
+        // "[time] [LEVEL] [thread] " prefix. Date part is cached per second, localtime is far too slow per record.
+        class LinePrefix
+        {
+            time_t      m_CachedSecond = -1;
+            std::string m_CachedDate;
+
+        public:
+            void Append(std::string &out, int64_t timestamp, Level level, std::string_view thread)
+            {
+                const time_t seconds = static_cast<time_t>(timestamp / 1000000000);
+                if (seconds != m_CachedSecond)
+                {
+                    tm local = {};
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+                    localtime_s(&local, &seconds);
+#else
+                    localtime_r(&seconds, &local);
+#endif
+                    char buf[32];
+                    m_CachedDate.assign(buf, strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &local));
+                    m_CachedSecond = seconds;
+                }
+                char micro[8];
+                snprintf(micro, sizeof(micro), ".%06u", static_cast<unsigned>((timestamp % 1000000000) / 1000));
+                out += '[';
+                out += m_CachedDate;
+                out += micro;
+                out += "] [";
+                out += LevelName(level);
+                out += "] [";
+                out += thread;
+                out += "] ";
+            }
+        };
+
+        struct Record
+        {
+            static constexpr size_t c_Size        = 128;
+            // Formats (or encodes raw when binary) & destroys payload.
+            using HandlerFn = void (*)(std::string &out, void *payload, bool binary);
+
+            int64_t         Timestamp = 0;                              // system_clock, ns
+            HandlerFn       Handler   = nullptr;
+            uint32_t        FormatId  = 0;                              // Site id, 0 - payload is plain text.
+            Level           Severity  = Level::Debug;
+            alignas(std::max_align_t) unsigned char Payload[c_Size - 2 * sizeof(std::max_align_t)];
+        };
+        static_assert(sizeof(Record) <= Record::c_Size, "Log record must stay in two cache lines");
+
+        // FormatT is std::string_view for call site literals, std::string for runtime formats:
+        // caller buffer may be gone before consumer thread formats the record.
+        template <typename FormatT, typename ...Args>
+        struct Payload
+        {
+            FormatT             Format;
+            std::tuple<Args...> Values;
+
+            static void Invoke(std::string &out, void *ptr, bool binary)
+            {
+                auto *self = static_cast<Payload*>(ptr);
+                if (binary)
+                {
+                    std::apply([&out](const auto &...values) { (EncodeArg(out, values), ...); }, self->Values);
+                }
+                else
+                {
+                    Detail::Format(out, self->Format, self->Values);
+                }
+                self->~Payload();
+            }
+        };
+
+        // Single producer / single consumer ring, owned by one producer thread.
+        class Ring
+        {
+            std::unique_ptr<Record[]>   m_Records;
+            size_t                      m_Mask;
+            alignas(64) std::atomic<size_t> m_Head    = 0;              // Written by producer.
+            size_t                      m_CachedTail  = 0;
+            uint32_t                    m_SampleCount = 0;
+            alignas(64) std::atomic<size_t> m_Tail    = 0;              // Written by consumer.
+            alignas(64) std::atomic<uint64_t> m_Dropped = 0;
+            std::atomic<bool>           m_Retired     = false;          // Producer thread exited.
+            std::atomic<bool>           m_Orphaned    = false;          // Logger destroyed.
+
+        public:
+            const std::thread::id       ThreadId      = std::this_thread::get_id();
+            const uint32_t              Index;                          // Thread number within logger session.
+            bool                        Announced     = false;          // Consumer only, thread entry written.
+
+            Ring(size_t capacity, uint32_t index) : Index(index)
+            {
+                size_t size = 2;
+                while (size < capacity)
+                {
+                    size <<= 1;
+                }
+                m_Records.reset(new Record[size]);
+                m_Mask = size - 1;
+            }
+
+            ~Ring()
+            {
+                std::string scratch;
+                Drain(scratch, false, [](const Record&, std::string_view) {});
+            }
+
+            size_t Capacity() const { return m_Mask + 1; }
+
+            // Producer side. Returns slot to fill or nullptr, commit with Publish().
+            template <typename Wake>
+            Record *Acquire(OverflowPolicy policy, uint32_t sampleRate, const Wake &wakeConsumer)
+            {
+                const size_t head = m_Head.load(std::memory_order_relaxed);
+                size_t used = head - m_CachedTail;
+                if (used >= (Capacity() * 3) / 4)
+                {
+                    wakeConsumer();
+                    m_CachedTail = m_Tail.load(std::memory_order_acquire);
+                    used = head - m_CachedTail;
+                }
+                if (policy == OverflowPolicy::Sample && used >= (Capacity() * 3) / 4 && (m_SampleCount++ % sampleRate))
+                {
+                    m_Dropped.fetch_add(1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+                while (used >= Capacity())
+                {
+                    if (policy != OverflowPolicy::Block)
+                    {
+                        m_Dropped.fetch_add(1, std::memory_order_relaxed);
+                        return nullptr;
+                    }
+                    wakeConsumer();
+                    std::this_thread::yield();
+                    m_CachedTail = m_Tail.load(std::memory_order_acquire);
+                    used = head - m_CachedTail;
+                }
+                return &m_Records[head & m_Mask];
+            }
+
+            void Publish()
+            {
+                m_Head.store(m_Head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            }
+
+            // Consumer side. Records with site are encoded raw in binary mode, rest is formatted.
+            template <typename Out>
+            size_t Drain(std::string &scratch, bool binary, const Out &out)
+            {
+                const size_t head = m_Head.load(std::memory_order_acquire);
+                size_t tail = m_Tail.load(std::memory_order_relaxed);
+                const size_t count = head - tail;
+                for (; tail != head; tail++)
+                {
+                    Record &record = m_Records[tail & m_Mask];
+                    scratch.clear();
+                    record.Handler(scratch, record.Payload, binary && record.FormatId);
+                    out(record, scratch);
+                }
+                m_Tail.store(tail, std::memory_order_release);
+                return count;
+            }
+
+            uint64_t TakeDropped() { return m_Dropped.exchange(0, std::memory_order_relaxed); }
+            bool     Empty() const { return m_Head.load(std::memory_order_acquire) == m_Tail.load(std::memory_order_acquire); }
+            void     Retire()      { m_Retired.store(true, std::memory_order_release); }
+            bool     Retired() const { return m_Retired.load(std::memory_order_acquire); }
+            void     Orphan()      { m_Orphaned.store(true, std::memory_order_release); }
+            bool     Orphaned() const { return m_Orphaned.load(std::memory_order_acquire); }
+        };
+    }
+
+    class Logger
+    {
+        static inline std::atomic<uint64_t>         s_NextSerial = 1;
+        const uint64_t                              m_Serial     = s_NextSerial++;  // Never reused, unlike address.
+        Options                                     m_Options;
+        std::atomic<Level>                          m_MinLevel = Level::Debug;
+        std::mutex                                  m_RingsMutex;
+        std::vector<std::shared_ptr<Detail::Ring>>  m_Rings;
+        uint32_t                                    m_NextRingIndex = 0;
+        std::mutex                                  m_SitesMutex;
+        std::unordered_map<uint32_t, const Site*>   m_Sites;
+        std::string                                 m_PendingFormats;           // Encoded format entries not written yet.
+        std::mutex                                  m_WakeMutex;
+        std::condition_variable                     m_WakeCv;
+        std::condition_variable                     m_FlushedCv;
+        uint64_t                                    m_FlushRequest  = 0;
+        uint64_t                                    m_FlushDone     = 0;
+        bool                                        m_Stop          = false;
+        std::atomic<bool>                           m_WakeRequested = false;    // Set by producers running out of ring space.
+        Detail::LinePrefix                          m_Prefix;                   // Consumer only from here.
+        int64_t                                     m_LastTimestamp = 0;
+        bool                                        m_HeaderWritten = false;
+        FILE                                       *m_File          = nullptr;
+        std::thread                                 m_Consumer;
+
+        // Thread rings of every logger the thread wrote to. Rings of destroyed loggers are dropped on next registration.
+        struct RingHolder
+        {
+            std::vector<std::pair<uint64_t, std::shared_ptr<Detail::Ring>>> Rings;
+            uint64_t      LastSerial = 0;
+            Detail::Ring *Last       = nullptr;
+
+            ~RingHolder()
+            {
+                for (const auto &entry : Rings)
+                {
+                    entry.second->Retire();
+                }
+            }
+        };
+
+        Detail::Ring &ThreadRing()
+        {
+            thread_local RingHolder holder;
+            if (holder.LastSerial == m_Serial)
+            {
+                return *holder.Last;
+            }
+            auto it = std::find_if(holder.Rings.begin(), holder.Rings.end(), [this](const auto &entry) { return entry.first == m_Serial; });
+            if (it == holder.Rings.end())
+            {
+                holder.Rings.erase(std::remove_if(holder.Rings.begin(), holder.Rings.end(), [](const auto &entry) { return entry.second->Orphaned(); }),
+                                   holder.Rings.end());
+                std::lock_guard<std::mutex> lock(m_RingsMutex);
+                holder.Rings.emplace_back(m_Serial, std::make_shared<Detail::Ring>(m_Options.RingCapacity, m_NextRingIndex++));
+                m_Rings.push_back(holder.Rings.back().second);
+                it = std::prev(holder.Rings.end());
+            }
+            holder.LastSerial = m_Serial;
+            holder.Last       = it->second.get();
+            return *holder.Last;
+        }
+
+        void Wake()
+        {
+            if (!m_WakeRequested.exchange(true, std::memory_order_acq_rel))
+            {
+                m_WakeCv.notify_one();
+            }
+        }
+
+        // Once per site, before its first record. Returns id its records carry: site.Id, or on hash collision
+        // next free id (probe order is fixed & entries are never removed, so same site finds same slot again).
+        template <typename ...Args>
+        uint32_t Register(Site &site)
+        {
+            std::lock_guard<std::mutex> lock(m_SitesMutex);
+            uint32_t id = site.Id;
+            for (auto known = m_Sites.find(id); known != m_Sites.end() && known->second != &site; known = m_Sites.find(id))
+            {
+                id = (id + 1) ? id + 1 : 1;     // 0 is reserved for records without a site.
+            }
+            if (m_Sites.emplace(id, &site).second && m_Options.Mode == Encoding::Binary)
+            {
+                m_PendingFormats += static_cast<char>(Binary::Entry_Format);
+                Binary::PutFixed32(m_PendingFormats, id);
+                m_PendingFormats += static_cast<char>(site.Severity);
+                Binary::PutVarint(m_PendingFormats, site.Line);
+                Binary::PutString(m_PendingFormats, site.File);
+                Binary::PutString(m_PendingFormats, site.Format);
+                Binary::PutString(m_PendingFormats, Detail::Signature<Args...>());
+            }
+            // Fast path only for own id: probed id belongs to this logger, site is shared by all of them.
+            if (id == site.Id)
+            {
+                site.RegisteredWith.store(m_Serial, std::memory_order_release);
+            }
+            return id;
+        }
+
+        template <typename FormatT, typename ...Args>
+        void PushRecord(uint32_t formatId, Level level, std::string_view format, Args&& ...args)
+        {
+            using PayloadT = Detail::Payload<FormatT, Detail::Stored<Args>...>;
+            Detail::Ring &ring = ThreadRing();
+            Detail::Record *record = ring.Acquire(m_Options.Policy, m_Options.SampleRate, [this]() { Wake(); });
+            if (!record)
+            {
+                return;
+            }
+            record->Timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            record->Severity  = level;
+            if constexpr (sizeof(PayloadT) <= sizeof(record->Payload) && alignof(PayloadT) <= alignof(std::max_align_t))
+            {
+                new (record->Payload) PayloadT{ FormatT(format), std::tuple<Detail::Stored<Args>...>(Detail::Store<Args>(std::forward<Args>(args))...) };
+                record->Handler  = &PayloadT::Invoke;
+                record->FormatId = formatId;
+            }
+            else
+            {
+                // Arguments too large for a slot, format in place.
+                std::string text;
+                Detail::Format(text, format, std::forward_as_tuple(args...));
+                using TextPayload = Detail::Payload<std::string_view, std::string>;
+                new (record->Payload) TextPayload{ "{}", std::tuple<std::string>(std::move(text)) };
+                record->Handler  = &TextPayload::Invoke;
+                record->FormatId = 0;
+            }
+            ring.Publish();
+        }
+
+        void AppendText(std::string &batch, const Detail::Ring &ring, const Detail::Record &record, std::string_view message, const std::string &threadName)
+        {
+            if (m_Options.Mode == Encoding::Text)
+            {
+                m_Prefix.Append(batch, record.Timestamp, record.Severity, threadName);
+                batch += message;
+                batch += '\n';
+                return;
+            }
+            batch += static_cast<char>(Binary::Entry_Text);
+            batch += static_cast<char>(record.Severity);
+            Binary::PutVarint(batch, ring.Index);
+            Binary::PutZigzag(batch, record.Timestamp - m_LastTimestamp);
+            Binary::PutString(batch, message);
+            m_LastTimestamp = record.Timestamp;
+        }
+
+        // Drains every ring into one batch & writes it. Returns records written.
+        size_t DrainAll(std::string &batch, std::string &scratch)
+        {
+            const bool binary = m_Options.Mode == Encoding::Binary;
+            std::vector<std::shared_ptr<Detail::Ring>> rings;
+            {
+                std::lock_guard<std::mutex> lock(m_RingsMutex);
+                rings = m_Rings;
+            }
+            size_t total = 0;
+            for (const auto &ring : rings)
+            {
+                std::ostringstream tid;
+                tid << ring->ThreadId;
+                const std::string thread_name = tid.str();
+                if (binary && !ring->Announced)
+                {
+                    batch += static_cast<char>(Binary::Entry_Thread);
+                    Binary::PutVarint(batch, ring->Index);
+                    Binary::PutString(batch, thread_name);
+                    ring->Announced = true;
+                }
+                total += ring->Drain(scratch, binary, [&](const Detail::Record &record, std::string_view message)
+                {
+                    if (!binary || !record.FormatId)
+                    {
+                        AppendText(batch, *ring, record, message, thread_name);
+                        return;
+                    }
+                    batch += static_cast<char>(Binary::Entry_Record);
+                    Binary::PutFixed32(batch, record.FormatId);
+                    Binary::PutVarint(batch, ring->Index);
+                    Binary::PutZigzag(batch, record.Timestamp - m_LastTimestamp);
+                    batch += message;
+                    m_LastTimestamp = record.Timestamp;
+                });
+                if (const uint64_t dropped = ring->TakeDropped())
+                {
+                    if (binary)
+                    {
+                        batch += static_cast<char>(Binary::Entry_Dropped);
+                        Binary::PutVarint(batch, ring->Index);
+                        Binary::PutVarint(batch, dropped);
+                    }
+                    else
+                    {
+                        batch += "[AsyncLog] [" + thread_name + "] " + std::to_string(dropped) + " records dropped\n";
+                    }
+                }
+            }
+            if (binary)
+            {
+                // Formats are taken after draining: every drained record registered its site before it was published.
+                std::string prologue;
+                if (!m_HeaderWritten)
+                {
+                    prologue.append(Binary::c_Magic, sizeof(Binary::c_Magic));
+                    prologue += static_cast<char>(Binary::c_Version);
+                    m_HeaderWritten = true;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(m_SitesMutex);
+                    prologue += m_PendingFormats;
+                    m_PendingFormats.clear();
+                }
+                if (!prologue.empty() && !batch.empty())
+                {
+                    batch.insert(0, prologue);
+                }
+                else if (!prologue.empty())
+                {
+                    batch.swap(prologue);
+                }
+            }
+            if (!batch.empty())
+            {
+                Write(batch);
+                batch.clear();
+            }
+            std::lock_guard<std::mutex> lock(m_RingsMutex);
+            for (auto it = m_Rings.begin(); it != m_Rings.end();)
+            {
+                it = (*it)->Retired() && (*it)->Empty() ? m_Rings.erase(it) : std::next(it);
+            }
+            return total;
+        }
+
+        void Write(std::string_view batch)
+        {
+            if (m_Options.Sink)
+            {
+                m_Options.Sink(batch);
+                return;
+            }
+            FILE *out = m_File ? m_File : stderr;
+            fwrite(batch.data(), 1, batch.size(), out);
+            fflush(out);
+        }
+
+        void ConsumerLoop()
+        {
+            std::string batch, scratch;
+            std::unique_lock<std::mutex> lock(m_WakeMutex);
+            while (true)
+            {
+                m_WakeCv.wait_for(lock, m_Options.FlushInterval, [this]() { return m_Stop || m_FlushRequest != m_FlushDone || m_WakeRequested.exchange(false); });
+                const bool     stop    = m_Stop;
+                const uint64_t request = m_FlushRequest;
+                lock.unlock();
+                DrainAll(batch, scratch);
+                lock.lock();
+                m_FlushDone = request;
+                m_FlushedCv.notify_all();
+                if (stop)
+                {
+                    break;
+                }
+            }
+        }
+
+    public:
+        explicit Logger(Options options = Defaults()) : m_Options(std::move(options)), m_MinLevel(m_Options.MinLevel)
+        {
+            if (m_Options.SampleRate == 0)
+            {
+                m_Options.SampleRate = 1;
+            }
+            if (!m_Options.Sink && !m_Options.Path.empty())
+            {
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+                fopen_s(&m_File, m_Options.Path.c_str(), "ab");
+#else
+                m_File = fopen(m_Options.Path.c_str(), "ab");
+#endif
+            }
+            m_Consumer = std::thread(&Logger::ConsumerLoop, this);
+        }
+
+        Logger(const Logger&)            = delete;
+        Logger &operator=(const Logger&) = delete;
+
+        ~Logger()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_WakeMutex);
+                m_Stop = true;
+            }
+            m_WakeCv.notify_one();
+            m_Consumer.join();
+            for (const auto &ring : m_Rings)
+            {
+                ring->Orphan();
+            }
+            if (m_File)
+            {
+                fclose(m_File);
+            }
+        }
+
+        // Options used by Instance(), change before first log call.
+        static Options &Defaults()
+        {
+            static Options options;
+            return options;
+        }
+
+        // Process wide logger used by Log_*F macros.
+        static Logger &Instance()
+        {
+            static Logger instance;
+            return instance;
+        }
+
+        void  SetMinLevel(Level level) { m_MinLevel.store(level, std::memory_order_relaxed); }
+        Level MinLevel() const         { return m_MinLevel.load(std::memory_order_relaxed); }
+        bool  Enabled(Level level) const { return level >= MinLevel(); }
+
+        // Hot path: copy arguments (and format, it may be runtime string) into calling thread ring,
+        // no locks & no formatting.
+        template <typename ...Args>
+        void Push(Level level, std::string_view format, Args&& ...args)
+        {
+            if (Enabled(level))
+            {
+                PushRecord<std::string>(0, level, format, std::forward<Args>(args)...);
+            }
+        }
+
+        // Same for macro call site, registers its format on first use.
+        template <typename ...Args>
+        void Push(Site &site, Args&& ...args)
+        {
+            uint32_t id = site.Id;
+            if (site.RegisteredWith.load(std::memory_order_acquire) != m_Serial)
+            {
+                id = Register<Detail::Stored<Args>...>(site);
+            }
+            PushRecord<std::string_view>(id, site.Severity, site.Format, std::forward<Args>(args)...);
+        }
+
+        // Blocks until everything pushed before the call is written.
+        void Flush()
+        {
+            std::unique_lock<std::mutex> lock(m_WakeMutex);
+            const uint64_t request = ++m_FlushRequest;
+            m_WakeCv.notify_one();
+            m_FlushedCv.wait(lock, [&]() { return m_FlushDone >= request; });
+        }
+    };
+
+    template <typename ...Args>
+    inline void Push(Level level, std::string_view format, Args&& ...args)
+    {
+        Logger::Instance().Push(level, format, std::forward<Args>(args)...);
+    }
+}
+
+// Level is checked before arguments are evaluated, site id is a compile time constant.
+#define ASYNC_LOG_SITE(level, format, ...)                                                                          \
+    do                                                                                                              \
+    {                                                                                                               \
+        if (AsyncLog::Logger::Instance().Enabled(level))                                                            \
+        {                                                                                                           \
+            static AsyncLog::Site async_log_site(std::integral_constant<uint32_t, AsyncLog::SiteId(__FILE__, __LINE__, format)>::value, \
+                                                 level, __FILE__, __LINE__, format);                                \
+            AsyncLog::Logger::Instance().Push(async_log_site, ##__VA_ARGS__);                                       \
+        }                                                                                                           \
+    } while (0)
@@ -0,0 +1,538 @@
+#pragma once
+
+// Portable Base64 codec, standard & URL safe alphabets (RFC 4648).
+// Works over caller buffers, bulk is processed with AVX2 / SSSE3 kernels picked in runtime.
+// Decoding is strict: foreign symbols, misplaced padding & non zero trailing bits are rejected.
+// Encoder / Decoder classes keep partial groups between Update calls for streams.
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <string_view>
+
+#include "Common.h"
+#include "CpuFeatures.hpp"
+
+namespace Base64
+{
+    enum class Alphabet
+    {
+        Standard,   // '+' '/'
+        UrlSafe     // '-' '_'
+    };
+
+    struct Options
+    {
+        Alphabet alphabet = Alphabet::Standard;
+        bool     padding  = true;               // Encode with '=' & require it on decode.
+    };
+
+    constexpr size_t EncodedSize(size_t iLen, bool padding = true)
+    {
+        return padding ? (iLen + 2) / 3 * 4 : iLen / 3 * 4 + (iLen % 3 ? iLen % 3 + 1 : 0);
+    }
+
+    // Upper bound, exact size depends on padding.
+    constexpr size_t DecodedMaxSize(size_t iLen)
+    {
+        return (iLen + 3) / 4 * 3;
+    }
+
+    namespace Detail
+    {
+        constexpr int8_t c_Invalid = -1;
+
+        struct Table
+        {
+            char   encode[64] = {};
+            int8_t decode[256] = {};
+            char   char62 = 0;
+            char   char63 = 0;
+
+            constexpr Table(char c62, char c63) : char62(c62), char63(c63)
+            {
+                for (int i = 0; i < 256; i++)
+                {
+                    decode[i] = c_Invalid;
+                }
+                for (int i = 0; i < 64; i++)
+                {
+                    const char c = i < 26 ? static_cast<char>('A' + i) : i < 52 ? static_cast<char>('a' + i - 26) :
+                                   i < 62 ? static_cast<char>('0' + i - 52) : i == 62 ? c62 : c63;
+                    encode[i] = c;
+                    decode[static_cast<uint8_t>(c)] = static_cast<int8_t>(i);
+                }
+            }
+        };
+
+        inline constexpr Table c_Standard = Table('+', '/');
+        inline constexpr Table c_UrlSafe  = Table('-', '_');
+
+        inline const Table &GetTable(Alphabet alphabet)
+        {
+            return alphabet == Alphabet::UrlSafe ? c_UrlSafe : c_Standard;
+        }
+
+        // Whole triples only.
+        inline void EncodeScalar(const uint8_t *iData, size_t triples, char *oData, const Table &table)
+        {
+            for (size_t i = 0; i < triples; i++, iData += 3, oData += 4)
+            {
+                const uint32_t v = (static_cast<uint32_t>(iData[0]) << 16) | (static_cast<uint32_t>(iData[1]) << 8) | iData[2];
+                oData[0] = table.encode[(v >> 18) & 0x3F];
+                oData[1] = table.encode[(v >> 12) & 0x3F];
+                oData[2] = table.encode[(v >> 6)  & 0x3F];
+                oData[3] = table.encode[v & 0x3F];
+            }
+        }
+
+        // Whole quads without padding, returns false on first foreign symbol.
+        inline bool DecodeScalar(const char *iData, size_t quads, uint8_t *oData, const Table &table)
+        {
+            for (size_t i = 0; i < quads; i++, iData += 4, oData += 3)
+            {
+                const int32_t a = table.decode[static_cast<uint8_t>(iData[0])], b = table.decode[static_cast<uint8_t>(iData[1])],
+                              c = table.decode[static_cast<uint8_t>(iData[2])], d = table.decode[static_cast<uint8_t>(iData[3])];
+                if ((a | b | c | d) < 0)
+                {
+                    return false;
+                }
+                const uint32_t v = (static_cast<uint32_t>(a) << 18) | (static_cast<uint32_t>(b) << 12) | (static_cast<uint32_t>(c) << 6) | static_cast<uint32_t>(d);
+                oData[0] = static_cast<uint8_t>(v >> 16);
+                oData[1] = static_cast<uint8_t>(v >> 8);
+                oData[2] = static_cast<uint8_t>(v);
+            }
+            return true;
+        }
+
+        // Last group: 1..4 symbols, padding symbols included in iLen. Returns decoded bytes or -1.
+        inline int DecodeLast(const char *iData, size_t iLen, uint8_t *oData, const Table &table, bool padding)
+        {
+            size_t symbols = iLen;
+            while (symbols && iData[symbols - 1] == '=')
+            {
+                symbols--;
+            }
+            const size_t pads = iLen - symbols;
+            if (padding ? (iLen != 4 || pads > 2) : pads != 0)
+            {
+                return -1;
+            }
+            if (symbols < 2)
+            {
+                return -1;
+            }
+            uint32_t v = 0;
+            for (size_t i = 0; i < symbols; i++)
+            {
+                const int8_t s = table.decode[static_cast<uint8_t>(iData[i])];
+                if (s < 0)
+                {
+                    return -1;
+                }
+                v |= static_cast<uint32_t>(s) << (18 - 6 * i);
+            }
+            const int bytes = static_cast<int>(symbols) - 1;
+            // Bits below decoded bytes must be zero, otherwise encoding is not canonical.
+            if (v & (0xFFFFFFu >> (8 * bytes)))
+            {
+                return -1;
+            }
+            for (int i = 0; i < bytes; i++)
+            {
+                oData[i] = static_cast<uint8_t>(v >> (16 - 8 * i));
+            }
+            return bytes;
+        }
+
+#if defined CPU_X86
+        // 6 bit indices of 3 byte groups spread to 4 bytes each, groups come in [b1 b0 b2 b1] order.
+        CPU_TARGET("ssse3") inline __m128i EncodeUnpack(__m128i in)
+        {
+            const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+            const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+            const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+            const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+            return _mm_or_si128(t1, t3);
+        }
+
+        CPU_TARGET("ssse3") inline __m128i EncodeTranslate(__m128i indices, const Table &table)
+        {
+            const __m128i shift_lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                    '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                    static_cast<char>(table.char62 - 62), static_cast<char>(table.char63 - 63), 'A', 0, 0);
+            __m128i lut_idx = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+            const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+            lut_idx = _mm_or_si128(lut_idx, _mm_and_si128(less, _mm_set1_epi8(13)));
+            return _mm_add_epi8(_mm_shuffle_epi8(shift_lut, lut_idx), indices);
+        }
+
+        // Returns consumed input bytes, multiple of 12.
+        CPU_TARGET("ssse3") inline size_t EncodeSsse3(const uint8_t *iData, size_t iLen, char *oData, const Table &table)
+        {
+            const __m128i shuffle = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+            size_t consumed = 0;
+            // Loads 16 bytes, uses 12.
+            for (; consumed + 16 <= iLen; consumed += 12, oData += 16)
+            {
+                const __m128i in = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(iData + consumed)), shuffle);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(oData), EncodeTranslate(EncodeUnpack(in), table));
+            }
+            return consumed;
+        }
+
+        CPU_TARGET("avx2") inline size_t EncodeAvx2(const uint8_t *iData, size_t iLen, char *oData, const Table &table)
+        {
+            const __m256i shuffle   = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                                       1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+            const __m256i shift_lut = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                       '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                       static_cast<char>(table.char62 - 62), static_cast<char>(table.char63 - 63), 'A', 0, 0,
+                                                       'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                       '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                       static_cast<char>(table.char62 - 62), static_cast<char>(table.char63 - 63), 'A', 0, 0);
+            size_t consumed = 0;
+            // Two 16 byte loads 12 bytes apart, 24 bytes used.
+            for (; consumed + 28 <= iLen; consumed += 24, oData += 32)
+            {
+                const uint8_t *src = iData + consumed;
+                __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src))),
+                                                     _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 12)), 1);
+                in = _mm256_shuffle_epi8(in, shuffle);
+                const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+                const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+                const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+                const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+                const __m256i indices = _mm256_or_si256(t1, t3);
+                __m256i lut_idx = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+                const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+                lut_idx = _mm256_or_si256(lut_idx, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(oData), _mm256_add_epi8(_mm256_shuffle_epi8(shift_lut, lut_idx), indices));
+            }
+            return consumed;
+        }
+
+        // Range based translation, so one kernel serves both alphabets. Returns false if any symbol is foreign.
+        CPU_TARGET("ssse3") inline bool DecodeTranslate(__m128i &io, const Table &table)
+        {
+            const __m128i in        = io;
+            const __m128i upper     = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(in, _mm_set1_epi8('Z' + 1)));
+            const __m128i lower     = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(in, _mm_set1_epi8('z' + 1)));
+            const __m128i digit     = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(in, _mm_set1_epi8('9' + 1)));
+            const __m128i is62      = _mm_cmpeq_epi8(in, _mm_set1_epi8(table.char62));
+            const __m128i is63      = _mm_cmpeq_epi8(in, _mm_set1_epi8(table.char63));
+            const __m128i valid     = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, _mm_or_si128(is62, is63)));
+            if (_mm_movemask_epi8(valid) != 0xFFFF)
+            {
+                return false;
+            }
+            __m128i shift = _mm_and_si128(upper, _mm_set1_epi8(-'A'));
+            shift = _mm_or_si128(shift, _mm_and_si128(lower, _mm_set1_epi8(26 - 'a')));
+            shift = _mm_or_si128(shift, _mm_and_si128(digit, _mm_set1_epi8(52 - '0')));
+            shift = _mm_or_si128(shift, _mm_and_si128(is62,  _mm_set1_epi8(static_cast<char>(62 - table.char62))));
+            shift = _mm_or_si128(shift, _mm_and_si128(is63,  _mm_set1_epi8(static_cast<char>(63 - table.char63))));
+            io = _mm_add_epi8(in, shift);
+            return true;
+        }
+
+        // Packs 4 x 6 bit values of every dword into 3 bytes.
+        CPU_TARGET("ssse3") inline __m128i DecodePack(__m128i values)
+        {
+            const __m128i merge_ab_bc = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+            const __m128i merged      = _mm_madd_epi16(merge_ab_bc, _mm_set1_epi32(0x00011000));
+            return _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        }
+
+        // Returns consumed symbols, multiple of 16. Stops before block with foreign symbol, scalar code reports it.
+        // Every store writes 4 bytes past produced output, so at least 8 symbols must follow last block.
+        CPU_TARGET("ssse3") inline size_t DecodeSsse3(const char *iData, size_t iLen, uint8_t *oData, const Table &table)
+        {
+            size_t consumed = 0;
+            for (; consumed + 16 + 8 <= iLen; consumed += 16, oData += 12)
+            {
+                __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(iData + consumed));
+                if (!DecodeTranslate(in, table))
+                {
+                    break;
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(oData), DecodePack(in));
+            }
+            return consumed;
+        }
+
+        // Same as DecodeSsse3 over 32 symbols, 8 bytes of overrun, so 16 symbols must follow.
+        CPU_TARGET("avx2") inline size_t DecodeAvx2(const char *iData, size_t iLen, uint8_t *oData, const Table &table)
+        {
+            const __m256i c62      = _mm256_set1_epi8(table.char62);
+            const __m256i c63      = _mm256_set1_epi8(table.char63);
+            const __m256i shift62  = _mm256_set1_epi8(static_cast<char>(62 - table.char62));
+            const __m256i shift63  = _mm256_set1_epi8(static_cast<char>(63 - table.char63));
+            const __m256i pack_mix = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                                      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+            size_t consumed = 0;
+            for (; consumed + 32 + 16 <= iLen; consumed += 32, oData += 24)
+            {
+                const __m256i in    = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(iData + consumed));
+                const __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), in));
+                const __m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), in));
+                const __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), in));
+                const __m256i is62  = _mm256_cmpeq_epi8(in, c62);
+                const __m256i is63  = _mm256_cmpeq_epi8(in, c63);
+                const __m256i valid = _mm256_or_si256(_mm256_or_si256(upper, lower), _mm256_or_si256(digit, _mm256_or_si256(is62, is63)));
+                if (static_cast<uint32_t>(_mm256_movemask_epi8(valid)) != 0xFFFFFFFFu)
+                {
+                    break;
+                }
+                __m256i shift = _mm256_and_si256(upper, _mm256_set1_epi8(-'A'));
+                shift = _mm256_or_si256(shift, _mm256_and_si256(lower, _mm256_set1_epi8(26 - 'a')));
+                shift = _mm256_or_si256(shift, _mm256_and_si256(digit, _mm256_set1_epi8(52 - '0')));
+                shift = _mm256_or_si256(shift, _mm256_and_si256(is62, shift62));
+                shift = _mm256_or_si256(shift, _mm256_and_si256(is63, shift63));
+                const __m256i values   = _mm256_add_epi8(in, shift);
+                const __m256i merge_ab = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+                const __m256i merged   = _mm256_madd_epi16(merge_ab, _mm256_set1_epi32(0x00011000));
+                const __m256i packed   = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(merged, pack_mix), _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(oData), packed);
+            }
+            return consumed;
+        }
+#endif
+
+        inline size_t EncodeBulk(const uint8_t *iData, size_t iLen, char *oData, const Table &table)
+        {
+            size_t consumed = 0;
+#if defined CPU_X86
+            if (CpuFeatures::HasAvx2())
+            {
+                consumed = EncodeAvx2(iData, iLen, oData, table);
+            }
+            else if (CpuFeatures::HasSsse3())
+            {
+                consumed = EncodeSsse3(iData, iLen, oData, table);
+            }
+#endif
+            EncodeScalar(iData + consumed, (iLen - consumed) / 3, oData + consumed / 3 * 4, table);
+            return iLen / 3 * 3;
+        }
+
+        // Whole quads without padding.
+        inline bool DecodeBulk(const char *iData, size_t iLen, uint8_t *oData, const Table &table)
+        {
+            size_t consumed = 0;
+#if defined CPU_X86
+            if (CpuFeatures::HasAvx2())
+            {
+                consumed = DecodeAvx2(iData, iLen, oData, table);
+            }
+            else if (CpuFeatures::HasSsse3())
+            {
+                consumed = DecodeSsse3(iData, iLen, oData, table);
+            }
+#endif
+            return DecodeScalar(iData + consumed, (iLen - consumed) / 4, oData + consumed / 4 * 3, table);
+        }
+
+        inline size_t EncodeLast(const uint8_t *iData, size_t iLen, char *oData, const Table &table, bool padding)
+        {
+            if (!iLen)
+            {
+                return 0;
+            }
+            const uint32_t v = (static_cast<uint32_t>(iData[0]) << 16) | (iLen > 1 ? static_cast<uint32_t>(iData[1]) << 8 : 0);
+            oData[0] = table.encode[(v >> 18) & 0x3F];
+            oData[1] = table.encode[(v >> 12) & 0x3F];
+            size_t written = 2;
+            if (iLen > 1)
+            {
+                oData[written++] = table.encode[(v >> 6) & 0x3F];
+            }
+            while (padding && written < 4)
+            {
+                oData[written++] = '=';
+            }
+            return written;
+        }
+    }
+
+    // oData must hold EncodedSize(iData.size(), options.padding) chars. Returns written chars.
+    inline size_t Encode(ByteView iData, char *oData, const Options &options = {})
+    {
+        const auto  &table = Detail::GetTable(options.alphabet);
+        const size_t bulk  = Detail::EncodeBulk(iData.data(), iData.size(), oData, table);
+        return bulk / 3 * 4 + Detail::EncodeLast(iData.data() + bulk, iData.size() - bulk, oData + bulk / 3 * 4, table, options.padding);
+    }
+
+    inline std::string Encode(ByteView iData, const Options &options = {})
+    {
+        std::string result(EncodedSize(iData.size(), options.padding), '\0');
+        Encode(iData, result.data(), options);
+        return result;
+    }
+
+    // oData must hold DecodedMaxSize(iData.size()) bytes. oWritten receives exact decoded size.
+    inline bool Decode(std::string_view iData, uint8_t *oData, size_t &oWritten, const Options &options = {})
+    {
+        oWritten = 0;
+        if (iData.empty())
+        {
+            return true;
+        }
+        const auto  &table = Detail::GetTable(options.alphabet);
+        // Last group is handled separately, it may be short or padded.
+        const size_t last  = iData.size() % 4 ? iData.size() % 4 : 4;
+        const size_t bulk  = iData.size() - last;
+        if (!Detail::DecodeBulk(iData.data(), bulk, oData, table))
+        {
+            return false;
+        }
+        const int tail = Detail::DecodeLast(iData.data() + bulk, last, oData + bulk / 4 * 3, table, options.padding);
+        if (tail < 0)
+        {
+            return false;
+        }
+        oWritten = bulk / 4 * 3 + static_cast<size_t>(tail);
+        return true;
+    }
+
+    inline bool Decode(std::string_view iData, std::vector<uint8_t> &oData, const Options &options = {})
+    {
+        oData.resize(DecodedMaxSize(iData.size()));
+        size_t written = 0;
+        const bool result = Decode(iData, oData.data(), written, options);
+        oData.resize(result ? written : 0);
+        return result;
+    }
+
+    // Incremental encoder. Update returns written chars, oData must hold EncodedSize(pending + iData.size()).
+    class Encoder
+    {
+    private:
+        const Detail::Table &m_Table;
+        const Options        m_Options;
+        uint8_t              m_Pending[3] = {};
+        size_t               m_PendingSize = 0;
+
+    public:
+        Encoder(const Options &options = {}) : m_Table(Detail::GetTable(options.alphabet)), m_Options(options) {}
+
+        size_t Update(ByteView iData, char *oData)
+        {
+            size_t written = 0, offset = 0;
+            if (m_PendingSize)
+            {
+                while (m_PendingSize < 3 && offset < iData.size())
+                {
+                    m_Pending[m_PendingSize++] = iData[offset++];
+                }
+                if (m_PendingSize < 3)
+                {
+                    return 0;
+                }
+                Detail::EncodeScalar(m_Pending, 1, oData, m_Table);
+                written       = 4;
+                m_PendingSize = 0;
+            }
+            const size_t bulk = Detail::EncodeBulk(iData.data() + offset, iData.size() - offset, oData + written, m_Table);
+            written += bulk / 3 * 4;
+            offset  += bulk;
+            while (offset < iData.size())
+            {
+                m_Pending[m_PendingSize++] = iData[offset++];
+            }
+            return written;
+        }
+
+        // Flushes pending bytes, oData must hold 4 chars.
+        size_t Final(char *oData)
+        {
+            const size_t written = Detail::EncodeLast(m_Pending, m_PendingSize, oData, m_Table, m_Options.padding);
+            m_PendingSize = 0;
+            return written;
+        }
+    };
+
+    // Incremental strict decoder. Update returns false on malformed input,
+    // oData must hold DecodedMaxSize(pending + iData.size()) bytes.
+    class Decoder
+    {
+    private:
+        const Detail::Table &m_Table;
+        const Options        m_Options;
+        char                 m_Pending[4] = {};
+        size_t               m_PendingSize = 0;
+        bool                 m_Finished    = false;     // Padding seen, nothing may follow.
+
+    public:
+        Decoder(const Options &options = {}) : m_Table(Detail::GetTable(options.alphabet)), m_Options(options) {}
+
+        bool Update(std::string_view iData, uint8_t *oData, size_t &oWritten)
+        {
+            oWritten = 0;
+            if (iData.empty())
+            {
+                return true;
+            }
+            if (m_Finished)
+            {
+                return false;
+            }
+            size_t offset = 0;
+            // Last full quad of the stream might be padded, so one quad always stays pending.
+            while (m_PendingSize < 4 && offset < iData.size())
+            {
+                m_Pending[m_PendingSize++] = iData[offset++];
+            }
+            if (offset == iData.size())
+            {
+                return true;
+            }
+            if (!FlushPending(oData, oWritten))
+            {
+                return false;
+            }
+            const size_t rest = iData.size() - offset;
+            const size_t keep = rest % 4 ? rest % 4 : 4;
+            const size_t bulk = rest - keep;
+            if (!Detail::DecodeBulk(iData.data() + offset, bulk, oData + oWritten, m_Table))
+            {
+                return false;
+            }
+            oWritten += bulk / 4 * 3;
+            memcpy(m_Pending, iData.data() + offset + bulk, keep);
+            m_PendingSize = keep;
+            return true;
+        }
+
+        // Decodes remaining group, oData must hold 3 bytes.
+        bool Final(uint8_t *oData, size_t &oWritten)
+        {
+            oWritten = 0;
+            if (!m_PendingSize)
+            {
+                return true;
+            }
+            const int tail = Detail::DecodeLast(m_Pending, m_PendingSize, oData, m_Table, m_Options.padding);
+            if (tail < 0)
+            {
+                return false;
+            }
+            oWritten      = static_cast<size_t>(tail);
+            m_PendingSize = 0;
+            m_Finished    = true;
+            return true;
+        }
+
+    private:
+        // Pending quad is not last one, so it has to be full & unpadded.
+        bool FlushPending(uint8_t *oData, size_t &oWritten)
+        {
+            if (m_PendingSize != 4 || !Detail::DecodeScalar(m_Pending, 1, oData, m_Table))
+            {
+                return false;
+            }
+            oWritten      = 3;
+            m_PendingSize = 0;
+            return true;
+        }
+    };
+}
@@ -0,0 +1,573 @@
+#pragma once
+
+// Unsigned multi precision integers over 64 bit limbs (least significant limb first)
+// and Montgomery arithmetic, sized for RSA.
+// Montgomery multiplication is CIOS (product & reduction rows fused in one pass), squaring has own
+// kernel which computes cross products once. Exp is constant time for fixed exponent length,
+// key setup helpers are not.
+
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+#include "Common.h"
+
+#if defined COMPILER_MSVC
+#include <intrin.h>                 // _umul128, _addcarry_u64, _udiv128
+#endif
+
+namespace BigNum
+{
+    using Limb  = uint64_t;
+    using Limbs = std::vector<Limb>;
+
+    constexpr size_t c_LimbBits = 64;
+    constexpr size_t c_MaxLimbs = 128;  // 8192 bit modulus
+
+    namespace Detail
+    {
+        // a * b + c + carry, low half returned, high one goes to carry.
+        inline Limb MulAdd(Limb a, Limb b, Limb c, Limb &carry)
+        {
+#if defined __SIZEOF_INT128__
+            const unsigned __int128 r = static_cast<unsigned __int128>(a) * b + c + carry;
+            carry = static_cast<Limb>(r >> 64);
+            return static_cast<Limb>(r);
+#elif defined COMPILER_MSVC && defined _M_X64
+            Limb hi = 0;
+            Limb lo = _umul128(a, b, &hi);
+            hi += _addcarry_u64(0, lo, c, &lo);
+            hi += _addcarry_u64(0, lo, carry, &lo);
+            carry = hi;
+            return lo;
+#else
+            const Limb a_lo = a & 0xFFFFFFFF, a_hi = a >> 32, b_lo = b & 0xFFFFFFFF, b_hi = b >> 32;
+            const Limb p0 = a_lo * b_lo, p1 = a_lo * b_hi, p2 = a_hi * b_lo, p3 = a_hi * b_hi;
+            const Limb mid = (p0 >> 32) + (p1 & 0xFFFFFFFF) + (p2 & 0xFFFFFFFF);
+            Limb lo = (p0 & 0xFFFFFFFF) | (mid << 32);
+            Limb hi = p3 + (p1 >> 32) + (p2 >> 32) + (mid >> 32);
+            lo += c;     hi += lo < c;
+            lo += carry; hi += lo < carry;
+            carry = hi;
+            return lo;
+#endif
+        }
+
+        inline Limb AddCarry(Limb a, Limb b, Limb &carry)
+        {
+            Limb sum = a + carry;
+            Limb out = sum < carry;
+            sum += b;
+            out += sum < b;
+            carry = out;
+            return sum;
+        }
+
+        inline Limb SubBorrow(Limb a, Limb b, Limb &borrow)
+        {
+            const Limb diff = a - b;
+            const Limb out  = (a < b) | (diff < borrow);
+            const Limb res  = diff - borrow;
+            borrow = out;
+            return res;
+        }
+
+        // t[0 .. k + 1] += a[0 .. k - 1] * b
+        inline void MulAddRow(Limb *t, const Limb *a, Limb b, size_t k)
+        {
+            Limb carry = 0;
+            for (size_t j = 0; j < k; j++)
+            {
+                t[j] = MulAdd(a[j], b, t[j], carry);
+            }
+            Limb top = 0;
+            t[k]      = AddCarry(t[k], carry, top);
+            t[k + 1] += top;
+        }
+
+        // (hi : lo) / d, hi must be below d. Quotient is returned, remainder goes to rem.
+        inline Limb DivWide(Limb hi, Limb lo, Limb d, Limb &rem)
+        {
+            if (!(d >> 32))
+            {
+                // Two native divisions over 32 bit halves, no 128 bit arithmetic needed.
+                Limb cur = (hi << 32) | (lo >> 32);
+                const Limb quot_hi = cur / d;
+                cur = ((cur % d) << 32) | (lo & 0xFFFFFFFF);
+                rem = cur % d;
+                return (quot_hi << 32) | (cur / d);
+            }
+#if defined __SIZEOF_INT128__
+            const unsigned __int128 num = (static_cast<unsigned __int128>(hi) << 64) | lo;
+            rem = static_cast<Limb>(num % d);
+            return static_cast<Limb>(num / d);
+#elif defined COMPILER_MSVC && defined _M_X64
+            return _udiv128(hi, lo, d, &rem);
+#else
+            Limb quot = 0;
+            for (int bit = 63; bit >= 0; bit--)
+            {
+                const bool overflow = hi >> 63;
+                hi = (hi << 1) | ((lo >> bit) & 1);
+                if (overflow || hi >= d)
+                {
+                    hi -= d;
+                    quot |= Limb(1) << bit;
+                }
+            }
+            rem = hi;
+            return quot;
+#endif
+        }
+    }
+
+    inline size_t SignificantLimbs(const Limbs &a)
+    {
+        size_t size = a.size();
+        while (size && !a[size - 1])
+        {
+            size--;
+        }
+        return size;
+    }
+
+    inline Limbs &Trim(Limbs &a)
+    {
+        a.resize(SignificantLimbs(a));
+        return a;
+    }
+
+    inline bool IsZero(const Limbs &a) { return SignificantLimbs(a) == 0; }
+
+    inline size_t BitLength(const Limbs &a)
+    {
+        const size_t size = SignificantLimbs(a);
+        if (!size)
+        {
+            return 0;
+        }
+        size_t bits = (size - 1) * c_LimbBits;
+        for (Limb top = a[size - 1]; top; top >>= 1)
+        {
+            bits++;
+        }
+        return bits;
+    }
+
+    // Big endian bytes to limbs, result has at least minLimbs limbs.
+    inline Limbs FromBytes(ByteView iData, size_t minLimbs = 0)
+    {
+        Limbs result(std::max(minLimbs, (iData.size() + 7) / 8), 0);
+        for (size_t i = 0; i < iData.size(); i++)
+        {
+            const size_t bit_pos = i * 8;
+            result[bit_pos / c_LimbBits] |= static_cast<Limb>(iData[iData.size() - 1 - i]) << (bit_pos % c_LimbBits);
+        }
+        return result;
+    }
+
+    // Limbs to fixed size big endian bytes, false if value does not fit.
+    inline bool ToBytes(const Limbs &a, uint8_t *oData, size_t iLen)
+    {
+        if ((BitLength(a) + 7) / 8 > iLen)
+        {
+            return false;
+        }
+        for (size_t i = 0; i < iLen; i++)
+        {
+            const size_t bit_pos = i * 8;
+            const size_t limb    = bit_pos / c_LimbBits;
+            oData[iLen - 1 - i]  = limb < a.size() ? static_cast<uint8_t>(a[limb] >> (bit_pos % c_LimbBits)) : 0;
+        }
+        return true;
+    }
+
+    inline std::vector<uint8_t> ToBytes(const Limbs &a)
+    {
+        std::vector<uint8_t> result((BitLength(a) + 7) / 8);
+        ToBytes(a, result.data(), result.size());
+        return result;
+    }
+
+    inline int Compare(const Limbs &a, const Limbs &b)
+    {
+        for (size_t i = std::max(a.size(), b.size()); i-- > 0;)
+        {
+            const Limb l = i < a.size() ? a[i] : 0, r = i < b.size() ? b[i] : 0;
+            if (l != r)
+            {
+                return l < r ? -1 : 1;
+            }
+        }
+        return 0;
+    }
+
+    inline Limbs Add(const Limbs &a, const Limbs &b)
+    {
+        Limbs result(std::max(a.size(), b.size()) + 1, 0);
+        Limb carry = 0;
+        for (size_t i = 0; i + 1 < result.size(); i++)
+        {
+            result[i] = Detail::AddCarry(i < a.size() ? a[i] : 0, i < b.size() ? b[i] : 0, carry);
+        }
+        result.back() = carry;
+        return Trim(result);
+    }
+
+    // a - b, a must not be less than b.
+    inline Limbs Sub(const Limbs &a, const Limbs &b)
+    {
+        Limbs result(a.size(), 0);
+        Limb borrow = 0;
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            result[i] = Detail::SubBorrow(a[i], i < b.size() ? b[i] : 0, borrow);
+        }
+        return Trim(result);
+    }
+
+    inline Limbs Mul(const Limbs &a, const Limbs &b)
+    {
+        Limbs result(a.size() + b.size() + 2, 0);
+        for (size_t i = 0; i < b.size(); i++)
+        {
+            Detail::MulAddRow(result.data() + i, a.data(), b[i], a.size());
+        }
+        return Trim(result);
+    }
+
+    inline Limbs MulSmall(const Limbs &a, Limb b)
+    {
+        Limbs result(a.size() + 1, 0);
+        Limb carry = 0;
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            result[i] = Detail::MulAdd(a[i], b, 0, carry);
+        }
+        result.back() = carry;
+        return Trim(result);
+    }
+
+    // Divides in place limb by limb, returns remainder.
+    inline Limb DivSmall(Limbs &a, Limb b)
+    {
+        Limb rem = 0;
+        for (size_t i = a.size(); i-- > 0;)
+        {
+            a[i] = Detail::DivWide(rem, a[i], b, rem);
+        }
+        Trim(a);
+        return rem;
+    }
+
+    // Remainder only, a is left untouched.
+    inline Limb ModSmall(const Limbs &a, Limb b)
+    {
+        Limb rem = 0;
+        for (size_t i = a.size(); i-- > 0;)
+        {
+            Detail::DivWide(rem, a[i], b, rem);
+        }
+        return rem;
+    }
+
+    inline Limbs ShiftRight(const Limbs &a, size_t bits)
+    {
+        const size_t limbs = bits / c_LimbBits, shift = bits % c_LimbBits;
+        if (limbs >= a.size())
+        {
+            return {};
+        }
+        Limbs result(a.size() - limbs, 0);
+        for (size_t i = 0; i < result.size(); i++)
+        {
+            const Limb hi = i + limbs + 1 < a.size() ? a[i + limbs + 1] : 0;
+            result[i] = shift ? (a[i + limbs] >> shift) | (hi << (c_LimbBits - shift)) : a[i + limbs];
+        }
+        return Trim(result);
+    }
+
+    inline void SecureZero(Limbs &a)
+    {
+        volatile Limb *ptr = a.data();
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            ptr[i] = 0;
+        }
+        a.clear();
+    }
+
+    // Arithmetic modulo odd n in Montgomery form, R = 2 ^ (64 * k).
+    class Montgomery
+    {
+    private:
+        Limbs  m_N;
+        Limbs  m_R2;
+        Limb   m_N0Inv = 0;      // -n ^ -1 mod 2 ^ 64
+        size_t m_K     = 0;
+
+        // Constant time final subtraction, (top : t) < 2n.
+        void FinalSubtract(const Limb *t, Limb top, Limb *out) const
+        {
+            Limb sub[c_MaxLimbs];
+            Limb borrow = 0;
+            for (size_t j = 0; j < m_K; j++)
+            {
+                sub[j] = Detail::SubBorrow(t[j], m_N[j], borrow);
+            }
+            Detail::SubBorrow(top, 0, borrow);
+            const Limb keep_t = 0 - borrow;
+            for (size_t j = 0; j < m_K; j++)
+            {
+                out[j] = (t[j] & keep_t) | (sub[j] & ~keep_t);
+            }
+        }
+
+    public:
+        bool Init(const Limbs &n)
+        {
+            m_N = n;
+            m_K = SignificantLimbs(Trim(m_N));
+            if (!m_K || m_K > c_MaxLimbs || !(m_N[0] & 1))
+            {
+                m_K = 0;
+                return false;
+            }
+            Limb inv = m_N[0];
+            for (size_t i = 0; i < 6; i++)
+            {
+                inv *= 2 - m_N[0] * inv;
+            }
+            m_N0Inv = 0 - inv;
+            // R ^ 2 mod n by doubling 1 for 2 * 64 * k times, modulus is public.
+            Limbs r2(m_K, 0);
+            r2[0] = 1;
+            for (size_t i = 0; i < 2 * c_LimbBits * m_K; i++)
+            {
+                Limb top = 0;
+                for (size_t j = 0; j < m_K; j++)
+                {
+                    const Limb next = r2[j] >> 63;
+                    r2[j] = (r2[j] << 1) | top;
+                    top = next;
+                }
+                if (top || Compare(r2, m_N) >= 0)
+                {
+                    Limb borrow = 0;
+                    for (size_t j = 0; j < m_K; j++)
+                    {
+                        r2[j] = Detail::SubBorrow(r2[j], m_N[j], borrow);
+                    }
+                }
+            }
+            m_R2 = std::move(r2);
+            return true;
+        }
+
+        size_t       Size()    const { return m_K; }
+        const Limbs &Modulus() const { return m_N; }
+
+        // out = a * b / R mod n, inputs are k limbs below n. out may alias inputs.
+        void Mul(const Limb *a, const Limb *b, Limb *out) const
+        {
+            const Limb *n = m_N.data();
+            Limb t[c_MaxLimbs + 1] = {};
+            for (size_t i = 0; i < m_K; i++)
+            {
+                // t = (t + a * b[i] + n * m) / 2 ^ 64, both products go through one loop
+                // with own carries and result is written one limb down.
+                const Limb bi = b[i];
+                Limb carry_a = 0, carry_n = 0;
+                const Limb low = Detail::MulAdd(a[0], bi, t[0], carry_a);
+                const Limb m   = low * m_N0Inv;
+                Detail::MulAdd(n[0], m, low, carry_n);
+                for (size_t j = 1; j < m_K; j++)
+                {
+                    const Limb sum = Detail::MulAdd(a[j], bi, t[j], carry_a);
+                    t[j - 1] = Detail::MulAdd(n[j], m, sum, carry_n);
+                }
+                Limb top_a = 0, top_n = 0;
+                const Limb sum = Detail::AddCarry(t[m_K], carry_a, top_a);
+                t[m_K - 1] = Detail::AddCarry(sum, carry_n, top_n);
+                t[m_K]     = top_a + top_n;
+            }
+            FinalSubtract(t, t[m_K], out);
+        }
+
+        // out = a * a / R mod n. Cross products a[i] * a[j], i < j are computed once and doubled,
+        // then 2k limb square goes through separate reduction.
+        void Sqr(const Limb *a, Limb *out) const
+        {
+            const Limb *n = m_N.data();
+            Limb p[2 * c_MaxLimbs];
+            memset(p, 0, 2 * m_K * sizeof(Limb));
+            for (size_t i = 0; i + 1 < m_K; i++)
+            {
+                Limb carry = 0;
+                for (size_t j = i + 1; j < m_K; j++)
+                {
+                    p[i + j] = Detail::MulAdd(a[i], a[j], p[i + j], carry);
+                }
+                p[i + m_K] = carry;
+            }
+            Limb shifted = 0;
+            for (size_t i = 0; i < 2 * m_K; i++)
+            {
+                const Limb next = p[i] >> 63;
+                p[i] = (p[i] << 1) | shifted;
+                shifted = next;
+            }
+            Limb carry = 0;
+            for (size_t i = 0; i < m_K; i++)
+            {
+                Limb hi = 0;
+                const Limb lo = Detail::MulAdd(a[i], a[i], 0, hi);
+                p[2 * i]     = Detail::AddCarry(p[2 * i], lo, carry);
+                p[2 * i + 1] = Detail::AddCarry(p[2 * i + 1], hi, carry);
+            }
+            // REDC: every row zeroes one low limb, carry out of top limb is kept aside.
+            Limb top = 0;
+            for (size_t i = 0; i < m_K; i++)
+            {
+                Limb row_carry = 0;
+                const Limb m = p[i] * m_N0Inv;
+                for (size_t j = 0; j < m_K; j++)
+                {
+                    p[i + j] = Detail::MulAdd(n[j], m, p[i + j], row_carry);
+                }
+                p[i + m_K] = Detail::AddCarry(p[i + m_K], row_carry, top);
+            }
+            FinalSubtract(p + m_K, top, out);
+        }
+
+        Limbs Mul(const Limbs &a, const Limbs &b) const
+        {
+            Limbs result(m_K, 0);
+            Mul(a.data(), b.data(), result.data());
+            return result;
+        }
+
+        // (a + b) mod n, a & b in range, constant time.
+        Limbs AddMod(const Limbs &a, const Limbs &b) const
+        {
+            Limbs sum(m_K, 0), sub(m_K, 0);
+            Limb carry = 0, borrow = 0;
+            for (size_t j = 0; j < m_K; j++)
+            {
+                sum[j] = Detail::AddCarry(a[j], b[j], carry);
+            }
+            for (size_t j = 0; j < m_K; j++)
+            {
+                sub[j] = Detail::SubBorrow(sum[j], m_N[j], borrow);
+            }
+            Detail::SubBorrow(carry, 0, borrow);
+            const Limb keep_sum = 0 - borrow;
+            for (size_t j = 0; j < m_K; j++)
+            {
+                sum[j] = (sum[j] & keep_sum) | (sub[j] & ~keep_sum);
+            }
+            return sum;
+        }
+
+        // (a - b) mod n, a & b in range, constant time.
+        Limbs SubMod(const Limbs &a, const Limbs &b) const
+        {
+            Limbs diff(m_K, 0);
+            Limb borrow = 0;
+            for (size_t j = 0; j < m_K; j++)
+            {
+                diff[j] = Detail::SubBorrow(a[j], b[j], borrow);
+            }
+            const Limb add_n = 0 - borrow;
+            Limb carry = 0;
+            for (size_t j = 0; j < m_K; j++)
+            {
+                diff[j] = Detail::AddCarry(diff[j], m_N[j] & add_n, carry);
+            }
+            return diff;
+        }
+
+        // Any length x to Montgomery form: Horner over k limb chunks, x * R mod n.
+        Limbs ToMont(const Limbs &x) const
+        {
+            Limbs acc(m_K, 0), chunk(m_K, 0);
+            const size_t chunks = std::max<size_t>(1, (x.size() + m_K - 1) / m_K);
+            for (size_t c = chunks; c-- > 0;)
+            {
+                for (size_t j = 0; j < m_K; j++)
+                {
+                    const size_t idx = c * m_K + j;
+                    chunk[j] = idx < x.size() ? x[idx] : 0;
+                }
+                // acc * R2 / R shifts accumulated value by one chunk, chunk * R2 / R = chunk * R mod n.
+                acc = AddMod(Mul(acc, m_R2), Mul(chunk, m_R2));
+            }
+            return acc;
+        }
+
+        Limbs FromMont(const Limbs &x) const
+        {
+            Limbs one(m_K, 0);
+            one[0] = 1;
+            return Mul(x, one);
+        }
+
+        // x mod n in normal form.
+        Limbs Reduce(const Limbs &x) const { return FromMont(ToMont(x)); }
+
+        // x ^ e mod n, fixed 4 bit window with constant time table scan.
+        // Time depends only on limb count of e, not on its value.
+        Limbs Exp(const Limbs &x, const Limbs &e) const
+        {
+            constexpr size_t window = 4, entries = 1 << window;
+            std::vector<Limbs> table(entries);
+            table[0] = ToMont(Limbs{ 1 });
+            table[1] = ToMont(x);
+            for (size_t i = 2; i < entries; i++)
+            {
+                table[i] = Mul(table[i - 1], table[1]);
+            }
+            Limbs acc = table[0], pick(m_K, 0);
+            for (size_t bit = e.size() * c_LimbBits; bit > 0; bit -= window)
+            {
+                for (size_t s = 0; s < window; s++)
+                {
+                    Sqr(acc.data(), acc.data());
+                }
+                const size_t pos  = bit - window;
+                const Limb   bits = (e[pos / c_LimbBits] >> (pos % c_LimbBits)) & (entries - 1);
+                std::fill(pick.begin(), pick.end(), 0);
+                for (size_t i = 0; i < entries; i++)
+                {
+                    const Limb mask = 0 - static_cast<Limb>(i == bits);
+                    for (size_t j = 0; j < m_K; j++)
+                    {
+                        pick[j] |= table[i][j] & mask;
+                    }
+                }
+                Mul(acc.data(), pick.data(), acc.data());
+            }
+            for (auto &entry : table)
+            {
+                SecureZero(entry);
+            }
+            return FromMont(acc);
+        }
+
+        // Square & multiply over public exponent, time depends on e.
+        Limbs ExpPublic(const Limbs &x, const Limbs &e) const
+        {
+            const Limbs base = ToMont(x);
+            Limbs acc = ToMont(Limbs{ 1 });
+            for (size_t bit = BitLength(e); bit-- > 0;)
+            {
+                Mul(acc.data(), acc.data(), acc.data());
+                if ((e[bit / c_LimbBits] >> (bit % c_LimbBits)) & 1)
+                {
+                    Mul(acc.data(), base.data(), acc.data());
+                }
+            }
+            return FromMont(acc);
+        }
+    };
+}
@@ -279,5 +279,36 @@ void SafeRelease(T **obj)
     }
 }
 
+#if defined IS_CPP_20G
+template <typename T>
+using Span = std::span<T>;
+#else
+// Minimal std::span stand in for C++17 builds, dynamic extent only.
+template <typename T>
+class Span
+{
+    T     *m_Data = nullptr;
+    size_t m_Size = 0;
+public:
+    constexpr Span(void) = default;
+    constexpr Span(T *data, size_t size) : m_Data(data), m_Size(size) {}
+    template <typename C, typename = std::enable_if_t<std::is_convertible_v<decltype(std::declval<C &>().data()), T *>>>
+    constexpr Span(C &&container) : m_Data(container.data()), m_Size(container.size()) {}
+
+    constexpr T     *data(void)  const { return m_Data; }
+    constexpr size_t size(void)  const { return m_Size; }
+    constexpr bool   empty(void) const { return m_Size == 0; }
+    constexpr T     *begin(void) const { return m_Data; }
+    constexpr T     *end(void)   const { return m_Data + m_Size; }
+    constexpr T     &operator[](size_t idx) const { return m_Data[idx]; }
+    constexpr Span   subspan(size_t offset, size_t count = static_cast<size_t>(-1)) const
+    {
+        return Span(m_Data + offset, count == static_cast<size_t>(-1) ? m_Size - offset : count);
+    }
+};
+#endif
+using ByteView        = Span<const uint8_t>;
+using MutableByteView = Span<uint8_t>;
+
 #define LOG_FEATURE_LOCATION
 #define USE_LOGGER
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+
+// Runtime x86 feature detection for header only kernels.
+// Kernel functions are marked with CPU_TARGET(...) so they compile without global -m flags,
+// and are called only when matching Has*() returns true.
+// CPU_GENERIC_ONLY reports no features, so every kernel takes its portable path (checks of fallbacks).
+
+#include "Common.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CPU_X86
+#include <immintrin.h>
+#if defined COMPILER_MSVC
+#include <intrin.h>
+#endif
+#endif
+
+#if defined CPU_X86 && !defined COMPILER_MSVC
+#define CPU_TARGET(features) __attribute__((target(features)))
+#else
+#define CPU_TARGET(features)
+#endif
+
+namespace CpuFeatures
+{
+    struct Flags
+    {
+        bool ssse3 = false;
+        bool avx2  = false;
+        bool aes   = false;
+    };
+
+    inline const Flags &Get()
+    {
+        static const Flags flags = []()
+        {
+            Flags result;
+#if defined CPU_X86 && !defined CPU_GENERIC_ONLY
+#if defined COMPILER_MSVC
+            int regs[4] = {};
+            __cpuid(regs, 0);
+            const int max_leaf = regs[0];
+            __cpuid(regs, 1);
+            result.ssse3 = (regs[2] & (1 << 9)) != 0;
+            result.aes   = (regs[2] & (1 << 25)) != 0;
+            const bool os_avx = (regs[2] & (1 << 27)) && (regs[2] & (1 << 28)) && (_xgetbv(0) & 0x6) == 0x6;
+            if (max_leaf >= 7)
+            {
+                __cpuidex(regs, 7, 0);
+                result.avx2 = os_avx && (regs[1] & (1 << 5)) != 0;
+            }
+#else
+            __builtin_cpu_init();
+            result.ssse3 = __builtin_cpu_supports("ssse3");
+            result.avx2  = __builtin_cpu_supports("avx2");
+            result.aes   = __builtin_cpu_supports("aes");
+#endif
+#endif
+            return result;
+        }();
+        return flags;
+    }
+
+    inline bool HasSsse3() { return Get().ssse3; }
+    inline bool HasAvx2()  { return Get().avx2; }
+    inline bool HasAes()   { return Get().aes; }
+}
@@ -1,16 +1,29 @@
 #pragma once
 
 #include <array>
+#include <atomic>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string>
 #include <vector>
 
+#include "Common.h"
+
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
 #include <bcrypt.h>
 #include <Windows.h>
 #include <wincrypt.h>
 
-#include "common.h"
+#include "AesPortable.hpp"
+#include "Random.hpp"
+#include "Sha256.hpp"
+#include "ThreadWrap.hpp"
+#include "Trace.hpp"
 
 #define NT_SUCCESS(Status) (((NTSTATUS)(Status)) >= 0)
 constexpr static size_t AES_BLOCK_SIZE = 32UL;
+constexpr static size_t AES_CIPHER_BLOCK_SIZE = 16UL;
 
 // Legacy AES-256
 // Works perfectly well with all kind of data.
@@ -29,7 +42,12 @@ private:
     std::array<uint8_t, AES_BLOCK_SIZE>     m_Key;
     std::array<uint8_t, AES_BLOCK_SIZE / 2> m_IV;
 
+    // CTR keystream comes from portable backend, CryptoAPI key import per call costs more than small message itself.
+    mutable std::shared_ptr<const PortableAES> m_Schedule;
+
     bool                InitContext(HCRYPTPROV& provider, HCRYPTKEY& key) const;
+    std::shared_ptr<const PortableAES> Schedule(void) const;
+    bool                CryptInPlaceCTR(MutableByteView iData, uint64_t nonce, ThreadPool *pool) const;
 
 public:
                         AES(void)   = default;
@@ -44,21 +62,205 @@ public:
     bool                DecryptInPlace(std::vector<uint8_t> &iData) const;
     bool                DecryptInPlace(std::string &iData) const;
 
+    // AES-256-CTR, IV is initial 128 bit big endian counter. No padding, output size equals input.
+    // Nonce is xored into high half of IV, so every message gets own counter space under one key.
+    // Nonce must never repeat for one key, same nonce twice is a two time pad.
+    // With pool buffer is split into independent counter ranges processed by workers,
+    // output is byte to byte same as serial one. Any caller memory: std::pmr::vector from RequestArena,
+    // MappedFile::MutableView() etc.
+    bool                EncryptInPlaceCTR(MutableByteView iData, uint64_t nonce, ThreadPool *pool = nullptr) const { return CryptInPlaceCTR(iData, nonce, pool); }
+    bool                DecryptInPlaceCTR(MutableByteView iData, uint64_t nonce, ThreadPool *pool = nullptr) const { return CryptInPlaceCTR(iData, nonce, pool); }
+
     bool                ImportKeys(const std::vector<uint8_t> &key, const std::vector<uint8_t> &iv);
     template <typename T>
     bool                ExportKeys(T &key, T &iv) const;
 };
 
+// Key schedule is expanded on first CTR call & shared by all threads afterwards.
+// ImportKeys & copy don't touch it, schedule built for other key is noticed by compare & replaced.
+inline std::shared_ptr<const PortableAES> AES::Schedule(void) const
+{
+    auto schedule = std::atomic_load(&m_Schedule);
+    if (schedule && schedule->HasKeys(m_Key, m_IV))
+    {
+        return schedule;
+    }
+    auto fresh = std::make_shared<PortableAES>();
+    if (!fresh->ImportKeys(std::vector<uint8_t>(m_Key.begin(), m_Key.end()), std::vector<uint8_t>(m_IV.begin(), m_IV.end())))
+    {
+        return nullptr;
+    }
+    schedule = std::move(fresh);
+    std::atomic_store(&m_Schedule, schedule);
+    return schedule;
+}
+
+inline bool AES::CryptInPlaceCTR(MutableByteView iData, uint64_t nonce, ThreadPool *pool) const
+{
+    const auto schedule = Schedule();
+    return schedule && schedule->EncryptInPlaceCTR(iData, nonce, pool);
+}
+
 class LIB_EXPORT BaseCNG
 {
 protected:
               BCRYPT_ALG_HANDLE InitAlgorithm(const wchar_t* alg);
 
 public:
+    enum class RngSource
+    {
+        UserSpace,  // Per thread ChaCha20, seeded from kernel
+        Kernel      // BCryptGenRandom on every call
+    };
+
     // Random number generator with selected data length,
     // uses kernel to select generate bytes
     static                 bool FillBufferRNG(size_t iLen, std::vector<uint8_t> &oData);
+    // Fills caller buffer, no allocation. Use for nonces, IVs & tokens on hot paths.
+    static                 bool FillBufferRNG(MutableByteView oData, RngSource source = RngSource::UserSpace)
+    {
+        return source == RngSource::Kernel ? SecureRandom::FillKernel(oData) : SecureRandom::Fill(oData);
+    }
     static std::vector<uint8_t> CalculateBase64(const std::vector<uint8_t> &iData);
+
+    // Algorithm provider opened once per process & kept until exit. CNG algorithm handles
+    // may be shared between threads, hash & key objects created from them may not.
+    static BCRYPT_ALG_HANDLE    CachedAlgorithm(const wchar_t *alg, ULONG flags = 0)
+    {
+        struct Provider
+        {
+            std::wstring      Name;
+            ULONG             Flags  = 0;
+            BCRYPT_ALG_HANDLE Handle = nullptr;
+        };
+        static std::mutex            mutex;
+        static std::vector<Provider> providers;    // Handful of algorithms, linear search is enough.
+        std::lock_guard lock(mutex);
+        for (const auto &provider : providers)
+        {
+            if (provider.Flags == flags && provider.Name == alg)
+            {
+                return provider.Handle;
+            }
+        }
+        BCRYPT_ALG_HANDLE handle = nullptr;
+        if (!NT_SUCCESS(BCryptOpenAlgorithmProvider(&handle, alg, nullptr, flags)))
+        {
+            return nullptr;
+        }
+        providers.push_back({ alg, flags, handle });
+        return handle;
+    }
+};
+
+// Reusable CNG hash (HMAC when secret is given). Hash object is created once over cached provider,
+// every Final resets it for next message, so small messages pay only for hashing itself.
+// Not thread safe, use one context per thread (see ThreadLocal).
+class LIB_EXPORT HashContext
+{
+private:
+    static constexpr size_t c_MaxDigestSize = 64;   // SHA-512
+
+    BCRYPT_HASH_HANDLE   m_Hash       = nullptr;
+    std::vector<uint8_t> m_Object;                  // CNG hash object memory, owned by context.
+    DWORD                m_DigestSize = 0;
+
+public:
+                        HashContext(const wchar_t *alg, ByteView secret = {})
+    {
+        const ULONG       flags     = BCRYPT_HASH_REUSABLE_FLAG | (secret.empty() ? 0 : BCRYPT_ALG_HANDLE_HMAC_FLAG);
+        BCRYPT_ALG_HANDLE algorithm = BaseCNG::CachedAlgorithm(alg, flags);
+        DWORD             object_length = 0;
+        ULONG             written       = 0;
+        if (!algorithm ||
+            !NT_SUCCESS(BCryptGetProperty(algorithm, BCRYPT_OBJECT_LENGTH, reinterpret_cast<PUCHAR>(&object_length), sizeof(object_length), &written, 0)) ||
+            !NT_SUCCESS(BCryptGetProperty(algorithm, BCRYPT_HASH_LENGTH,   reinterpret_cast<PUCHAR>(&m_DigestSize),  sizeof(m_DigestSize),  &written, 0)) ||
+            m_DigestSize > c_MaxDigestSize)
+        {
+            return;
+        }
+        m_Object.resize(object_length);
+        if (!NT_SUCCESS(BCryptCreateHash(algorithm, &m_Hash, m_Object.data(), object_length,
+                                         const_cast<PUCHAR>(secret.data()), static_cast<ULONG>(secret.size()), BCRYPT_HASH_REUSABLE_FLAG)))
+        {
+            m_Hash = nullptr;
+        }
+    }
+                        HashContext(const HashContext&)        = delete;
+                        HashContext(const HashContext&&)       = delete;
+              auto     &operator=(const HashContext&)          = delete;
+              auto     &operator=(const HashContext&&)         = delete;
+                        ~HashContext()
+    {
+        if (m_Hash)
+        {
+            BCryptDestroyHash(m_Hash);
+        }
+    }
+
+    bool                IsValid(void)    const { return m_Hash != nullptr; }
+    size_t              DigestSize(void) const { return m_DigestSize; }
+
+    bool                Update(ByteView iData)
+    {
+        // BCryptHashData takes ULONG length, views over 4 GiB go in several calls.
+        for (size_t done = 0; done < iData.size();)
+        {
+            const ULONG length = static_cast<ULONG>(std::min<size_t>(iData.size() - done, 1UL << 30));
+            if (!m_Hash || !NT_SUCCESS(BCryptHashData(m_Hash, const_cast<PUCHAR>(iData.data() + done), length, 0)))
+            {
+                return false;
+            }
+            done += length;
+        }
+        return m_Hash != nullptr;
+    }
+
+    // Writes digest (oData must hold DigestSize bytes) & leaves context ready for next message.
+    bool                Final(MutableByteView oData)
+    {
+        return m_Hash && oData.size() >= m_DigestSize && NT_SUCCESS(BCryptFinishHash(m_Hash, oData.data(), m_DigestSize, 0));
+    }
+
+    template <typename T>
+    bool                Final(T &oData)
+    {
+        oData.resize(m_DigestSize);
+        return Final(MutableByteView(oData.data(), oData.size()));
+    }
+
+    // Drops data hashed since last Final.
+    void                Reset(void)
+    {
+        std::array<uint8_t, c_MaxDigestSize> scratch;
+        Final(MutableByteView(scratch));
+    }
+
+    template <typename T>
+    bool                Calculate(ByteView iData, T &oData)
+    {
+        if (!Update(iData))
+        {
+            Reset();
+            return false;
+        }
+        return Final(oData);
+    }
+
+    // Plain (no HMAC) context of calling thread, created on first use & kept until thread exit.
+    static HashContext &ThreadLocal(const wchar_t *alg)
+    {
+        thread_local std::vector<std::pair<std::wstring, std::unique_ptr<HashContext>>> contexts;
+        for (auto &[name, context] : contexts)
+        {
+            if (name == alg)
+            {
+                return *context;
+            }
+        }
+        contexts.emplace_back(alg, std::make_unique<HashContext>(alg));
+        return *contexts.back().second;
+    }
 };
 
 // CNG based RSA impl.
@@ -142,6 +344,8 @@ private:
         Hash_Undefined  = 0,
         Hash_Crc32      = 1,
     };
+    static constexpr size_t c_TreeChunkSize = 4UL * 1024 * 1024;
+
     InnerHashType     m_ExternType = Hash_Undefined;
     BCRYPT_ALG_HANDLE m_AlgHandle  = nullptr;
 
@@ -153,8 +357,14 @@ private:
            const Hash &               operator=(const Hash&)  = delete;
            const Hash &               operator=(const Hash&&) = delete;
            const std::vector<uint8_t> InnerHash(const std::vector<uint8_t> &iData) const;
+           bool                       AlgorithmName(wchar_t (&oName)[64]) const;
+           bool                       IsAlgorithm(const wchar_t *alg) const;
 public:
                                      ~Hash();
+    // Each factory call opens own provider. Shared keeps one instance per algorithm name for whole process,
+    // prefer it on hot paths: Hash::Shared(BCRYPT_SHA256_ALGORITHM).CalculateHash(data)
+    // Lookup takes no lock, unknown name is cached as well & its instance fails every call.
+    static const Hash                &Shared(const wchar_t *alg);
     static const Hash                 SHA_1();
     static const Hash                 SHA_256();
     static const Hash                 SHA_384();
@@ -167,5 +377,231 @@ public:
     static const Hash                 Crc32();
 
            const std::vector<uint8_t> CalculateHash(const std::vector<uint8_t> &iData, const std::vector<uint8_t> &iSalt = {}) const;
+    // Hashes caller memory in place (e.g. MappedFile::View()). Unsalted CNG hashes stream view without copy
+    // through reusable per thread HashContext, no hash object is created per call.
+           const std::vector<uint8_t> CalculateHash(ByteView iData, const std::vector<uint8_t> &iSalt = {}) const;
+    // Digest is allocated from oData`s memory resource (e.g. Memory::RequestArena), hash object is per thread context.
+           bool                       CalculateHash(ByteView iData, std::pmr::vector<uint8_t> &oData) const;
            bool                       VerifyHashData(const std::vector<uint8_t> &hashData, const std::vector<uint8_t> &iData, const std::vector<uint8_t> &iSalt = {}) const;
-};
\ No newline at end of file
+
+    // Independent hash of every buffer. Unsalted SHA-256 goes through multi-buffer kernel (8 lanes with AVX2),
+    // other algorithms hash one by one.
+           const std::vector<std::vector<uint8_t>> CalculateHashBatch(const std::vector<std::vector<uint8_t>> &iData, const std::vector<uint8_t> &iSalt = {}) const;
+    // Tree mode for large inputs: chunkSize leaves are hashed over pool workers (serially without pool),
+    // result is hash of domain separated root block & concatenated leaf hashes. Bound to chunkSize,
+    // never equal to CalculateHash, not even for input that fits single chunk!
+           const std::vector<uint8_t> CalculateTreeHash(ByteView iData, size_t chunkSize = c_TreeChunkSize, ThreadPool *pool = ThreadPool::GLobalInstance()) const;
+           const std::vector<uint8_t> CalculateTreeHash(const std::vector<uint8_t> &iData, size_t chunkSize = c_TreeChunkSize, ThreadPool *pool = ThreadPool::GLobalInstance()) const
+           {
+               return CalculateTreeHash(ByteView(iData), chunkSize, pool);
+           }
+};
+
+inline bool Hash::AlgorithmName(wchar_t (&oName)[64]) const
+{
+    if (!m_AlgHandle || m_ExternType != Hash_Undefined)
+    {
+        return false;
+    }
+    ULONG written = 0;
+    oName[0] = L'\0';
+    return NT_SUCCESS(BCryptGetProperty(m_AlgHandle, BCRYPT_ALGORITHM_NAME, reinterpret_cast<PUCHAR>(oName), sizeof(oName) - sizeof(wchar_t), &written, 0));
+}
+
+inline bool Hash::IsAlgorithm(const wchar_t *alg) const
+{
+    wchar_t alg_name[64] = {};
+    return AlgorithmName(alg_name) && wcscmp(alg_name, alg) == 0;
+}
+
+// Append only list keyed by requested name, entries live until exit. Readers walk it without lock,
+// mutex only serializes creation, so one name never gets two providers.
+inline const Hash &Hash::Shared(const wchar_t *alg)
+{
+    struct Entry
+    {
+        std::wstring                Name;
+        std::unique_ptr<const Hash> Instance;
+        const Entry                *Next = nullptr;
+    };
+    static std::atomic<const Entry*> head = nullptr;
+    static std::mutex                mutex;
+    const auto find = [alg](const Entry *entry) -> const Hash*
+    {
+        for (; entry; entry = entry->Next)
+        {
+            if (entry->Name == alg)
+            {
+                return entry->Instance.get();
+            }
+        }
+        return nullptr;
+    };
+    if (const Hash *hash = find(head.load(std::memory_order_acquire)))
+    {
+        return *hash;
+    }
+    std::lock_guard lock(mutex);
+    const Entry *first = head.load(std::memory_order_relaxed);
+    if (const Hash *hash = find(first))
+    {
+        return *hash;
+    }
+    auto entry = std::make_unique<Entry>();
+    entry->Name     = alg;
+    entry->Instance = std::unique_ptr<const Hash>(new Hash(alg));
+    entry->Next     = first;
+    head.store(entry.get(), std::memory_order_release);
+    return *entry.release()->Instance;
+}
+
+inline const std::vector<uint8_t> Hash::CalculateHash(ByteView iData, const std::vector<uint8_t> &iSalt) const
+{
+    TRACE_SCOPE("Crypto", "Hash");
+    wchar_t alg_name[64] = {};
+    if (!iSalt.empty() || !AlgorithmName(alg_name))
+    {
+        return CalculateHash(std::vector<uint8_t>(iData.begin(), iData.end()), iSalt);
+    }
+    std::vector<uint8_t> result;
+    if (!HashContext::ThreadLocal(alg_name).Calculate(iData, result))
+    {
+        return {};
+    }
+    return result;
+}
+
+inline bool Hash::CalculateHash(ByteView iData, std::pmr::vector<uint8_t> &oData) const
+{
+    TRACE_SCOPE("Crypto", "Hash");
+    wchar_t alg_name[64] = {};
+    if (!AlgorithmName(alg_name))
+    {
+        const auto digest = CalculateHash(iData);
+        oData.assign(digest.begin(), digest.end());
+        return !digest.empty();
+    }
+    return HashContext::ThreadLocal(alg_name).Calculate(iData, oData);
+}
+
+inline const std::vector<std::vector<uint8_t>> Hash::CalculateHashBatch(const std::vector<std::vector<uint8_t>> &iData, const std::vector<uint8_t> &iSalt) const
+{
+    TRACE_SCOPE("Crypto", "Hash batch");
+    std::vector<std::vector<uint8_t>> result;
+    result.reserve(iData.size());
+    if (iSalt.empty() && IsAlgorithm(BCRYPT_SHA256_ALGORITHM))
+    {
+        for (const auto &digest : Sha256::CalculateBatch(iData))
+        {
+            result.emplace_back(digest.begin(), digest.end());
+        }
+        return result;
+    }
+    for (const auto &data : iData)
+    {
+        result.emplace_back(CalculateHash(data, iSalt));
+    }
+    return result;
+}
+
+inline const std::vector<uint8_t> Hash::CalculateTreeHash(ByteView iData, size_t chunkSize, ThreadPool *pool) const
+{
+    TRACE_SCOPE("Crypto", "Hash tree");
+    if (!chunkSize)
+    {
+        return {};
+    }
+    // Leaves & root start with different 64 byte blocks (0x00 / 0x01 as in RFC 6962), root block also carries
+    // chunk size & total length. No root equals plain hash of anything or root of a differently split input.
+    std::array<uint8_t, Sha256::c_BlockSize> leaf_block = {};
+    std::array<uint8_t, Sha256::c_BlockSize> node_block = {};
+    node_block[0] = 0x01;
+    for (size_t b = 0; b < sizeof(uint64_t); b++)
+    {
+        node_block[8 + b]  = static_cast<uint8_t>(static_cast<uint64_t>(chunkSize)   >> (56 - 8 * b));
+        node_block[16 + b] = static_cast<uint8_t>(static_cast<uint64_t>(iData.size()) >> (56 - 8 * b));
+    }
+    const auto prefixed_hash = [this](ByteView prefix, ByteView data) -> std::vector<uint8_t>
+    {
+        wchar_t alg_name[64] = {};
+        if (!AlgorithmName(alg_name))
+        {
+            std::vector<uint8_t> joined(prefix.begin(), prefix.end());
+            joined.insert(joined.end(), data.begin(), data.end());
+            return CalculateHash(joined);
+        }
+        auto &context = HashContext::ThreadLocal(alg_name);
+        std::vector<uint8_t> result;
+        if (!context.Update(prefix))
+        {
+            context.Reset();
+            return {};
+        }
+        return context.Calculate(data, result) ? result : std::vector<uint8_t>();
+    };
+    const auto for_each = [pool](const char *name, size_t count, const std::function<void(size_t)> &body)
+    {
+        if (pool && count > 1)
+        {
+            pool->ParallelFor(name, count, body);
+            return;
+        }
+        for (size_t idx = 0; idx < count; idx++)
+        {
+            body(idx);
+        }
+    };
+
+    const size_t chunks     = std::max<size_t>(1, (iData.size() + chunkSize - 1) / chunkSize);
+    const auto   chunk_size = [&](size_t idx) { return std::min(chunkSize, iData.size() - idx * chunkSize); };
+    std::vector<std::vector<uint8_t>> leaves(chunks);
+    if (IsAlgorithm(BCRYPT_SHA256_ALGORITHM))
+    {
+        // Every pool task takes up to 8 leaves, so each worker also runs multi-buffer kernel.
+        const size_t groups = (chunks + Sha256::c_Lanes - 1) / Sha256::c_Lanes;
+        for_each("Hash tree leaves", groups, [&](size_t group)
+        {
+            const size_t first = group * Sha256::c_Lanes;
+            const size_t count = std::min(Sha256::c_Lanes, chunks - first);
+            const uint8_t  *ptrs[Sha256::c_Lanes] = {};
+            size_t          lens[Sha256::c_Lanes] = {};
+            Sha256::Digest  digests[Sha256::c_Lanes];
+            for (size_t i = 0; i < count; i++)
+            {
+                ptrs[i] = iData.data() + (first + i) * chunkSize;
+                lens[i] = chunk_size(first + i);
+            }
+            Sha256::CalculateBatch(ptrs, lens, count, digests, leaf_block.data());
+            for (size_t i = 0; i < count; i++)
+            {
+                leaves[first + i].assign(digests[i].begin(), digests[i].end());
+            }
+        });
+    }
+    else
+    {
+        for_each("Hash tree leaves", chunks, [&](size_t idx)
+        {
+            leaves[idx] = prefixed_hash(leaf_block, iData.subspan(idx * chunkSize, chunk_size(idx)));
+        });
+    }
+    std::vector<uint8_t> nodes;
+    for (const auto &leaf : leaves)
+    {
+        if (leaf.empty())
+        {
+            return {};
+        }
+        nodes.insert(nodes.end(), leaf.begin(), leaf.end());
+    }
+    return prefixed_hash(node_block, nodes);
+}
+
+#else
+// No CNG outside of Windows, AES & RSA fall back to portable implementations.
+#include "AesPortable.hpp"
+#include "RsaPortable.hpp"
+
+using AES = PortableAES;
+using RSA = PortableRSA;
+#endif
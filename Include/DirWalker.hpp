@@ -0,0 +1,811 @@
+#pragma once
+
+// Parallel directory traversal & bulk file fingerprinting.
+// Directories are spread over ThreadPool workers as they are discovered, calling thread takes part as well.
+// Linux: raw getdents64 into 64 KiB buffers & statx relative to directory fd, no per entry path lookup.
+// Elsewhere: std::filesystem::directory_iterator per directory, still parallel over subdirectories.
+// Results are streamed to caller in batches. Optional fingerprint stage (size, mtime, XXH64 of content)
+// runs during walk, incremental mode takes hash from previous FileManifest when size & mtime did not change.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Common.h"
+#include "MappedFile.hpp"
+#include "ThreadWrap.hpp"
+
+#if defined PLATFORM_LINUX
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// XXH64, fast non cryptographic content hash. Streaming, output equals one shot XXH64 with same seed.
+class FastHash
+{
+    static constexpr uint64_t c_Prime1 = 11400714785074694791ULL;
+    static constexpr uint64_t c_Prime2 = 14029467366897019727ULL;
+    static constexpr uint64_t c_Prime3 = 1609587929392839161ULL;
+    static constexpr uint64_t c_Prime4 = 9650029242287828579ULL;
+    static constexpr uint64_t c_Prime5 = 2870177450012600261ULL;
+    static constexpr size_t   c_Stripe = 32;
+
+    uint64_t m_Acc[4]            = {};
+    uint8_t  m_Buffer[c_Stripe]  = {};
+    size_t   m_Buffered          = 0;
+    uint64_t m_Total             = 0;
+    uint64_t m_Seed              = 0;
+
+    static uint64_t Rotl(uint64_t v, int bits) { return (v << bits) | (v >> (64 - bits)); }
+    static uint64_t Load64(const uint8_t *p) { uint64_t v; memcpy(&v, p, sizeof(v)); return v; }
+    static uint32_t Load32(const uint8_t *p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+
+    static uint64_t Round(uint64_t acc, uint64_t input)
+    {
+        acc += input * c_Prime2;
+        return Rotl(acc, 31) * c_Prime1;
+    }
+
+    static uint64_t Merge(uint64_t hash, uint64_t acc)
+    {
+        hash ^= Round(0, acc);
+        return hash * c_Prime1 + c_Prime4;
+    }
+
+    void Stripe(const uint8_t *p)
+    {
+        m_Acc[0] = Round(m_Acc[0], Load64(p));
+        m_Acc[1] = Round(m_Acc[1], Load64(p + 8));
+        m_Acc[2] = Round(m_Acc[2], Load64(p + 16));
+        m_Acc[3] = Round(m_Acc[3], Load64(p + 24));
+    }
+
+public:
+    explicit FastHash(uint64_t seed = 0)
+    {
+        Reset(seed);
+    }
+
+    void Reset(uint64_t seed = 0)
+    {
+        m_Seed     = seed;
+        m_Acc[0]   = seed + c_Prime1 + c_Prime2;
+        m_Acc[1]   = seed + c_Prime2;
+        m_Acc[2]   = seed;
+        m_Acc[3]   = seed - c_Prime1;
+        m_Buffered = 0;
+        m_Total    = 0;
+    }
+
+    void Update(ByteView iData)
+    {
+        const uint8_t *p   = iData.data();
+        size_t         len = iData.size();
+        m_Total += len;
+        if (m_Buffered)
+        {
+            const size_t fill = std::min(len, c_Stripe - m_Buffered);
+            memcpy(m_Buffer + m_Buffered, p, fill);
+            m_Buffered += fill;
+            p   += fill;
+            len -= fill;
+            if (m_Buffered < c_Stripe)
+            {
+                return;
+            }
+            Stripe(m_Buffer);
+            m_Buffered = 0;
+        }
+        for (; len >= c_Stripe; p += c_Stripe, len -= c_Stripe)
+        {
+            Stripe(p);
+        }
+        memcpy(m_Buffer, p, len);
+        m_Buffered = len;
+    }
+
+    uint64_t Final(void) const
+    {
+        uint64_t hash = m_Total >= c_Stripe ?
+            Rotl(m_Acc[0], 1) + Rotl(m_Acc[1], 7) + Rotl(m_Acc[2], 12) + Rotl(m_Acc[3], 18) :
+            m_Seed + c_Prime5;
+        if (m_Total >= c_Stripe)
+        {
+            for (const uint64_t acc : m_Acc)
+            {
+                hash = Merge(hash, acc);
+            }
+        }
+        hash += m_Total;
+        const uint8_t *p   = m_Buffer;
+        size_t         len = m_Buffered;
+        for (; len >= 8; p += 8, len -= 8)
+        {
+            hash ^= Round(0, Load64(p));
+            hash  = Rotl(hash, 27) * c_Prime1 + c_Prime4;
+        }
+        if (len >= 4)
+        {
+            hash ^= static_cast<uint64_t>(Load32(p)) * c_Prime1;
+            hash  = Rotl(hash, 23) * c_Prime2 + c_Prime3;
+            p   += 4;
+            len -= 4;
+        }
+        for (; len; p++, len--)
+        {
+            hash ^= *p * c_Prime5;
+            hash  = Rotl(hash, 11) * c_Prime1;
+        }
+        hash ^= hash >> 33;
+        hash *= c_Prime2;
+        hash ^= hash >> 29;
+        hash *= c_Prime3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+    static uint64_t Calculate(ByteView iData, uint64_t seed = 0)
+    {
+        FastHash hash(seed);
+        hash.Update(iData);
+        return hash.Final();
+    }
+};
+
+// Fingerprints of previous scan, keyed by native path.
+// Binary file: c_Magic, then per file size, mtime, hash (u64 each), path length (u32) & path.
+class FileManifest
+{
+public:
+    struct Fingerprint
+    {
+        uint64_t Size    = 0;
+        int64_t  MtimeNs = 0;
+        uint64_t Hash    = 0;
+    };
+    using PathString = std::filesystem::path::string_type;
+
+private:
+    static constexpr char c_Magic[8] = { 'F', 'S', 'M', 'A', 'N', 'I', 'F', '1' };
+
+    mutable std::mutex                             m_Mutex;
+    std::unordered_map<PathString, Fingerprint>    m_Files;
+
+public:
+    FileManifest(void) = default;
+    FileManifest(const FileManifest&)            = delete;
+    FileManifest &operator=(const FileManifest&) = delete;
+
+    // Thread safe, walker workers insert concurrently.
+    void Insert(const PathString &path, const Fingerprint &fingerprint)
+    {
+        std::lock_guard lock(m_Mutex);
+        m_Files[path] = fingerprint;
+    }
+
+    bool Find(const PathString &path, Fingerprint &oFingerprint) const
+    {
+        std::lock_guard lock(m_Mutex);
+        const auto it = m_Files.find(path);
+        if (it == m_Files.end())
+        {
+            return false;
+        }
+        oFingerprint = it->second;
+        return true;
+    }
+
+    size_t Size(void) const
+    {
+        std::lock_guard lock(m_Mutex);
+        return m_Files.size();
+    }
+
+    void Clear(void)
+    {
+        std::lock_guard lock(m_Mutex);
+        m_Files.clear();
+    }
+
+    bool Load(const std::filesystem::path &path)
+    {
+        MappedFile file;
+        if (!file.Open(path))
+        {
+            return false;
+        }
+        file.Advise(MappedFile::Advice::Sequential);
+        const ByteView data = file.View();
+        if (data.size() < sizeof(c_Magic) || memcmp(data.data(), c_Magic, sizeof(c_Magic)) != 0)
+        {
+            return false;
+        }
+        std::unordered_map<PathString, Fingerprint> files;
+        constexpr size_t header = 3 * sizeof(uint64_t) + sizeof(uint32_t);
+        for (size_t pos = sizeof(c_Magic); pos < data.size();)
+        {
+            if (data.size() - pos < header)
+            {
+                return false;
+            }
+            Fingerprint fingerprint;
+            uint32_t    length = 0;
+            memcpy(&fingerprint.Size,    data.data() + pos,      sizeof(uint64_t));
+            memcpy(&fingerprint.MtimeNs, data.data() + pos + 8,  sizeof(int64_t));
+            memcpy(&fingerprint.Hash,    data.data() + pos + 16, sizeof(uint64_t));
+            memcpy(&length,              data.data() + pos + 24, sizeof(uint32_t));
+            pos += header;
+            const size_t bytes = static_cast<size_t>(length) * sizeof(PathString::value_type);
+            if (data.size() - pos < bytes)
+            {
+                return false;
+            }
+            PathString file_path(length, 0);
+            memcpy(file_path.data(), data.data() + pos, bytes);
+            pos += bytes;
+            files.emplace(std::move(file_path), fingerprint);
+        }
+        std::lock_guard lock(m_Mutex);
+        m_Files = std::move(files);
+        return true;
+    }
+
+    // Written to temporary file & renamed, so crash never leaves half written manifest behind.
+    bool Save(const std::filesystem::path &path) const
+    {
+        std::vector<uint8_t> data(c_Magic, c_Magic + sizeof(c_Magic));
+        {
+            std::lock_guard lock(m_Mutex);
+            for (const auto &[file_path, fingerprint] : m_Files)
+            {
+                const uint32_t length = static_cast<uint32_t>(file_path.size());
+                const size_t   bytes  = file_path.size() * sizeof(PathString::value_type);
+                const size_t   pos    = data.size();
+                data.resize(pos + 3 * sizeof(uint64_t) + sizeof(uint32_t) + bytes);
+                memcpy(data.data() + pos,      &fingerprint.Size,    sizeof(uint64_t));
+                memcpy(data.data() + pos + 8,  &fingerprint.MtimeNs, sizeof(int64_t));
+                memcpy(data.data() + pos + 16, &fingerprint.Hash,    sizeof(uint64_t));
+                memcpy(data.data() + pos + 24, &length,              sizeof(uint32_t));
+                memcpy(data.data() + pos + 28, file_path.data(),     bytes);
+            }
+        }
+        std::filesystem::path temp_path = path;
+        temp_path += ".tmp";
+        {
+            MappedFile file;
+            if (!file.Create(temp_path, data.size()))
+            {
+                return false;
+            }
+            memcpy(file.MutableView().data(), data.data(), data.size());
+            if (!file.Flush())
+            {
+                return false;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(temp_path, path, error);
+        return !error;
+    }
+};
+
+class DirWalker
+{
+public:
+    enum class EntryType : uint8_t
+    {
+        File,
+        Directory,
+        Symlink,
+        Other
+    };
+
+    struct Entry
+    {
+        std::filesystem::path Path;
+        EntryType             Type        = EntryType::Other;
+        uint64_t              Size        = 0;
+        int64_t               MtimeNs     = 0;
+        uint64_t              Hash        = 0;          // Valid when Fingerprinted.
+        bool                  Fingerprinted = false;
+        bool                  Unchanged     = false;    // Hash taken from previous manifest, content was not read.
+    };
+
+    struct Options
+    {
+        bool                FollowSymlinks     = false;
+        bool                ReportDirectories  = false;
+        bool                Stat               = true;      // Size & mtime of every file, implied by Fingerprint.
+        bool                Fingerprint        = false;
+        const FileManifest *Previous           = nullptr;   // Incremental mode: unchanged files are not read.
+        FileManifest       *Current            = nullptr;   // Receives fingerprints of this scan.
+        size_t              BatchSize          = 512;       // Entries per sink call.
+        size_t              Workers            = 0;         // 0 - hardware concurrency.
+    };
+
+    struct Stats
+    {
+        uint64_t Files       = 0;
+        uint64_t Directories = 0;
+        uint64_t HashedBytes = 0;
+        uint64_t Reused      = 0;       // Fingerprints taken from previous manifest.
+        uint64_t Errors      = 0;       // Unreadable directories & files, walk goes on.
+    };
+
+    // Called with batches of entries, never concurrently. Batch may be moved from.
+    using Sink = std::function<void(std::vector<Entry> &batch)>;
+
+private:
+    static constexpr size_t c_ListBuffer = 64 * 1024;
+    static constexpr size_t c_ReadBuffer = 256 * 1024;
+
+    struct WalkContext
+    {
+        Options                         options;
+        std::mutex                      mutex;
+        std::condition_variable         wake;
+        std::deque<std::filesystem::path> pending;
+        size_t                          active   = 0;
+        bool                            finished = false;
+        std::set<std::pair<uint64_t, uint64_t>> visited;   // (device, inode) of every entered directory when links are followed.
+
+        std::mutex                      sinkMutex;
+        const Sink                     *sink = nullptr;
+
+        std::atomic<uint64_t>           files       = 0;
+        std::atomic<uint64_t>           directories = 0;
+        std::atomic<uint64_t>           hashedBytes = 0;
+        std::atomic<uint64_t>           reused      = 0;
+        std::atomic<uint64_t>           errors      = 0;
+    };
+
+    ThreadPool *m_Pool;
+    Options     m_Options;
+    Stats       m_Stats;
+
+    static void Emit(WalkContext &ctx, std::vector<Entry> &batch)
+    {
+        if (batch.empty())
+        {
+            return;
+        }
+        {
+            std::lock_guard lock(ctx.sinkMutex);
+            (*ctx.sink)(batch);
+        }
+        batch.clear();
+    }
+
+    // Returns false when directory should not be entered, symlink loops are cut here.
+    static bool FirstVisit(WalkContext &ctx, uint64_t device, uint64_t inode)
+    {
+        std::lock_guard lock(ctx.mutex);
+        return ctx.visited.emplace(device, inode).second;
+    }
+
+    static void Schedule(WalkContext &ctx, std::filesystem::path &&directory)
+    {
+        {
+            std::lock_guard lock(ctx.mutex);
+            ctx.pending.push_back(std::move(directory));
+        }
+        ctx.wake.notify_one();
+    }
+
+    static bool ApplyPrevious(const WalkContext &ctx, Entry &entry)
+    {
+        FileManifest::Fingerprint previous;
+        if (!ctx.options.Previous || !ctx.options.Previous->Find(entry.Path.native(), previous) ||
+            previous.Size != entry.Size || previous.MtimeNs != entry.MtimeNs)
+        {
+            return false;
+        }
+        entry.Hash          = previous.Hash;
+        entry.Fingerprinted = true;
+        entry.Unchanged     = true;
+        return true;
+    }
+
+    // viaLink - file was reached through followed symlink, name must be resolved then.
+    static void Fingerprint(WalkContext &ctx, Entry &entry, std::vector<uint8_t> &buffer, int dirFd, const char *name, bool viaLink)
+    {
+        if (ApplyPrevious(ctx, entry))
+        {
+            ctx.reused++;
+        }
+        else
+        {
+            FastHash hash;
+            uint64_t read_total = 0;
+            bool     ok         = false;
+#if defined PLATFORM_LINUX
+            int fd = -1;
+            do
+            {
+                fd = openat(dirFd, name, O_RDONLY | O_CLOEXEC | (viaLink ? 0 : O_NOFOLLOW));
+            } while (fd < 0 && errno == EINTR);
+            if (fd >= 0)
+            {
+                posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+                ssize_t read_now = 0;
+                while ((read_now = read(fd, buffer.data(), buffer.size())) != 0)
+                {
+                    if (read_now < 0)
+                    {
+                        if (errno == EINTR)
+                        {
+                            continue;
+                        }
+                        break;
+                    }
+                    hash.Update(ByteView(buffer.data(), static_cast<size_t>(read_now)));
+                    read_total += static_cast<uint64_t>(read_now);
+                }
+                ok = read_now == 0;
+                close(fd);
+            }
+#else
+            (void)buffer;
+            (void)dirFd;
+            (void)name;
+            (void)viaLink;
+            MappedFile file;
+            if (file.Open(entry.Path))
+            {
+                file.Advise(MappedFile::Advice::Sequential);
+                hash.Update(file.View());
+                read_total = file.Size();
+                ok         = true;
+            }
+#endif
+            if (!ok)
+            {
+                ctx.errors++;
+                return;
+            }
+            // File changed while read, size from stat would not match content.
+            entry.Size          = read_total;
+            entry.Hash          = hash.Final();
+            entry.Fingerprinted = true;
+            ctx.hashedBytes += read_total;
+        }
+        if (ctx.options.Current)
+        {
+            ctx.options.Current->Insert(entry.Path.native(), { entry.Size, entry.MtimeNs, entry.Hash });
+        }
+    }
+
+    static void AddEntry(WalkContext &ctx, Entry &&entry, std::vector<Entry> &batch)
+    {
+        batch.push_back(std::move(entry));
+        if (batch.size() >= ctx.options.BatchSize)
+        {
+            Emit(ctx, batch);
+        }
+    }
+
+#if defined PLATFORM_LINUX
+    struct LinuxDirent64
+    {
+        uint64_t       d_ino;
+        int64_t        d_off;
+        unsigned short d_reclen;
+        unsigned char  d_type;
+        char           d_name[1];
+    };
+
+    // Fills type, size & mtime. statx when libc has it, fstatat otherwise.
+    static bool StatAt(int dirFd, const char *name, bool follow, EntryType &oType, uint64_t &oSize, int64_t &oMtimeNs, uint64_t &oDevice, uint64_t &oInode)
+    {
+        const int flags = (follow ? 0 : AT_SYMLINK_NOFOLLOW) | AT_NO_AUTOMOUNT;
+        mode_t mode = 0;
+#if defined STATX_BASIC_STATS
+        struct statx info = {};
+        if (statx(dirFd, name, flags, STATX_TYPE | STATX_SIZE | STATX_MTIME | STATX_INO, &info) != 0)
+        {
+            return false;
+        }
+        mode      = info.stx_mode;
+        oSize     = info.stx_size;
+        oMtimeNs  = static_cast<int64_t>(info.stx_mtime.tv_sec) * 1000000000 + info.stx_mtime.tv_nsec;
+        oDevice   = (static_cast<uint64_t>(info.stx_dev_major) << 32) | info.stx_dev_minor;
+        oInode    = info.stx_ino;
+#else
+        struct stat info = {};
+        if (fstatat(dirFd, name, &info, flags) != 0)
+        {
+            return false;
+        }
+        mode      = info.st_mode;
+        oSize     = static_cast<uint64_t>(info.st_size);
+        oMtimeNs  = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+        oDevice   = static_cast<uint64_t>(info.st_dev);
+        oInode    = static_cast<uint64_t>(info.st_ino);
+#endif
+        oType = S_ISREG(mode) ? EntryType::File : S_ISDIR(mode) ? EntryType::Directory : S_ISLNK(mode) ? EntryType::Symlink : EntryType::Other;
+        return true;
+    }
+
+    static bool DirectoryKey(const std::filesystem::path &directory, uint64_t &oDevice, uint64_t &oInode)
+    {
+        EntryType type     = EntryType::Other;
+        uint64_t  size     = 0;
+        int64_t   mtime_ns = 0;
+        return StatAt(AT_FDCWD, directory.c_str(), true, type, size, mtime_ns, oDevice, oInode);
+    }
+
+    static void ListDirectory(WalkContext &ctx, const std::filesystem::path &directory, std::vector<Entry> &batch,
+                              std::vector<uint8_t> &listBuffer, std::vector<uint8_t> &readBuffer)
+    {
+        int fd = -1;
+        do
+        {
+            fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        } while (fd < 0 && errno == EINTR);
+        if (fd < 0)
+        {
+            ctx.errors++;
+            return;
+        }
+        MakeScopeGuard([fd]() { close(fd); });
+        const bool need_stat = ctx.options.Stat || ctx.options.Fingerprint;
+        for (;;)
+        {
+            const long listed = syscall(SYS_getdents64, fd, listBuffer.data(), listBuffer.size());
+            if (listed < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (listed <= 0)
+            {
+                if (listed < 0)
+                {
+                    ctx.errors++;
+                }
+                return;
+            }
+            for (long pos = 0; pos < listed;)
+            {
+                const auto *dirent = reinterpret_cast<const LinuxDirent64*>(listBuffer.data() + pos);
+                pos += dirent->d_reclen;
+                const char *name = dirent->d_name;
+                if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0)))
+                {
+                    continue;
+                }
+                Entry entry;
+                entry.Path = directory / name;
+                switch (dirent->d_type)
+                {
+                case DT_REG: entry.Type = EntryType::File;      break;
+                case DT_DIR: entry.Type = EntryType::Directory; break;
+                case DT_LNK: entry.Type = EntryType::Symlink;   break;
+                default:     entry.Type = EntryType::Other;     break;
+                }
+                const bool follow = entry.Type == EntryType::Symlink && ctx.options.FollowSymlinks;
+                uint64_t device = 0;
+                uint64_t inode  = dirent->d_ino;
+                // With links followed every directory needs device & inode, links may point back to it.
+                const bool need_key = ctx.options.FollowSymlinks && entry.Type == EntryType::Directory;
+                if (dirent->d_type == DT_UNKNOWN || follow || need_key || (need_stat && entry.Type == EntryType::File))
+                {
+                    if (!StatAt(fd, name, follow, entry.Type, entry.Size, entry.MtimeNs, device, inode))
+                    {
+                        ctx.errors++;
+                        continue;
+                    }
+                }
+                if (entry.Type == EntryType::Directory)
+                {
+                    ctx.directories++;
+                    if (ctx.options.FollowSymlinks && !FirstVisit(ctx, device, inode))
+                    {
+                        continue;
+                    }
+                    Schedule(ctx, std::filesystem::path(entry.Path));
+                    if (!ctx.options.ReportDirectories)
+                    {
+                        continue;
+                    }
+                }
+                else if (entry.Type == EntryType::File)
+                {
+                    ctx.files++;
+                    if (ctx.options.Fingerprint)
+                    {
+                        Fingerprint(ctx, entry, readBuffer, fd, name, follow);
+                    }
+                }
+                AddEntry(ctx, std::move(entry), batch);
+            }
+        }
+    }
+#else
+    static int64_t ToNs(std::filesystem::file_time_type time)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    }
+
+    // No inode numbers here, canonical path identifies directory.
+    static bool DirectoryKey(const std::filesystem::path &directory, uint64_t &oDevice, uint64_t &oInode)
+    {
+        std::error_code error;
+        const auto canonical = std::filesystem::canonical(directory, error);
+        oDevice = std::hash<std::filesystem::path::string_type>()(canonical.native());
+        oInode  = 0;
+        return !error;
+    }
+
+    static void ListDirectory(WalkContext &ctx, const std::filesystem::path &directory, std::vector<Entry> &batch,
+                              std::vector<uint8_t> &listBuffer, std::vector<uint8_t> &readBuffer)
+    {
+        (void)listBuffer;
+        std::error_code error;
+        std::filesystem::directory_iterator it(directory, std::filesystem::directory_options::skip_permission_denied, error);
+        if (error)
+        {
+            ctx.errors++;
+            return;
+        }
+        const bool need_stat = ctx.options.Stat || ctx.options.Fingerprint;
+        for (; it != std::filesystem::directory_iterator(); it.increment(error))
+        {
+            if (error)
+            {
+                ctx.errors++;
+                return;
+            }
+            const auto &dir_entry = *it;
+            Entry entry;
+            entry.Path = dir_entry.path();
+            const bool is_link = dir_entry.is_symlink(error);
+            const bool follow  = is_link && ctx.options.FollowSymlinks;
+            const auto status  = follow ? dir_entry.status(error) : dir_entry.symlink_status(error);
+            entry.Type = is_link && !follow                                  ? EntryType::Symlink :
+                         status.type() == std::filesystem::file_type::regular   ? EntryType::File :
+                         status.type() == std::filesystem::file_type::directory ? EntryType::Directory : EntryType::Other;
+            if (entry.Type == EntryType::Directory)
+            {
+                ctx.directories++;
+                uint64_t device = 0, inode = 0;
+                if (ctx.options.FollowSymlinks && (!DirectoryKey(entry.Path, device, inode) || !FirstVisit(ctx, device, inode)))
+                {
+                    continue;
+                }
+                Schedule(ctx, std::filesystem::path(entry.Path));
+                if (!ctx.options.ReportDirectories)
+                {
+                    continue;
+                }
+            }
+            else if (entry.Type == EntryType::File)
+            {
+                ctx.files++;
+                if (need_stat)
+                {
+                    entry.Size    = dir_entry.file_size(error);
+                    entry.MtimeNs = ToNs(dir_entry.last_write_time(error));
+                }
+                if (ctx.options.Fingerprint)
+                {
+                    Fingerprint(ctx, entry, readBuffer, -1, nullptr, follow);
+                }
+            }
+            AddEntry(ctx, std::move(entry), batch);
+        }
+    }
+#endif
+
+    // Worker body, runs until no directory is pending & nobody is listing one.
+    // Touches only ctx, late helpers may start after Walk returned.
+    static void Run(const std::shared_ptr<WalkContext> &ctx)
+    {
+        std::vector<Entry>   batch;
+        std::vector<uint8_t> list_buffer(c_ListBuffer);
+        std::vector<uint8_t> read_buffer(ctx->options.Fingerprint ? c_ReadBuffer : 0);
+        batch.reserve(ctx->options.BatchSize);
+        std::unique_lock lock(ctx->mutex);
+        for (;;)
+        {
+            ctx->wake.wait(lock, [&ctx]() { return ctx->finished || !ctx->pending.empty() || !ctx->active; });
+            if (ctx->finished)
+            {
+                return;
+            }
+            if (ctx->pending.empty())
+            {
+                ctx->finished = true;
+                ctx->wake.notify_all();
+                return;
+            }
+            const std::filesystem::path directory = std::move(ctx->pending.front());
+            ctx->pending.pop_front();
+            ctx->active++;
+            lock.unlock();
+            ListDirectory(*ctx, directory, batch, list_buffer, read_buffer);
+            lock.lock();
+            if (ctx->pending.empty())
+            {
+                // Going idle, leftovers are emitted while still counted as active, so walk can`t end under us.
+                lock.unlock();
+                Emit(*ctx, batch);
+                lock.lock();
+            }
+            ctx->active--;
+            if (!ctx->active && ctx->pending.empty())
+            {
+                ctx->wake.notify_all();
+            }
+        }
+    }
+
+public:
+    DirWalker(ThreadPool *pool = ThreadPool::GLobalInstance()) : m_Pool(pool) {}
+
+    DirWalker(ThreadPool *pool, const Options &options) :
+        m_Pool(pool), m_Options(options)
+    {
+        if (!m_Options.BatchSize)
+        {
+            m_Options.BatchSize = 1;
+        }
+    }
+
+    // Streams every entry under root to sink. Returns false when root is not a readable directory.
+    bool Walk(const std::filesystem::path &root, const Sink &sink)
+    {
+        m_Stats = {};
+        std::error_code error;
+        if (!std::filesystem::is_directory(root, error))
+        {
+            return false;
+        }
+        auto ctx = std::make_shared<WalkContext>();
+        ctx->options = m_Options;
+        ctx->sink    = &sink;
+        uint64_t device = 0, inode = 0;
+        if (m_Options.FollowSymlinks && DirectoryKey(root, device, inode))
+        {
+            // Link back to root must not walk the tree again.
+            FirstVisit(*ctx, device, inode);
+        }
+        ctx->pending.push_back(root);
+        const size_t workers = m_Options.Workers ? m_Options.Workers : std::max(1u, std::thread::hardware_concurrency());
+        for (size_t i = 1; m_Pool && i < workers; i++)
+        {
+            m_Pool->AddDetachedTask("Directory walk", std::function<void()>([ctx]() { Run(ctx); }));
+        }
+        Run(ctx);
+        m_Stats.Files       = ctx->files;
+        m_Stats.Directories = ctx->directories;
+        m_Stats.HashedBytes = ctx->hashedBytes;
+        m_Stats.Reused      = ctx->reused;
+        m_Stats.Errors      = ctx->errors;
+        return true;
+    }
+
+    // Collects whole tree, order is unspecified.
+    bool Walk(const std::filesystem::path &root, std::vector<Entry> &oEntries)
+    {
+        oEntries.clear();
+        return Walk(root, Sink([&oEntries](std::vector<Entry> &batch)
+        {
+            oEntries.insert(oEntries.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+        }));
+    }
+
+    const Stats &LastStats(void) const { return m_Stats; }
+};
@@ -1,2 +1,58 @@
 #pragma once
-#include "../Libs/LogLib/LogLib.h"
\ No newline at end of file
+#if defined __has_include
+#if __has_include("../Libs/LogLib/LogLib.h")
+#include "../Libs/LogLib/LogLib.h"
+#elif !defined LOG_ASYNC
+// LogLib submodule is not checked out (headers only builds, e.g. Benchmarks on Linux), AsyncLog serves Log_*F.
+#define LOG_ASYNC
+#endif
+#else
+#include "../Libs/LogLib/LogLib.h"
+#endif
+
+#define LOG_LEVEL_DEBUG     0
+#define LOG_LEVEL_INFO      1
+#define LOG_LEVEL_WARNING   2
+#define LOG_LEVEL_ERROR     3
+#define LOG_LEVEL_NONE      4
+
+// Build time threshold, calls below it compile to nothing & their arguments are never evaluated.
+#if !defined LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+// Async mode: Log_*F only enqueue records, formatting & writing happen on AsyncLog consumer thread.
+// Binary mode is async mode writing format ids & raw arguments, see Tools/LogDecoder.
+#if defined LOG_BINARY && !defined LOG_ASYNC
+#define LOG_ASYNC
+#endif
+
+#if defined LOG_ASYNC
+#include "AsyncLog.hpp"
+
+#undef Log_DebugF
+#undef Log_InfoF
+#undef Log_WarningF
+#undef Log_ErrorF
+#define Log_DebugF(format, ...)   ASYNC_LOG_SITE(AsyncLog::Level::Debug,   format, ##__VA_ARGS__)
+#define Log_InfoF(format, ...)    ASYNC_LOG_SITE(AsyncLog::Level::Info,    format, ##__VA_ARGS__)
+#define Log_WarningF(format, ...) ASYNC_LOG_SITE(AsyncLog::Level::Warning, format, ##__VA_ARGS__)
+#define Log_ErrorF(format, ...)   ASYNC_LOG_SITE(AsyncLog::Level::Error,   format, ##__VA_ARGS__)
+#endif
+
+#if LOG_MIN_LEVEL > LOG_LEVEL_DEBUG
+#undef  Log_DebugF
+#define Log_DebugF(...)   ((void)0)
+#endif
+#if LOG_MIN_LEVEL > LOG_LEVEL_INFO
+#undef  Log_InfoF
+#define Log_InfoF(...)    ((void)0)
+#endif
+#if LOG_MIN_LEVEL > LOG_LEVEL_WARNING
+#undef  Log_WarningF
+#define Log_WarningF(...) ((void)0)
+#endif
+#if LOG_MIN_LEVEL > LOG_LEVEL_ERROR
+#undef  Log_ErrorF
+#define Log_ErrorF(...)   ((void)0)
+#endif
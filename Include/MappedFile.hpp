@@ -0,0 +1,343 @@
+#pragma once
+
+// Memory mapped file views.
+// Read only & read write mappings of whole file or its part, exposed as ByteView / MutableByteView,
+// so Marshall::UnmarshallObject & Hash::CalculateHash read big inputs straight from page cache, no copies.
+// Access pattern hints go to madvise (PrefetchVirtualMemory on Windows), huge pages are best effort.
+
+#include <filesystem>
+#include <utility>
+
+#include "Common.h"
+
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+class MappedFile
+{
+public:
+    enum class Access : uint8_t
+    {
+        ReadOnly,
+        ReadWrite
+    };
+
+    enum class Advice : uint8_t
+    {
+        Normal,
+        Sequential,     // Aggressive read ahead, pages behind may be dropped early.
+        Random,         // No read ahead.
+        WillNeed,       // Start reading range now.
+        DontNeed        // Range may be dropped from page cache.
+    };
+
+private:
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+    HANDLE   m_File    = INVALID_HANDLE_VALUE;
+    HANDLE   m_Mapping = nullptr;
+#else
+    int      m_File    = -1;
+#endif
+    uint8_t *m_Base    = nullptr;       // Start of mapping, aligned down to allocation granularity.
+    size_t   m_Mapped  = 0;
+    size_t   m_Delta   = 0;             // Requested offset - aligned offset.
+    size_t   m_Size    = 0;
+    Access   m_Access  = Access::ReadOnly;
+
+    static size_t Granularity(void)
+    {
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+        SYSTEM_INFO info = {};
+        GetSystemInfo(&info);
+        return info.dwAllocationGranularity;
+#else
+        static const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        return page;
+#endif
+    }
+
+    bool OpenFile(const std::filesystem::path &path, Access access, bool create)
+    {
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+        const DWORD rights = access == Access::ReadWrite ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ;
+        m_File = CreateFileW(path.c_str(), rights, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                             create ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        return m_File != INVALID_HANDLE_VALUE;
+#else
+        const int flags = (access == Access::ReadWrite ? O_RDWR : O_RDONLY) | (create ? O_CREAT : 0) | O_CLOEXEC;
+        do
+        {
+            m_File = open(path.c_str(), flags, 0644);
+        } while (m_File < 0 && errno == EINTR);
+        return m_File >= 0;
+#endif
+    }
+
+    bool FileSize(uint64_t &oSize) const
+    {
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+        LARGE_INTEGER size = {};
+        if (!GetFileSizeEx(m_File, &size))
+        {
+            return false;
+        }
+        oSize = static_cast<uint64_t>(size.QuadPart);
+#else
+        struct stat info = {};
+        if (fstat(m_File, &info) != 0)
+        {
+            return false;
+        }
+        oSize = static_cast<uint64_t>(info.st_size);
+#endif
+        return true;
+    }
+
+    bool SetFileSize(uint64_t size)
+    {
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+        LARGE_INTEGER position = {};
+        position.QuadPart = static_cast<LONGLONG>(size);
+        return SetFilePointerEx(m_File, position, nullptr, FILE_BEGIN) && SetEndOfFile(m_File);
+#else
+        return ftruncate(m_File, static_cast<off_t>(size)) == 0;
+#endif
+    }
+
+    bool MapRange(uint64_t offset, size_t length, bool hugePages)
+    {
+        const uint64_t aligned = offset - offset % Granularity();
+        m_Delta  = static_cast<size_t>(offset - aligned);
+        m_Size   = length;
+        m_Mapped = m_Delta + length;
+        if (!length)
+        {
+            return true;                                            // Empty view, nothing to map.
+        }
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+        // Large pages are available only for pagefile backed sections, file views always use small pages.
+        (void)hugePages;
+        const uint64_t end = offset + length;
+        m_Mapping = CreateFileMappingW(m_File, nullptr, m_Access == Access::ReadWrite ? PAGE_READWRITE : PAGE_READONLY,
+                                       static_cast<DWORD>(end >> 32), static_cast<DWORD>(end), nullptr);
+        if (!m_Mapping)
+        {
+            return false;
+        }
+        m_Base = static_cast<uint8_t*>(MapViewOfFile(m_Mapping, m_Access == Access::ReadWrite ? FILE_MAP_WRITE : FILE_MAP_READ,
+                                                     static_cast<DWORD>(aligned >> 32), static_cast<DWORD>(aligned), m_Mapped));
+        return m_Base != nullptr;
+#else
+        const int protection = m_Access == Access::ReadWrite ? PROT_READ | PROT_WRITE : PROT_READ;
+        void *base = mmap(nullptr, m_Mapped, protection, MAP_SHARED, m_File, static_cast<off_t>(aligned));
+        if (base == MAP_FAILED)
+        {
+            return false;
+        }
+        m_Base = static_cast<uint8_t*>(base);
+#if defined MADV_HUGEPAGE
+        // Needs THP for page cache (read only file THP or filesystem support), silently ignored otherwise.
+        if (hugePages)
+        {
+            madvise(m_Base, m_Mapped, MADV_HUGEPAGE);
+        }
+#else
+        (void)hugePages;
+#endif
+        return true;
+#endif
+    }
+
+public:
+    MappedFile(void) = default;
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile &operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile &&other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    MappedFile &operator=(MappedFile &&other) noexcept
+    {
+        if (this != &other)
+        {
+            Close();
+            std::swap(m_File,   other.m_File);
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+            std::swap(m_Mapping, other.m_Mapping);
+#endif
+            std::swap(m_Base,   other.m_Base);
+            std::swap(m_Mapped, other.m_Mapped);
+            std::swap(m_Delta,  other.m_Delta);
+            std::swap(m_Size,   other.m_Size);
+            std::swap(m_Access, other.m_Access);
+        }
+        return *this;
+    }
+
+    ~MappedFile()
+    {
+        Close();
+    }
+
+    // Maps [offset, offset + length) of existing file, length 0 maps up to end of file.
+    // Offset needs no alignment, view starts exactly at it.
+    bool Open(const std::filesystem::path &path, Access access = Access::ReadOnly, uint64_t offset = 0, size_t length = 0, bool hugePages = false)
+    {
+        Close();
+        m_Access = access;
+        uint64_t file_size = 0;
+        if (!OpenFile(path, access, false) || !FileSize(file_size) || offset > file_size)
+        {
+            Close();
+            return false;
+        }
+        const uint64_t available = file_size - offset;
+        if (!length || length > available)
+        {
+            if (available > static_cast<uint64_t>(SIZE_MAX))
+            {
+                Close();
+                return false;
+            }
+            length = static_cast<size_t>(available);
+        }
+        if (!MapRange(offset, length, hugePages))
+        {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    // Creates file (or truncates existing one) of given size & maps it for writing.
+    bool Create(const std::filesystem::path &path, size_t size, bool hugePages = false)
+    {
+        Close();
+        m_Access = Access::ReadWrite;
+        if (!OpenFile(path, Access::ReadWrite, true) || !SetFileSize(size) || !MapRange(0, size, hugePages))
+        {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    // Hint for range of view, length 0 means up to the end of view.
+    bool Advise(Advice advice, size_t offset = 0, size_t length = 0) const
+    {
+        if (!m_Base || offset >= m_Size)
+        {
+            return false;
+        }
+        if (!length || length > m_Size - offset)
+        {
+            length = m_Size - offset;
+        }
+        // Range has to start on page boundary.
+        const size_t start = (m_Delta + offset) - (m_Delta + offset) % Granularity();
+        const size_t count = m_Delta + offset + length - start;
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+        if (advice == Advice::WillNeed || advice == Advice::Sequential)
+        {
+            WIN32_MEMORY_RANGE_ENTRY range = { m_Base + start, count };
+            return PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0) != FALSE;
+        }
+        if (advice == Advice::DontNeed && m_Access == Access::ReadOnly)
+        {
+            return DiscardVirtualMemory(m_Base + start, count) == ERROR_SUCCESS;
+        }
+        return true;
+#else
+        int flag = POSIX_MADV_NORMAL;
+        switch (advice)
+        {
+        case Advice::Normal:     flag = POSIX_MADV_NORMAL;     break;
+        case Advice::Sequential: flag = POSIX_MADV_SEQUENTIAL; break;
+        case Advice::Random:     flag = POSIX_MADV_RANDOM;     break;
+        case Advice::WillNeed:   flag = POSIX_MADV_WILLNEED;   break;
+        case Advice::DontNeed:   flag = POSIX_MADV_DONTNEED;   break;
+        }
+        return posix_madvise(m_Base + start, count, flag) == 0;
+#endif
+    }
+
+    // Writes dirty pages back to file. Async only schedules writeback.
+    bool Flush(bool async = false) const
+    {
+        if (m_Access != Access::ReadWrite)
+        {
+            return false;
+        }
+        if (!m_Base)
+        {
+            return IsOpen();
+        }
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+        return FlushViewOfFile(m_Base, m_Mapped) && (async || FlushFileBuffers(m_File));
+#else
+        return msync(m_Base, m_Mapped, async ? MS_ASYNC : MS_SYNC) == 0;
+#endif
+    }
+
+    void Close(void)
+    {
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+        if (m_Base)
+        {
+            UnmapViewOfFile(m_Base);
+        }
+        if (m_Mapping)
+        {
+            CloseHandle(m_Mapping);
+            m_Mapping = nullptr;
+        }
+        if (m_File != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(m_File);
+            m_File = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (m_Base)
+        {
+            munmap(m_Base, m_Mapped);
+        }
+        if (m_File >= 0)
+        {
+            close(m_File);
+            m_File = -1;
+        }
+#endif
+        m_Base   = nullptr;
+        m_Mapped = 0;
+        m_Delta  = 0;
+        m_Size   = 0;
+    }
+
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+    bool IsOpen(void) const { return m_File != INVALID_HANDLE_VALUE; }
+#else
+    bool IsOpen(void) const { return m_File >= 0; }
+#endif
+    size_t Size(void)  const { return m_Size; }
+    Access Mode(void)  const { return m_Access; }
+
+    // Views are valid until Close or destruction.
+    ByteView View(void) const
+    {
+        return ByteView(m_Base ? m_Base + m_Delta : nullptr, m_Size);
+    }
+
+    MutableByteView MutableView(void)
+    {
+        return m_Access == Access::ReadWrite && m_Base ? MutableByteView(m_Base + m_Delta, m_Size) : MutableByteView();
+    }
+};
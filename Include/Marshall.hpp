@@ -2,28 +2,45 @@
 
 // A bit sloppy and chubby way to transfer memory objects into buffer.
 
+#include <cstring>
 #include <map>
+#include <memory_resource>
 #include <string>
 #include <vector>
 
 #include <typeindex>
 
+#include "Common.h"
+#include "Trace.hpp"
+
 #define ADD_IMPL(C, T) \
-    inline const std::vector<uint8_t> Marshallable<T>::Marshall() const \
+    template <> inline const std::vector<uint8_t> Marshallable<T>::Marshall() const \
     { return C<T>::MarshallImpl(m_Object); }; \
-    inline void Marshallable<T>::Unmarshall(const std::vector<uint8_t> &marshalledData, T &result, std::size_t &processedData) \
+    template <> inline void Marshallable<T>::MarshallTo(std::vector<uint8_t> &result) const \
+    { C<T>::MarshallAppend(m_Object, result); }; \
+    template <> inline void Marshallable<T>::MarshallTo(std::pmr::vector<uint8_t> &result) const \
+    { C<T>::MarshallAppend(m_Object, result); }; \
+    template <> inline void Marshallable<T>::Unmarshall(ByteView marshalledData, T &result, std::size_t &processedData) \
     { result = C<T>::UnmarshallImpl(marshalledData, processedData); };
 
 #define ADD_IMPL_SUB_ONE(C, T, T1) \
-    inline const std::vector<uint8_t> Marshallable<T<T1>>::Marshall() const \
+    template <> inline const std::vector<uint8_t> Marshallable<T<T1>>::Marshall() const \
     { return C<T1>::MarshallImpl(m_Object); }; \
-    inline void Marshallable<T<T1>>::Unmarshall(const std::vector<uint8_t> &marshalledData, T<T1> &result, std::size_t &processedData) \
+    template <> inline void Marshallable<T<T1>>::MarshallTo(std::vector<uint8_t> &result) const \
+    { C<T1>::MarshallAppend(m_Object, result); }; \
+    template <> inline void Marshallable<T<T1>>::MarshallTo(std::pmr::vector<uint8_t> &result) const \
+    { C<T1>::MarshallAppend(m_Object, result); }; \
+    template <> inline void Marshallable<T<T1>>::Unmarshall(ByteView marshalledData, T<T1> &result, std::size_t &processedData) \
     { result = C<T1>::UnmarshallImpl(marshalledData, processedData); };
 
 #define ADD_IMPL_SUB_TWO(C, T, T1, T2) \
-    inline const std::vector<uint8_t> Marshallable<T<T1,T2>>::Marshall() const \
+    template <> inline const std::vector<uint8_t> Marshallable<T<T1,T2>>::Marshall() const \
     { return C<T1,T2>::MarshallImpl(m_Object); }; \
-    inline void Marshallable<T<T1, T2>>::Unmarshall(const std::vector<uint8_t> &marshalledData, T<T1, T2> &result, std::size_t &processedData) \
+    template <> inline void Marshallable<T<T1,T2>>::MarshallTo(std::vector<uint8_t> &result) const \
+    { C<T1,T2>::MarshallAppend(m_Object, result); }; \
+    template <> inline void Marshallable<T<T1,T2>>::MarshallTo(std::pmr::vector<uint8_t> &result) const \
+    { C<T1,T2>::MarshallAppend(m_Object, result); }; \
+    template <> inline void Marshallable<T<T1, T2>>::Unmarshall(ByteView marshalledData, T<T1, T2> &result, std::size_t &processedData) \
     { result = C<T1,T2>::UnmarshallImpl(marshalledData, processedData); };
 
 struct Marshall;
@@ -34,8 +51,11 @@ struct Marshallable
     friend struct Marshall;
     using   MarshallType = T;
     const   MarshallType &m_Object;
-    static void Unmarshall(const std::vector<uint8_t> &marshalledData, MarshallType &result, std::size_t &processedData);
+    static void Unmarshall(ByteView marshalledData, MarshallType &result, std::size_t &processedData);
     virtual const std::vector<uint8_t> Marshall() const;
+    // Appends to result, no temporary buffers. pmr version keeps whole output inside caller`s arena.
+    void MarshallTo(std::vector<uint8_t> &result) const;
+    void MarshallTo(std::pmr::vector<uint8_t> &result) const;
 
 public:
     Marshallable(const MarshallType &obj) : m_Object(obj) {};
@@ -46,42 +66,73 @@ struct Marshall
     template <typename T>
     static void MarshallObject(const Marshallable<T> &obj, std::vector<uint8_t> &result)
     {
+        TRACE_SCOPE("Marshall", "Marshall");
         result = obj.Marshall();
     }
 
     template <typename T>
-    static T UnmarshallObject(const std::vector<uint8_t> &data, std::size_t &processedData)
+    static void MarshallObject(const Marshallable<T> &obj, std::pmr::vector<uint8_t> &result)
+    {
+        TRACE_SCOPE("Marshall", "Marshall");
+        result.clear();
+        obj.MarshallTo(result);
+    }
+
+    // View overloads read directly from caller memory (e.g. MappedFile::View()), no copy of input.
+    template <typename T>
+    static T UnmarshallObject(ByteView data, std::size_t &processedData)
     {
         T result = {};
         Marshallable<T>::Unmarshall(data, result, processedData);
         return result;
     }
 
+    // Nested entries go through overload above, only top level call is traced.
     template <typename T>
-    static T UnmarshallObject(const std::vector<uint8_t> &data)
+    static T UnmarshallObject(ByteView data)
     {
-        T result = {};
+        TRACE_SCOPE("Marshall", "Unmarshall");
         std::size_t processed_data = 0;
-        Marshallable<T>::Unmarshall(data, result, processed_data);
-        return result;
+        return UnmarshallObject<T>(data, processed_data);
+    }
+
+    template <typename T>
+    static T UnmarshallObject(const std::vector<uint8_t> &data, std::size_t &processedData)
+    {
+        TRACE_SCOPE("Marshall", "Unmarshall");
+        return UnmarshallObject<T>(ByteView(data), processedData);
+    }
+
+    template <typename T>
+    static T UnmarshallObject(const std::vector<uint8_t> &data)
+    {
+        return UnmarshallObject<T>(ByteView(data));
     }
 };
 
 template <class T, std::enable_if_t<std::is_trivial_v<T>, bool> = true>
 struct MarshallableTrivialImpl : public Marshallable<T>
 {
+    template <class Tvec>
+    inline static void MarshallAppend(const T &obj, Tvec &result)
+    {
+        const std::size_t type_hash = std::type_index(typeid(T)).hash_code();
+        const std::size_t pos       = result.size();
+        result.resize(pos + sizeof(std::size_t) + sizeof(T));
+        memcpy(&result[pos], &type_hash, sizeof(std::size_t));
+        memcpy(&result[pos + sizeof(std::size_t)], &obj, sizeof(T));
+    }
+
     inline static const std::vector<uint8_t> MarshallImpl(const T &obj)
     {
-        const std::type_index type_info = typeid(T);
-        std::vector<uint8_t> result(sizeof(std::size_t) + sizeof(T), 0x00);
-        *(reinterpret_cast<std::size_t *>(result.data()))      = type_info.hash_code();
-        *(reinterpret_cast<T *>(&result[sizeof(std::size_t)])) = obj;
+        std::vector<uint8_t> result;
+        MarshallAppend(obj, result);
         return result;
     }
 
-    inline static T UnmarshallImpl(const std::vector<uint8_t> &marshalledData, std::size_t &processedData)
+    inline static T UnmarshallImpl(ByteView marshalledData, std::size_t &processedData)
     {
-        T result;
+        T result = {};
         if (std::type_index(typeid(T)).hash_code() == *reinterpret_cast<const std::size_t *>(marshalledData.data()))
         {
             result = *reinterpret_cast<const T*>(&marshalledData[sizeof(std::size_t)]);
@@ -97,16 +148,25 @@ ADD_IMPL(MarshallableTrivialImpl, uint8_t);
 template <class Tchar>
 struct MarshallableStringImpl : public Marshallable<std::basic_string<Tchar>>
 {
+    template <class Tvec>
+    inline static void MarshallAppend(const std::basic_string<Tchar> &obj, Tvec &result)
+    {
+        const std::size_t length    = obj.size();
+        const size_t      copy_size = obj.size() * sizeof(Tchar);
+        const std::size_t pos       = result.size();
+        result.resize(pos + sizeof(std::size_t) + copy_size);
+        memcpy(&result[pos], &length, sizeof(std::size_t));
+        memcpy(&result[pos + sizeof(std::size_t)], obj.data(), copy_size);
+    }
+
     inline static const std::vector<uint8_t> MarshallImpl(const std::basic_string<Tchar> &obj)
     {
-        const size_t copy_size = obj.size() * sizeof(Tchar);
-        std::vector<uint8_t> result(sizeof(std::size_t) + copy_size, 0x0);
-        *(reinterpret_cast<std::size_t *>(result.data())) = obj.size();
-        memcpy(&result[sizeof(std::size_t)], obj.data(), copy_size);
+        std::vector<uint8_t> result;
+        MarshallAppend(obj, result);
         return result;
     }
 
-    inline static std::basic_string<Tchar> UnmarshallImpl(const std::vector<uint8_t> &marshalledData, size_t &processedData)
+    inline static std::basic_string<Tchar> UnmarshallImpl(ByteView marshalledData, size_t &processedData)
     {
         const std::size_t unmarshall_size = *(reinterpret_cast<const std::size_t *>(marshalledData.data()));
         std::basic_string<Tchar> result(unmarshall_size, 0x00);
@@ -122,48 +182,51 @@ ADD_IMPL_SUB_ONE(MarshallableStringImpl, std::basic_string, wchar_t);
 template <class Tkey, class Tval>
 struct MarshallableMapImpl : public Marshallable<std::map<Tkey, Tval>>
 {
-    inline static const std::vector<uint8_t> MarshallImpl(const std::map<Tkey, Tval> &obj)
+    template <class Tvec>
+    inline static void MarshallAppend(const std::map<Tkey, Tval> &obj, Tvec &result)
     {
-        std::vector<uint8_t> result(sizeof(std::size_t), 0x00);
+        const std::size_t pos = result.size();
+        result.resize(pos + sizeof(std::size_t));
         for (const auto &[key, val] : obj)
         {
-            std::vector<uint8_t> temp_vector;
-            Marshall::MarshallObject(Marshallable<Tkey>(key), temp_vector);
-            result.insert(result.end(), std::make_move_iterator(temp_vector.begin()), std::make_move_iterator(temp_vector.end()));
-            Marshall::MarshallObject(Marshallable<Tval>(val), temp_vector);
-            result.insert(result.end(), std::make_move_iterator(temp_vector.begin()), std::make_move_iterator(temp_vector.end()));
+            Marshallable<Tkey>(key).MarshallTo(result);
+            Marshallable<Tval>(val).MarshallTo(result);
         }
-        *(reinterpret_cast<std::size_t *>(result.data())) = result.size() - sizeof(std::size_t);
+        const std::size_t map_size = result.size() - pos - sizeof(std::size_t);
+        memcpy(&result[pos], &map_size, sizeof(std::size_t));
+    }
+
+    inline static const std::vector<uint8_t> MarshallImpl(const std::map<Tkey, Tval> &obj)
+    {
+        std::vector<uint8_t> result;
+        MarshallAppend(obj, result);
         return result;
     }
 
-    inline static std::map<Tkey, Tval> UnmarshallImpl(const std::vector<uint8_t> &marshalledData, size_t &processedData)
+    inline static std::map<Tkey, Tval> UnmarshallImpl(ByteView marshalledData, size_t &processedData)
     {
         std::map<Tkey, Tval> result;
         std::size_t map_size = *reinterpret_cast<const size_t *>(marshalledData.data());
-        auto it_block_st  = std::next(marshalledData.begin(),sizeof(std::size_t)),
-             it_block_end = it_block_st;
-        std::advance(it_block_end, sizeof(std::size_t) + sizeof(Tkey));
+        // Sub views of input, entries are never copied out before unmarshalling.
+        std::size_t offset = sizeof(std::size_t);
         while (processedData != map_size)
         {
             size_t processed_size = 0;
-            Tkey key = Marshall::UnmarshallObject<Tkey>({ it_block_st, it_block_end }, processed_size);
+            Tkey key = Marshall::UnmarshallObject<Tkey>(marshalledData.subspan(offset, sizeof(std::size_t) + sizeof(Tkey)), processed_size);
             processedData += processed_size;
             if (processedData >= map_size)
             {
                 break;
             }
-            std::advance(it_block_st, processed_size);
-            std::advance(it_block_end, processed_size);
-            Tval value = Marshall::UnmarshallObject<Tval>({ it_block_st, marshalledData.end()}, processed_size);
-            result[key] = value;
+            offset += processed_size;
+            Tval value = Marshall::UnmarshallObject<Tval>(marshalledData.subspan(offset), processed_size);
+            result[key] = std::move(value);
             processedData += processed_size;
             if (processedData >= map_size)
             {
                 break;
             }
-            std::advance(it_block_st,  processed_size);
-            std::advance(it_block_end, processed_size);
+            offset += processed_size;
         }
         return result;
     }
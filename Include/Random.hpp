@@ -0,0 +1,230 @@
+#pragma once
+
+// User space CSPRNG, one instance per thread.
+// ChaCha20 keystream with fast key erasure (first block of every refill becomes next key),
+// seeded from kernel and reseeded after fork or every c_ReseedInterval bytes.
+// Filling caller buffer costs no syscall nor allocation in common case.
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+#include "Common.h"
+
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+#include <Windows.h>
+#include <bcrypt.h>
+#else
+#include <unistd.h>
+#include <pthread.h>
+#if defined PLATFORM_LINUX || defined PLATFORM_ANDROID
+#include <sys/random.h>
+#endif
+#endif
+
+namespace SecureRandom
+{
+    constexpr size_t   c_KeySize        = 32;
+    constexpr size_t   c_ChaChaBlock    = 64;
+    constexpr size_t   c_BufferBlocks   = 16;
+    constexpr uint64_t c_ReseedInterval = 16ULL * 1024 * 1024;
+
+    // Kernel source, one syscall per call (per 256 bytes at most on platforms with getentropy).
+    inline bool FillKernel(uint8_t *oData, size_t iLen)
+    {
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+        return BCryptGenRandom(nullptr, oData, static_cast<ULONG>(iLen), BCRYPT_USE_SYSTEM_PREFERRED_RNG) >= 0;
+#elif defined PLATFORM_LINUX || defined PLATFORM_ANDROID
+        while (iLen)
+        {
+            const ssize_t got = getrandom(oData, iLen, 0);
+            if (got < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            oData += got;
+            iLen  -= static_cast<size_t>(got);
+        }
+        return true;
+#else
+        while (iLen)
+        {
+            const size_t part = std::min<size_t>(iLen, 256);
+            if (getentropy(oData, part) != 0)
+            {
+                return false;
+            }
+            oData += part;
+            iLen  -= part;
+        }
+        return true;
+#endif
+    }
+
+    namespace Detail
+    {
+        inline uint32_t Rotl(uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+
+        inline void QuarterRound(uint32_t &a, uint32_t &b, uint32_t &c, uint32_t &d)
+        {
+            a += b; d ^= a; d = Rotl(d, 16);
+            c += d; b ^= c; b = Rotl(b, 12);
+            a += b; d ^= a; d = Rotl(d, 8);
+            c += d; b ^= c; b = Rotl(b, 7);
+        }
+
+        // RFC 8439 block function over prepared 16 word input.
+        inline void ChaChaBlock(const uint32_t input[16], uint8_t out[c_ChaChaBlock])
+        {
+            uint32_t x[16];
+            memcpy(x, input, sizeof(x));
+            for (size_t i = 0; i < 10; i++)
+            {
+                QuarterRound(x[0], x[4], x[8],  x[12]);
+                QuarterRound(x[1], x[5], x[9],  x[13]);
+                QuarterRound(x[2], x[6], x[10], x[14]);
+                QuarterRound(x[3], x[7], x[11], x[15]);
+                QuarterRound(x[0], x[5], x[10], x[15]);
+                QuarterRound(x[1], x[6], x[11], x[12]);
+                QuarterRound(x[2], x[7], x[8],  x[13]);
+                QuarterRound(x[3], x[4], x[9],  x[14]);
+            }
+            for (size_t i = 0; i < 16; i++)
+            {
+                const uint32_t v = x[i] + input[i];
+                out[i * 4]     = static_cast<uint8_t>(v);
+                out[i * 4 + 1] = static_cast<uint8_t>(v >> 8);
+                out[i * 4 + 2] = static_cast<uint8_t>(v >> 16);
+                out[i * 4 + 3] = static_cast<uint8_t>(v >> 24);
+            }
+        }
+
+        // Bumped in child after fork, every thread generator compares it against own copy.
+        inline std::atomic<uint32_t> g_ForkGeneration = 0;
+
+        inline void RegisterForkHandler()
+        {
+#if !defined PLATFORM_WIN32 && !defined PLATFORM_WIN64
+            static const bool registered = []()
+            {
+                return pthread_atfork(nullptr, nullptr, []() { g_ForkGeneration.fetch_add(1, std::memory_order_relaxed); }) == 0;
+            }();
+            (void)registered;
+#endif
+        }
+    }
+
+    class Generator
+    {
+    private:
+        std::array<uint32_t, 16>                          m_Input  = {};
+        std::array<uint8_t, c_ChaChaBlock * c_BufferBlocks> m_Buffer = {};
+        size_t                                            m_Available  = 0;
+        uint64_t                                          m_SinceSeed  = 0;
+        uint32_t                                          m_Generation = 0;
+        bool                                              m_Seeded     = false;
+
+        bool Reseed()
+        {
+            uint8_t seed[c_KeySize + 8] = {};
+            if (!FillKernel(seed, sizeof(seed)))
+            {
+                return false;
+            }
+            static constexpr uint32_t sigma[4] = { 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574 };  // "expand 32-byte k"
+            memcpy(m_Input.data(), sigma, sizeof(sigma));
+            memcpy(m_Input.data() + 4,  seed, c_KeySize);
+            m_Input[12] = 0;
+            m_Input[13] = 0;
+            memcpy(m_Input.data() + 14, seed + c_KeySize, 8);
+            memset(seed, 0x00, sizeof(seed));
+            m_Available  = 0;
+            m_SinceSeed  = 0;
+            m_Generation = Detail::g_ForkGeneration.load(std::memory_order_relaxed);
+            m_Seeded     = true;
+            return true;
+        }
+
+        void Refill()
+        {
+            for (size_t i = 0; i < c_BufferBlocks; i++)
+            {
+                Detail::ChaChaBlock(m_Input.data(), m_Buffer.data() + i * c_ChaChaBlock);
+                if (++m_Input[12] == 0)
+                {
+                    ++m_Input[13];
+                }
+            }
+            // Fast key erasure: state that produced handed out bytes is gone, even if generator leaks later.
+            memcpy(m_Input.data() + 4, m_Buffer.data(), c_KeySize);
+            memset(m_Buffer.data(), 0x00, c_KeySize);
+            m_Available = m_Buffer.size() - c_KeySize;
+        }
+
+    public:
+        Generator()
+        {
+            Detail::RegisterForkHandler();
+        }
+
+        ~Generator()
+        {
+            memset(m_Input.data(),  0x00, sizeof(m_Input));
+            memset(m_Buffer.data(), 0x00, m_Buffer.size());
+        }
+
+        Generator(const Generator &)            = delete;
+        Generator &operator=(const Generator &) = delete;
+
+        bool Fill(uint8_t *oData, size_t iLen)
+        {
+            if (!m_Seeded || m_SinceSeed >= c_ReseedInterval ||
+                m_Generation != Detail::g_ForkGeneration.load(std::memory_order_relaxed))
+            {
+                if (!Reseed())
+                {
+                    return false;
+                }
+            }
+            m_SinceSeed += iLen;
+            while (iLen)
+            {
+                if (!m_Available)
+                {
+                    Refill();
+                }
+                const size_t take = std::min(iLen, m_Available);
+                uint8_t *src = m_Buffer.data() + m_Buffer.size() - m_Available;
+                memcpy(oData, src, take);
+                // Handed out bytes never stay in memory.
+                memset(src, 0x00, take);
+                m_Available -= take;
+                oData       += take;
+                iLen        -= take;
+            }
+            return true;
+        }
+    };
+
+    inline Generator &ThreadGenerator()
+    {
+        thread_local Generator generator;
+        return generator;
+    }
+
+    inline bool Fill(MutableByteView oData)
+    {
+        return ThreadGenerator().Fill(oData.data(), oData.size());
+    }
+
+    inline bool FillKernel(MutableByteView oData)
+    {
+        return FillKernel(oData.data(), oData.size());
+    }
+}
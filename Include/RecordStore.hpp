@@ -0,0 +1,1195 @@
+#pragma once
+
+// Append-only encrypted key / value log, replaces "marshall whole map, encrypt, rewrite file" saves.
+// Record: header | AES-256-CTR payload (Marshall-ed key, then value) | body tag | chain tag.
+// Every record has random nonce, so records never share counter space under one key.
+// Body tag (HMAC of header & ciphertext) is computed by writer, chain tag is added by committer:
+// it covers previous chain tag, sequence number & body tag, so records can not be dropped, reordered
+// or moved between logs. Chain starts from random log id in file header.
+// Writers seal records on their own threads. Sealed records queue up while previous batch is written,
+// next committer takes the whole queue: one batch of writes & one fsync for any number of writers.
+// PutAsync leaves write & fsync to ThreadPool task, callback fires once record is durable.
+// Superseded records are dropped by compaction on ThreadPool, live records are copied still sealed.
+// Only batch that was being written at crash may be cut off on Open, corruption in front of
+// valid records fails Open instead of silently dropping acknowledged records.
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Common.h"
+#include "Allocators.hpp"
+#include "AsyncIO.hpp"
+#include "Cypher.h"
+#include "LogLib.h"
+#include "MappedFile.hpp"
+#include "Marshall.hpp"
+#include "Random.hpp"
+#include "Sha256.hpp"
+#include "ThreadWrap.hpp"
+
+#if !defined PLATFORM_WIN32 && !defined PLATFORM_WIN64
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+class RecordStore
+{
+public:
+    struct Options
+    {
+        ThreadPool *Pool            = ThreadPool::GLobalInstance();   // PutAsync commits, compaction, AES of big payloads.
+        size_t      MaxBatchBytes   = 4 * 1024 * 1024;                // Committer takes at most this much per fsync.
+        bool        Sync            = true;                           // fsync every batch, off - durability is left to OS,
+                                                                      // power loss may leave log that fails to open.
+        bool        AutoCompact     = true;
+        uint64_t    CompactMinBytes = 16 * 1024 * 1024;               // Smaller logs are never compacted automatically.
+        double      CompactRatio    = 0.5;                            // Share of superseded bytes that triggers compaction.
+    };
+
+    struct Stats
+    {
+        uint64_t Records     = 0;       // Appended since Open.
+        uint64_t Batches     = 0;
+        uint64_t Syncs       = 0;
+        uint64_t Compactions = 0;
+        uint64_t LiveBytes   = 0;       // Records still referenced by index.
+        uint64_t FileBytes   = 0;
+        size_t   Keys        = 0;
+    };
+
+private:
+    enum class RecordType : uint8_t
+    {
+        Put   = 1,
+        Erase = 2
+    };
+
+    // Sequence, BatchIndex & Flags are set by committer, body tag is computed with them zeroed.
+    struct RecordHeader
+    {
+        uint32_t Magic;
+        uint32_t PayloadSize;
+        uint64_t Nonce;
+        uint64_t Sequence;      // 1 for first record in log.
+        uint32_t BatchIndex;    // Records in front of this one in its commit batch.
+        uint8_t  Type;
+        uint8_t  Flags;
+        uint8_t  Reserved[2];
+    };
+    static_assert(sizeof(RecordHeader) == 32, "Record header is part of file format");
+
+    struct Location
+    {
+        uint64_t Offset;
+        uint64_t Sequence;
+        uint32_t Size;
+    };
+
+    struct Pending
+    {
+        std::pmr::vector<uint8_t>   Sealed;         // Whole record exactly as it goes to file.
+        std::string                 Key;
+        RecordType                  Type    = RecordType::Put;
+        std::function<void(bool)>   OnDurable;
+        bool                        Done    = false;
+        bool                        Result  = false;
+
+        Pending(std::pmr::memory_resource *resource) : Sealed(resource) {}
+    };
+    using PendingPtr = std::shared_ptr<Pending>;
+
+    static constexpr char     c_FileMagic[8]      = { 'B', 'S', 'R', 'E', 'C', 'L', 'G', '2' };
+    static constexpr size_t   c_KeyCheckSize      = 8;
+    static constexpr size_t   c_LogIdSize         = 8;
+    static constexpr size_t   c_FileHeaderSize    = sizeof(c_FileMagic) + c_KeyCheckSize + c_LogIdSize;
+    static constexpr uint32_t c_RecordMagic       = 0x32435242;                 // "BRC2"
+    static constexpr size_t   c_TagSize           = 16;                         // Truncated HMAC-SHA256, record has body & chain tag.
+    static constexpr uint8_t  c_BatchEnd          = 1;                          // Flags: last record of commit batch.
+    static constexpr size_t   c_MaxPayload        = 256UL * 1024 * 1024;
+    static constexpr size_t   c_ParallelCryptSize = 4UL * 1024 * 1024;          // Bigger payloads are encrypted over pool.
+    static constexpr size_t   c_CopyBufferSize    = 1024UL * 1024;
+
+    using Tag = std::array<uint8_t, c_TagSize>;
+
+    struct Chain
+    {
+        uint64_t Sequence = 0;  // Of last linked record.
+        Tag      Last     = {}; // Its chain tag, seed from file header before first record.
+    };
+
+    Options                                     m_Options;
+    std::filesystem::path                       m_Path;
+    AES                                         m_Cipher;
+    Sha256::Hmac                                m_Mac;
+    Sha256::Hmac                                m_ChainMac;
+    std::array<uint8_t, c_KeyCheckSize>         m_KeyCheck  = {};
+    AsyncIO::Engine                             m_IO        { nullptr };        // Completions run in place, committer drains.
+
+    std::mutex                                  m_QueueMutex;
+    std::condition_variable                     m_Durable;
+    std::deque<PendingPtr>                      m_Queue;
+    bool                                        m_CommitScheduled  = false;
+    bool                                        m_CompactScheduled = false;
+    size_t                                      m_Background       = 0;         // Pool tasks referencing this.
+
+    std::mutex                                  m_CommitMutex;                  // Owner appends to file, moves m_Tail.
+    std::mutex                                  m_CompactMutex;
+    mutable std::shared_mutex                   m_IndexMutex;                   // Index, file handle & tail.
+    AsyncIO::NativeFile                         m_File      = InvalidFile();
+    std::unordered_map<std::string, Location>   m_Index;
+    uint64_t                                    m_Tail      = 0;
+    uint64_t                                    m_LiveBytes = 0;
+    Chain                                       m_Chain;                        // Ends at m_Tail, moved by commit lock owner.
+
+    std::atomic<uint64_t>                       m_Records     = 0;
+    std::atomic<uint64_t>                       m_Batches     = 0;
+    std::atomic<uint64_t>                       m_Syncs       = 0;
+    std::atomic<uint64_t>                       m_Compactions = 0;
+
+    static AsyncIO::NativeFile InvalidFile(void)
+    {
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+        return INVALID_HANDLE_VALUE;
+#else
+        return -1;
+#endif
+    }
+
+    static AsyncIO::NativeFile OpenFile(const std::filesystem::path &path, bool truncate)
+    {
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+        // Share delete, so compaction may replace file while readers hold it.
+        return CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                           truncate ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+#else
+        int file = -1;
+        do
+        {
+            file = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | (truncate ? O_TRUNC : 0), 0600);
+        } while (file < 0 && errno == EINTR);
+        return file;
+#endif
+    }
+
+    static void CloseFile(AsyncIO::NativeFile file)
+    {
+        if (file == InvalidFile())
+        {
+            return;
+        }
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+        CloseHandle(file);
+#else
+        close(file);
+#endif
+    }
+
+    static bool FileSize(AsyncIO::NativeFile file, uint64_t &oSize)
+    {
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+        LARGE_INTEGER size = {};
+        if (!GetFileSizeEx(file, &size))
+        {
+            return false;
+        }
+        oSize = static_cast<uint64_t>(size.QuadPart);
+#else
+        struct stat info = {};
+        if (fstat(file, &info) != 0)
+        {
+            return false;
+        }
+        oSize = static_cast<uint64_t>(info.st_size);
+#endif
+        return true;
+    }
+
+    static bool SetFileSize(AsyncIO::NativeFile file, uint64_t size)
+    {
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+        LARGE_INTEGER position = {};
+        position.QuadPart = static_cast<LONGLONG>(size);
+        return SetFilePointerEx(file, position, nullptr, FILE_BEGIN) && SetEndOfFile(file);
+#else
+        return ftruncate(file, static_cast<off_t>(size)) == 0;
+#endif
+    }
+
+    static bool WriteAt(AsyncIO::NativeFile file, ByteView iData, uint64_t offset)
+    {
+        return AsyncIO::Detail::CompleteIO(AsyncIO::Request::Write(file, iData, offset, nullptr)) == static_cast<int64_t>(iData.size());
+    }
+
+    static bool ReadAt(AsyncIO::NativeFile file, MutableByteView oData, uint64_t offset)
+    {
+        return AsyncIO::Detail::CompleteIO(AsyncIO::Request::Read(file, oData, offset, nullptr)) == static_cast<int64_t>(oData.size());
+    }
+
+    static bool SyncFile(AsyncIO::NativeFile file)
+    {
+        return AsyncIO::Detail::CompleteIO(AsyncIO::Request::Fsync(file, nullptr)) == 0;
+    }
+
+    // Atomic rename over target; on POSIX directory is synced too, so rename itself survives crash.
+    static bool ReplaceFile(const std::filesystem::path &from, const std::filesystem::path &to)
+    {
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+        return MoveFileExW(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != FALSE;
+#else
+        if (rename(from.c_str(), to.c_str()) != 0)
+        {
+            return false;
+        }
+        const auto parent = to.has_parent_path() ? to.parent_path() : std::filesystem::path(".");
+        const int dir = open(parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir >= 0)
+        {
+            fsync(dir);
+            close(dir);
+        }
+        return true;
+#endif
+    }
+
+    static size_t RecordSize(size_t payloadSize) { return sizeof(RecordHeader) + payloadSize + 2 * c_TagSize; }
+
+    static bool EqualTag(const uint8_t *lhs, const uint8_t *rhs, size_t size)
+    {
+        uint8_t diff = 0;
+        for (size_t i = 0; i < size; i++)
+        {
+            diff |= lhs[i] ^ rhs[i];
+        }
+        return diff == 0;
+    }
+
+    bool DeriveKeys(ByteView secret)
+    {
+        const auto derive = [&secret](const char *label)
+        {
+            return Sha256::CalculateHmac(secret.data(), secret.size(), reinterpret_cast<const uint8_t*>(label), strlen(label));
+        };
+        const auto cipher_key = derive("BStash record cipher");
+        const auto cipher_iv  = derive("BStash record iv");
+        const auto mac_key    = derive("BStash record mac");
+        const auto chain_key  = derive("BStash record chain");
+        const auto check      = derive("BStash record check");
+        m_Mac.SetKey(mac_key.data(), mac_key.size());
+        m_ChainMac.SetKey(chain_key.data(), chain_key.size());
+        std::copy_n(check.begin(), m_KeyCheck.size(), m_KeyCheck.begin());
+        return m_Cipher.ImportKeys(std::vector<uint8_t>(cipher_key.begin(), cipher_key.end()),
+                                   std::vector<uint8_t>(cipher_iv.begin(), cipher_iv.begin() + 16));
+    }
+
+    // Serialize, encrypt & authenticate on calling thread. fill appends value to payload after key.
+    template <class Fill>
+    PendingPtr Seal(RecordType type, std::string_view key, const Fill &fill) const
+    {
+        auto pending = std::make_shared<Pending>(Memory::ThreadCachePool::Instance());
+        pending->Key.assign(key);
+        pending->Type = type;
+        auto &sealed = pending->Sealed;
+        sealed.resize(sizeof(RecordHeader));
+        Marshallable<std::string>(pending->Key).MarshallTo(sealed);
+        fill(sealed);
+        const size_t payload_size = sealed.size() - sizeof(RecordHeader);
+        if (payload_size > c_MaxPayload)
+        {
+            return nullptr;
+        }
+        RecordHeader header = {};
+        header.Magic       = c_RecordMagic;
+        header.PayloadSize = static_cast<uint32_t>(payload_size);
+        header.Type        = static_cast<uint8_t>(type);
+        if (!SecureRandom::Fill(MutableByteView(reinterpret_cast<uint8_t*>(&header.Nonce), sizeof(header.Nonce))))
+        {
+            return nullptr;
+        }
+        memcpy(sealed.data(), &header, sizeof(header));
+        ThreadPool *pool = payload_size >= c_ParallelCryptSize ? m_Options.Pool : nullptr;
+        if (!m_Cipher.EncryptInPlaceCTR(MutableByteView(sealed.data() + sizeof(header), payload_size), header.Nonce, pool))
+        {
+            return nullptr;
+        }
+        const auto tag = BodyTag(sealed.data());
+        sealed.insert(sealed.end(), tag.begin(), tag.end());
+        sealed.resize(sealed.size() + c_TagSize);
+        return pending;
+    }
+
+    static Tag Truncate(const Sha256::Digest &digest)
+    {
+        Tag tag;
+        std::copy_n(digest.begin(), tag.size(), tag.begin());
+        return tag;
+    }
+
+    // Header with position fields zeroed & ciphertext.
+    Tag BodyTag(const uint8_t *record) const
+    {
+        RecordHeader header;
+        memcpy(&header, record, sizeof(header));
+        header.Sequence   = 0;
+        header.BatchIndex = 0;
+        header.Flags      = 0;
+        Sha256::Hmac mac = m_Mac;
+        mac.Update(reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+        mac.Update(record + sizeof(header), header.PayloadSize);
+        return Truncate(mac.Final());
+    }
+
+    // Previous chain tag, whole header & body tag. tags points to body tag, chain tag follows it.
+    Tag ChainTag(const Tag &previous, const uint8_t *header, const uint8_t *tags) const
+    {
+        Sha256::Hmac mac = m_ChainMac;
+        mac.Update(previous.data(), previous.size());
+        mac.Update(header, sizeof(RecordHeader));
+        mac.Update(tags, c_TagSize);
+        return Truncate(mac.Final());
+    }
+
+    Tag ChainSeed(const uint8_t *fileHeader) const
+    {
+        Sha256::Hmac mac = m_ChainMac;
+        mac.Update(fileHeader, c_FileHeaderSize);
+        return Truncate(mac.Final());
+    }
+
+    // Stamps next position into sealed record & appends it to chain.
+    void Link(uint8_t *header, uint8_t *tags, Chain &chain, uint32_t batchIndex, bool batchEnd) const
+    {
+        RecordHeader fields;
+        memcpy(&fields, header, sizeof(fields));
+        fields.Sequence   = chain.Sequence + 1;
+        fields.BatchIndex = batchIndex;
+        fields.Flags      = batchEnd ? c_BatchEnd : 0;
+        memcpy(header, &fields, sizeof(fields));
+        chain.Sequence = fields.Sequence;
+        chain.Last     = ChainTag(chain.Last, header, tags);
+        memcpy(tags + c_TagSize, chain.Last.data(), c_TagSize);
+    }
+
+    // Framing & body tag of record at start of data. Returns record size, 0 if it is not valid record.
+    // Says nothing about record position, see Verify.
+    size_t VerifyBody(ByteView data, RecordHeader &oHeader) const
+    {
+        if (data.size() < RecordSize(0))
+        {
+            return 0;
+        }
+        memcpy(&oHeader, data.data(), sizeof(oHeader));
+        const bool known_type = oHeader.Type == static_cast<uint8_t>(RecordType::Put) || oHeader.Type == static_cast<uint8_t>(RecordType::Erase);
+        if (oHeader.Magic != c_RecordMagic || oHeader.PayloadSize > c_MaxPayload || !known_type)
+        {
+            return 0;
+        }
+        const size_t size = RecordSize(oHeader.PayloadSize);
+        if (size > data.size())
+        {
+            return 0;
+        }
+        const auto tag = BodyTag(data.data());
+        return EqualTag(tag.data(), data.data() + size - 2 * c_TagSize, c_TagSize) ? size : 0;
+    }
+
+    // Record must be next one in chain, chain moves past it.
+    size_t Verify(ByteView data, Chain &chain, RecordHeader &oHeader) const
+    {
+        const size_t size = VerifyBody(data, oHeader);
+        if (!size || oHeader.Sequence != chain.Sequence + 1)
+        {
+            return 0;
+        }
+        const uint8_t *tags = data.data() + size - 2 * c_TagSize;
+        const auto tag = ChainTag(chain.Last, data.data(), tags);
+        if (!EqualTag(tag.data(), tags + c_TagSize, c_TagSize))
+        {
+            return 0;
+        }
+        chain.Sequence = oHeader.Sequence;
+        chain.Last     = tag;
+        return size;
+    }
+
+    // Marshall-ed key size from decrypted payload prefix, false if key does not fit into payload.
+    static bool KeySpan(ByteView prefix, size_t payloadSize, size_t &oKeyBytes)
+    {
+        if (prefix.size() < sizeof(size_t) || payloadSize < sizeof(size_t))
+        {
+            return false;
+        }
+        size_t length = 0;
+        memcpy(&length, prefix.data(), sizeof(length));
+        if (length > payloadSize - sizeof(size_t))
+        {
+            return false;
+        }
+        oKeyBytes = sizeof(size_t) + length;
+        return true;
+    }
+
+    // Decrypts only key part of verified record, CTR lets payload prefix be decrypted alone.
+    bool ReadKey(ByteView record, const RecordHeader &header, std::vector<uint8_t> &scratch, std::string &oKey) const
+    {
+        const ByteView payload = record.subspan(sizeof(RecordHeader), header.PayloadSize);
+        scratch.assign(payload.begin(), payload.begin() + std::min(payload.size(), sizeof(size_t)));
+        size_t key_bytes = 0;
+        if (!m_Cipher.DecryptInPlaceCTR(MutableByteView(scratch), header.Nonce, nullptr) || !KeySpan(ByteView(scratch), payload.size(), key_bytes))
+        {
+            return false;
+        }
+        scratch.assign(payload.begin(), payload.begin() + key_bytes);
+        if (!m_Cipher.DecryptInPlaceCTR(MutableByteView(scratch), header.Nonce, nullptr))
+        {
+            return false;
+        }
+        oKey = Marshall::UnmarshallObject<std::string>(ByteView(scratch));
+        return true;
+    }
+
+    // Authenticates record & decrypts payload in place, value is view into record.
+    // Sequence from index pins record to its place in chain verified on Open.
+    bool Unseal(MutableByteView record, std::string_view key, uint64_t sequence, ByteView &oValue) const
+    {
+        RecordHeader header = {};
+        if (VerifyBody(record, header) != record.size() || header.Sequence != sequence || header.Type != static_cast<uint8_t>(RecordType::Put))
+        {
+            return false;
+        }
+        const MutableByteView payload = record.subspan(sizeof(RecordHeader), header.PayloadSize);
+        ThreadPool *pool = payload.size() >= c_ParallelCryptSize ? m_Options.Pool : nullptr;
+        size_t key_bytes = 0;
+        if (!m_Cipher.DecryptInPlaceCTR(payload, header.Nonce, pool) || !KeySpan(ByteView(payload), payload.size(), key_bytes))
+        {
+            return false;
+        }
+        size_t processed = 0;
+        if (Marshall::UnmarshallObject<std::string>(ByteView(payload), processed) != key)
+        {
+            return false;
+        }
+        oValue = ByteView(payload).subspan(processed);
+        return true;
+    }
+
+    // Caller holds m_IndexMutex exclusively.
+    void Apply(const std::string &key, RecordType type, uint64_t offset, uint32_t size, uint64_t sequence)
+    {
+        auto it = m_Index.find(key);
+        if (it != m_Index.end())
+        {
+            m_LiveBytes -= it->second.Size;
+        }
+        if (type == RecordType::Erase)
+        {
+            if (it != m_Index.end())
+            {
+                m_Index.erase(it);
+            }
+            return;
+        }
+        if (it == m_Index.end())
+        {
+            it = m_Index.emplace(key, Location{}).first;
+        }
+        it->second  = { offset, sequence, size };
+        m_LiveBytes += size;
+    }
+
+    // Batch is written with parallel writes, crash may leave any of its records on disk. Past last
+    // complete batch there may only be records of the one that follows it, anything authentic from
+    // later batch means log is damaged in front of acknowledged records.
+    bool IsTornBatch(ByteView data, uint64_t from, uint64_t lastSequence) const
+    {
+        size_t position = static_cast<size_t>(from);
+        while (position + RecordSize(0) <= data.size())
+        {
+            RecordHeader header = {};
+            const size_t size = memcmp(data.data() + position, &c_RecordMagic, sizeof(c_RecordMagic)) == 0 ? VerifyBody(data.subspan(position), header) : 0;
+            if (!size)
+            {
+                position++;
+                continue;
+            }
+            if (header.Sequence - header.BatchIndex != lastSequence + 1)
+            {
+                return false;
+            }
+            position += size;
+        }
+        return true;
+    }
+
+    // Scans log from header & rebuilds index from complete batches, cuts off batch torn by crash.
+    bool Recover(const Chain &seed, uint64_t fileSize)
+    {
+        struct Recovered
+        {
+            std::string Key;
+            RecordType  Type;
+            uint64_t    Offset;
+            uint64_t    Sequence;
+            uint32_t    Size;
+        };
+        uint64_t offset = c_FileHeaderSize;     // End of last complete batch.
+        Chain chain = seed;
+        std::unique_lock lock(m_IndexMutex);
+        if (fileSize > c_FileHeaderSize)
+        {
+            MappedFile mapped;
+            if (!mapped.Open(m_Path, MappedFile::Access::ReadOnly, 0, static_cast<size_t>(fileSize)))
+            {
+                return false;
+            }
+            mapped.Advise(MappedFile::Advice::Sequential);
+            const ByteView data = mapped.View();
+            std::vector<uint8_t> scratch;
+            std::vector<Recovered> batch;
+            Chain next = chain;
+            uint64_t position = offset;
+            while (position < data.size())
+            {
+                RecordHeader header = {};
+                Recovered record;
+                const size_t size = Verify(data.subspan(position), next, header);
+                if (!size || !ReadKey(data.subspan(position, size), header, scratch, record.Key))
+                {
+                    break;
+                }
+                record.Type     = static_cast<RecordType>(header.Type);
+                record.Offset   = position;
+                record.Sequence = header.Sequence;
+                record.Size     = static_cast<uint32_t>(size);
+                batch.push_back(std::move(record));
+                position += size;
+                if (header.Flags & c_BatchEnd)
+                {
+                    for (const auto &applied : batch)
+                    {
+                        Apply(applied.Key, applied.Type, applied.Offset, applied.Size, applied.Sequence);
+                    }
+                    batch.clear();
+                    offset = position;
+                    chain  = next;
+                }
+            }
+            if (offset < fileSize && !IsTornBatch(data, offset, chain.Sequence))
+            {
+                Log_ErrorF("Record log {}: damaged at offset {}, records past it can not be trusted.", m_Path.string(), position);
+                return false;
+            }
+        }
+        if (offset < fileSize)
+        {
+            Log_WarningF("Record log {}: dropping {} bytes of batch torn by crash.", m_Path.string(), fileSize - offset);
+            if (!SetFileSize(m_File, offset) || !SyncFile(m_File))
+            {
+                return false;
+            }
+        }
+        m_Tail  = offset;
+        m_Chain = chain;
+        return true;
+    }
+
+    bool WriteBatch(const std::vector<PendingPtr> &batch)
+    {
+        if (m_File == InvalidFile())
+        {
+            return false;
+        }
+        std::vector<AsyncIO::Request> requests;
+        requests.reserve(batch.size());
+        std::atomic<bool> written = true;
+        uint64_t offset = m_Tail;
+        Chain chain = m_Chain;
+        for (size_t idx = 0; idx < batch.size(); idx++)
+        {
+            auto &sealed = batch[idx]->Sealed;
+            Link(sealed.data(), sealed.data() + sealed.size() - 2 * c_TagSize, chain, static_cast<uint32_t>(idx), idx + 1 == batch.size());
+        }
+        for (const auto &pending : batch)
+        {
+            const int64_t size = static_cast<int64_t>(pending->Sealed.size());
+            requests.push_back(AsyncIO::Request::Write(m_File, ByteView(pending->Sealed.data(), pending->Sealed.size()), offset,
+                                                       [&written, size](int64_t result) { if (result != size) written = false; }));
+            offset += pending->Sealed.size();
+        }
+        bool result = m_IO.Submit(requests);
+        m_IO.Drain();
+        if (result && written && m_Options.Sync)
+        {
+            result = m_IO.Submit(AsyncIO::Request::Fsync(m_File, [&written](int64_t synced) { if (synced < 0) written = false; }));
+            m_IO.Drain();
+            m_Syncs++;
+        }
+        if (!result || !written)
+        {
+            // Partial batch must not stay in front of next one, Open would stop at it.
+            SetFileSize(m_File, m_Tail);
+            Log_ErrorF("Record log {}: batch of {} records was not written.", m_Path.string(), batch.size());
+            return false;
+        }
+        std::unique_lock lock(m_IndexMutex);
+        offset = m_Tail;
+        for (size_t idx = 0; idx < batch.size(); idx++)
+        {
+            const auto &pending = batch[idx];
+            Apply(pending->Key, pending->Type, offset, static_cast<uint32_t>(pending->Sealed.size()), m_Chain.Sequence + idx + 1);
+            offset += pending->Sealed.size();
+        }
+        m_Tail  = offset;
+        m_Chain = chain;
+        m_Records += batch.size();
+        m_Batches++;
+        return true;
+    }
+
+    // Writes & syncs one batch taken from queue. Caller owns m_CommitMutex.
+    void CommitRound()
+    {
+        std::vector<PendingPtr> batch;
+        {
+            std::lock_guard lock(m_QueueMutex);
+            size_t bytes = 0;
+            while (!m_Queue.empty() && (batch.empty() || bytes + m_Queue.front()->Sealed.size() <= m_Options.MaxBatchBytes))
+            {
+                bytes += m_Queue.front()->Sealed.size();
+                batch.push_back(std::move(m_Queue.front()));
+                m_Queue.pop_front();
+            }
+        }
+        if (batch.empty())
+        {
+            return;
+        }
+        const bool result = WriteBatch(batch);
+        {
+            std::lock_guard lock(m_QueueMutex);
+            for (auto &pending : batch)
+            {
+                pending->Done   = true;
+                pending->Result = result;
+            }
+        }
+        m_Durable.notify_all();
+        for (auto &pending : batch)
+        {
+            if (pending->OnDurable)
+            {
+                pending->OnDurable(result);
+            }
+        }
+        ScheduleCompaction();
+    }
+
+    // Commit lock owner notifies after unlock, so waiters that saw it taken retry as leaders.
+    void ReleaseCommit(std::unique_lock<std::mutex> &commit)
+    {
+        commit.unlock();
+        { std::lock_guard lock(m_QueueMutex); }
+        m_Durable.notify_all();
+    }
+
+    // Last thing pool task does: Close may destroy store as soon as queue lock is released.
+    void BackgroundDone()
+    {
+        std::lock_guard lock(m_QueueMutex);
+        m_Background--;
+        m_Durable.notify_all();
+    }
+
+    // Leader / follower group commit: whoever gets commit lock writes everything queued so far,
+    // others wait for it and take the next round if their record was queued too late.
+    bool WaitDurable(const PendingPtr &pending)
+    {
+        std::unique_lock lock(m_QueueMutex);
+        while (!pending->Done)
+        {
+            std::unique_lock commit(m_CommitMutex, std::try_to_lock);
+            if (!commit.owns_lock())
+            {
+                m_Durable.wait(lock);
+                continue;
+            }
+            lock.unlock();
+            CommitRound();
+            ReleaseCommit(commit);
+            lock.lock();
+        }
+        return pending->Result;
+    }
+
+    void Enqueue(const PendingPtr &pending)
+    {
+        std::lock_guard lock(m_QueueMutex);
+        m_Queue.push_back(pending);
+    }
+
+    // Pool task commits until queue is empty. Emptiness check & flag reset share one lock,
+    // so record queued after the last round always finds flag cleared and schedules new task.
+    void ScheduleCommit()
+    {
+        {
+            std::lock_guard lock(m_QueueMutex);
+            if (m_CommitScheduled)
+            {
+                return;
+            }
+            m_CommitScheduled = true;
+            m_Background++;
+        }
+        m_Options.Pool->AddDetachedTask("RecordStore commit", std::function<void()>([this]()
+        {
+            std::unique_lock commit(m_CommitMutex);
+            while (true)
+            {
+                {
+                    std::lock_guard lock(m_QueueMutex);
+                    if (m_Queue.empty())
+                    {
+                        m_CommitScheduled = false;
+                        break;
+                    }
+                }
+                CommitRound();
+            }
+            commit.unlock();
+            BackgroundDone();
+        }));
+    }
+
+    bool Commit(const PendingPtr &pending)
+    {
+        if (!pending)
+        {
+            return false;
+        }
+        Enqueue(pending);
+        return WaitDurable(pending);
+    }
+
+    void ScheduleCompaction()
+    {
+        if (!m_Options.AutoCompact || !m_Options.Pool)
+        {
+            return;
+        }
+        {
+            std::shared_lock lock(m_IndexMutex);
+            const uint64_t dead = m_Tail - c_FileHeaderSize - m_LiveBytes;
+            if (m_Tail < m_Options.CompactMinBytes || dead < m_Tail * m_Options.CompactRatio)
+            {
+                return;
+            }
+        }
+        {
+            std::lock_guard lock(m_QueueMutex);
+            if (m_CompactScheduled)
+            {
+                return;
+            }
+            m_CompactScheduled = true;
+            m_Background++;
+        }
+        m_Options.Pool->AddDetachedTask("RecordStore compaction", std::function<void()>([this]()
+        {
+            Compact();
+            {
+                std::lock_guard lock(m_QueueMutex);
+                m_CompactScheduled = false;
+            }
+            BackgroundDone();
+        }));
+    }
+
+    // Appends [from, to) of current log to out at outOffset as is.
+    bool CopyRange(AsyncIO::NativeFile out, uint64_t &outOffset, uint64_t from, uint64_t to, std::vector<uint8_t> &buffer)
+    {
+        while (from < to)
+        {
+            const size_t part = static_cast<size_t>(std::min<uint64_t>(buffer.size(), to - from));
+            if (!ReadAt(m_File, MutableByteView(buffer.data(), part), from) || !WriteAt(out, ByteView(buffer.data(), part), outOffset))
+            {
+                return false;
+            }
+            from      += part;
+            outOffset += part;
+        }
+        return true;
+    }
+
+    // Appends records [from, to) of current log to out, still sealed but linked into out chain.
+    // Out file is synced as whole before it replaces log, so every record is batch of its own.
+    bool CopyRecords(AsyncIO::NativeFile out, uint64_t &outOffset, uint64_t from, uint64_t to, Chain &chain, std::vector<uint8_t> &buffer)
+    {
+        while (from < to)
+        {
+            const size_t part = static_cast<size_t>(std::min<uint64_t>(buffer.size(), to - from));
+            if (part < sizeof(RecordHeader) || !ReadAt(m_File, MutableByteView(buffer.data(), part), from))
+            {
+                return false;
+            }
+            size_t done = 0;
+            RecordHeader header = {};
+            while (part - done >= sizeof(header))
+            {
+                memcpy(&header, buffer.data() + done, sizeof(header));
+                const size_t size = RecordSize(header.PayloadSize);
+                if (header.Magic != c_RecordMagic || header.PayloadSize > c_MaxPayload || from + done + size > to)
+                {
+                    return false;
+                }
+                if (done + size > part)
+                {
+                    break;
+                }
+                Link(buffer.data() + done, buffer.data() + done + size - 2 * c_TagSize, chain, 0, true);
+                done += size;
+            }
+            if (done)
+            {
+                if (!WriteAt(out, ByteView(buffer.data(), done), outOffset))
+                {
+                    return false;
+                }
+                from      += done;
+                outOffset += done;
+                continue;
+            }
+            // Record bigger than buffer is copied as is, then its position fields & chain tag are rewritten.
+            uint8_t head[sizeof(RecordHeader)];
+            uint8_t tags[2 * c_TagSize];
+            memcpy(head, buffer.data(), sizeof(head));
+            const uint64_t size   = RecordSize(header.PayloadSize);
+            const uint64_t record = outOffset;
+            if (!ReadAt(m_File, MutableByteView(tags, sizeof(tags)), from + size - sizeof(tags)) || !CopyRange(out, outOffset, from, from + size, buffer))
+            {
+                return false;
+            }
+            Link(head, tags, chain, 0, true);
+            if (!WriteAt(out, ByteView(head, sizeof(head)), record) || !WriteAt(out, ByteView(tags, sizeof(tags)), record + size - sizeof(tags)))
+            {
+                return false;
+            }
+            from += size;
+        }
+        return true;
+    }
+
+    // Every file gets new log id, its chain starts from seed over whole header.
+    bool WriteFileHeader(AsyncIO::NativeFile file, Chain &oChain)
+    {
+        uint8_t header[c_FileHeaderSize];
+        memcpy(header, c_FileMagic, sizeof(c_FileMagic));
+        memcpy(header + sizeof(c_FileMagic), m_KeyCheck.data(), m_KeyCheck.size());
+        if (!SecureRandom::Fill(MutableByteView(header + sizeof(c_FileMagic) + c_KeyCheckSize, c_LogIdSize)))
+        {
+            return false;
+        }
+        oChain = { 0, ChainSeed(header) };
+        return WriteAt(file, ByteView(header, sizeof(header)), 0);
+    }
+
+public:
+    RecordStore() = default;
+    RecordStore(const Options &options) : m_Options(options) {}
+
+    RecordStore(const RecordStore&)            = delete;
+    RecordStore &operator=(const RecordStore&) = delete;
+
+    ~RecordStore() { Close(); }
+
+    // Opens or creates log. secret is any length key material, cipher & MAC keys are derived from it.
+    // Fails on file sealed with different secret instead of treating every record as corrupted.
+    bool Open(const std::filesystem::path &path, ByteView secret)
+    {
+        Close();
+        if (!DeriveKeys(secret))
+        {
+            return false;
+        }
+        m_Path = path;
+        m_File = OpenFile(path, false);
+        uint64_t size = 0;
+        if (m_File == InvalidFile() || !FileSize(m_File, size))
+        {
+            Close();
+            return false;
+        }
+        Chain seed;
+        if (size < c_FileHeaderSize)
+        {
+            // New log, or crash before header reached disk.
+            if (!SetFileSize(m_File, 0) || !WriteFileHeader(m_File, seed) || !SyncFile(m_File))
+            {
+                Close();
+                return false;
+            }
+            size = c_FileHeaderSize;
+        }
+        else
+        {
+            uint8_t header[c_FileHeaderSize];
+            if (!ReadAt(m_File, MutableByteView(header, sizeof(header)), 0) || memcmp(header, c_FileMagic, sizeof(c_FileMagic)) != 0 ||
+                !EqualTag(header + sizeof(c_FileMagic), m_KeyCheck.data(), m_KeyCheck.size()))
+            {
+                Log_ErrorF("Record log {}: not a record log or sealed with another key.", path.string());
+                Close();
+                return false;
+            }
+            seed = { 0, ChainSeed(header) };
+        }
+        if (!Recover(seed, size))
+        {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    // Waits for queued commits & background compaction, then closes file.
+    void Close()
+    {
+        {
+            std::unique_lock lock(m_QueueMutex);
+            m_Durable.wait(lock, [this]() { return m_Background == 0; });
+        }
+        std::lock_guard compacting(m_CompactMutex);
+        std::unique_lock lock(m_IndexMutex);
+        CloseFile(m_File);
+        m_File      = InvalidFile();
+        m_Tail      = 0;
+        m_LiveBytes = 0;
+        m_Chain     = {};
+        m_Index.clear();
+    }
+
+    bool IsOpen() const
+    {
+        std::shared_lock lock(m_IndexMutex);
+        return m_File != InvalidFile();
+    }
+
+    // Returns once record is durable (or written, without Sync). Safe to call from many threads at once.
+    bool Put(std::string_view key, ByteView value)
+    {
+        return Commit(Seal(RecordType::Put, key, [&value](std::pmr::vector<uint8_t> &payload) { payload.insert(payload.end(), value.begin(), value.end()); }));
+    }
+
+    // Value is marshalled straight into record buffer, no intermediate copy.
+    template <class T>
+    bool PutObject(std::string_view key, const T &object)
+    {
+        return Commit(Seal(RecordType::Put, key, [&object](std::pmr::vector<uint8_t> &payload) { Marshallable<T>(object).MarshallTo(payload); }));
+    }
+
+    bool Erase(std::string_view key)
+    {
+        return Commit(Seal(RecordType::Erase, key, [](std::pmr::vector<uint8_t> &) {}));
+    }
+
+    // Seals on calling thread and returns, write & fsync happen on pool. onDurable gets commit result.
+    // False only if record could not be sealed, onDurable is not called then.
+    bool PutAsync(std::string_view key, ByteView value, std::function<void(bool)> onDurable)
+    {
+        auto pending = Seal(RecordType::Put, key, [&value](std::pmr::vector<uint8_t> &payload) { payload.insert(payload.end(), value.begin(), value.end()); });
+        if (!pending)
+        {
+            return false;
+        }
+        pending->OnDurable = std::move(onDurable);
+        Enqueue(pending);
+        if (m_Options.Pool)
+        {
+            ScheduleCommit();
+        }
+        else
+        {
+            WaitDurable(pending);
+        }
+        return true;
+    }
+
+    bool Get(std::string_view key, std::vector<uint8_t> &oValue) const
+    {
+        std::vector<uint8_t> record;
+        uint64_t sequence = 0;
+        {
+            std::shared_lock lock(m_IndexMutex);
+            const auto it = m_Index.find(std::string(key));
+            if (it == m_Index.end())
+            {
+                return false;
+            }
+            record.resize(it->second.Size);
+            sequence = it->second.Sequence;
+            if (!ReadAt(m_File, MutableByteView(record), it->second.Offset))
+            {
+                return false;
+            }
+        }
+        ByteView value;
+        if (!Unseal(MutableByteView(record), key, sequence, value))
+        {
+            return false;
+        }
+        oValue.assign(value.begin(), value.end());
+        return true;
+    }
+
+    template <class T>
+    bool GetObject(std::string_view key, T &oObject) const
+    {
+        std::vector<uint8_t> value;
+        if (!Get(key, value))
+        {
+            return false;
+        }
+        oObject = Marshall::UnmarshallObject<T>(ByteView(value));
+        return true;
+    }
+
+    bool Contains(std::string_view key) const
+    {
+        std::shared_lock lock(m_IndexMutex);
+        return m_Index.find(std::string(key)) != m_Index.end();
+    }
+
+    std::vector<std::string> Keys() const
+    {
+        std::shared_lock lock(m_IndexMutex);
+        std::vector<std::string> result;
+        result.reserve(m_Index.size());
+        for (const auto &[key, location] : m_Index)
+        {
+            result.push_back(key);
+        }
+        return result;
+    }
+
+    // Rewrites log with live records only. Bulk of copying runs next to writers,
+    // they are held only while records appended meanwhile are copied & files are swapped.
+    bool Compact()
+    {
+        std::lock_guard compacting(m_CompactMutex);
+        std::vector<Location> live;
+        uint64_t snapshot_end      = 0;
+        uint64_t snapshot_sequence = 0;
+        {
+            std::shared_lock lock(m_IndexMutex);
+            if (m_File == InvalidFile())
+            {
+                return false;
+            }
+            live.reserve(m_Index.size());
+            for (const auto &[key, location] : m_Index)
+            {
+                live.push_back(location);
+            }
+            snapshot_end      = m_Tail;
+            snapshot_sequence = m_Chain.Sequence;
+        }
+        std::sort(live.begin(), live.end(), [](const Location &lhs, const Location &rhs) { return lhs.Offset < rhs.Offset; });
+
+        auto temp_path = m_Path;
+        temp_path += ".compact";
+        AsyncIO::NativeFile out = OpenFile(temp_path, true);
+        if (out == InvalidFile())
+        {
+            return false;
+        }
+        bool swapped = false;
+        MakeScopeGuard([&]()
+        {
+            if (!swapped)
+            {
+                CloseFile(out);
+                std::error_code error;
+                std::filesystem::remove(temp_path, error);
+            }
+        });
+        Chain chain;
+        if (!WriteFileHeader(out, chain))
+        {
+            return false;
+        }
+        // Adjacent live records are copied with one read & write, live[i] gets sequence i + 1.
+        std::vector<uint8_t> buffer(c_CopyBufferSize);
+        std::vector<uint64_t> moved(live.size());
+        uint64_t out_offset = c_FileHeaderSize;
+        for (size_t first = 0; first < live.size();)
+        {
+            size_t last = first;
+            moved[first] = out_offset;
+            uint64_t end = live[first].Offset + live[first].Size;
+            while (last + 1 < live.size() && live[last + 1].Offset == end)
+            {
+                last++;
+                moved[last] = moved[first] + (live[last].Offset - live[first].Offset);
+                end += live[last].Size;
+            }
+            if (!CopyRecords(out, out_offset, live[first].Offset, end, chain, buffer))
+            {
+                return false;
+            }
+            first = last + 1;
+        }
+
+        std::unique_lock commit(m_CommitMutex);
+        MakeScopeGuard([&]() { ReleaseCommit(commit); });
+        const uint64_t tail_start = out_offset;
+        if (!CopyRecords(out, out_offset, snapshot_end, m_Tail, chain, buffer) || !SyncFile(out) || !ReplaceFile(temp_path, m_Path))
+        {
+            return false;
+        }
+        std::unique_lock lock(m_IndexMutex);
+        for (auto &[key, location] : m_Index)
+        {
+            if (location.Offset >= snapshot_end)
+            {
+                location.Offset   = location.Offset - snapshot_end + tail_start;
+                location.Sequence = location.Sequence - snapshot_sequence + live.size();
+                continue;
+            }
+            const auto it = std::lower_bound(live.begin(), live.end(), location.Offset, [](const Location &lhs, uint64_t offset) { return lhs.Offset < offset; });
+            location.Offset   = moved[static_cast<size_t>(it - live.begin())];
+            location.Sequence = static_cast<uint64_t>(it - live.begin()) + 1;
+        }
+        Log_InfoF("Record log {} compacted: {} -> {} bytes.", m_Path.string(), m_Tail, out_offset);
+        CloseFile(m_File);
+        m_File  = out;
+        m_Tail  = out_offset;
+        m_Chain = chain;
+        swapped = true;
+        m_Compactions++;
+        return true;
+    }
+
+    Stats GetStats() const
+    {
+        Stats stats;
+        stats.Records     = m_Records;
+        stats.Batches     = m_Batches;
+        stats.Syncs       = m_Syncs;
+        stats.Compactions = m_Compactions;
+        std::shared_lock lock(m_IndexMutex);
+        stats.LiveBytes   = m_LiveBytes;
+        stats.FileBytes   = m_Tail;
+        stats.Keys        = m_Index.size();
+        return stats;
+    }
+};
@@ -0,0 +1,865 @@
+#pragma once
+
+// Portable RSA backend, same interface as CNG based RSA from Cypher.h.
+// Montgomery arithmetic from BigNum.hpp, private key operations go through CRT with
+// constant time exponentiation, base blinding and check of result with public exponent.
+// Padding: off - zeroed (raw), on - OAEP with SHA-256.
+// Keys are imported / exported as ASN.1 PKCS#1 (DER / BER / PEM).
+
+#include <array>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+
+#include "Common.h"
+#include "BigNum.hpp"
+#include "Base64.hpp"
+#include "Random.hpp"
+#include "Sha256.hpp"
+#include "ThreadWrap.hpp"
+
+class LIB_EXPORT PortableRSA
+{
+public:
+    enum KeyTypeFlags : uint8_t
+    {
+        KeyType_Undefined =  0,
+        KeyType_Public    =  1,
+        KeyType_Full      =  2,
+        KeyType_BER       =  4,
+        KeyType_DER       =  8,
+        KeyType_PEM       =  16
+    };
+    using KeyType = FlagWrap<KeyTypeFlags>;
+
+private:
+    using Limbs = BigNum::Limbs;
+
+    static constexpr char     c_PemAddition[]   = "-----";
+    static constexpr char     c_PemBegin[]      = "BEGIN";
+    static constexpr char     c_PemEnd[]        = "END";
+
+    static constexpr char     c_PublicKeyId[]   = "RSA PUBLIC KEY";
+    static constexpr char     c_PrivateKeyId[]  = "RSA PRIVATE KEY";
+
+    static constexpr size_t   c_PemLineSize     = 64;
+    static constexpr BigNum::Limb c_PublicExponent = 65537;
+    static constexpr uint32_t c_BlindingRefresh = 32;                  // Uses of one blinding pair before new random r
+
+    // DigestInfo prefix of SHA-256 for PKCS#1 v1.5 signatures.
+    static constexpr uint8_t  c_Sha256DigestInfo[] = { 0x30, 0x31, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01,
+                                                       0x65, 0x03, 0x04, 0x02, 0x01, 0x05, 0x00, 0x04, 0x20 };
+
+    static constexpr bool ValidKeyType(const KeyType &flags)
+    {
+        // Exactly one of Public / Full, PEM can`t be mixed with DER / BER. No encoding flag means DER.
+        const bool is_public = flags & KeyType_Public, is_full = flags & KeyType_Full;
+        const bool is_pem    = flags & KeyType_PEM,    is_der  = (flags & KeyType_DER) || (flags & KeyType_BER);
+        return (is_public != is_full) && !(is_pem && is_der);
+    }
+
+    Limbs               m_N, m_E, m_D, m_P, m_Q, m_DP, m_DQ, m_QInv;
+    Limbs               m_QInvMont;                                     // q ^ -1 * R mod p
+    BigNum::Montgomery  m_MontN, m_MontP, m_MontQ;
+    size_t              m_ModulusSize     = 0;                          // Bytes
+    KeyType             m_Keytype         = KeyType_Undefined;
+    bool                m_ExplicitPadding = false;
+
+    // r ^ e and r ^ -1 mod n in Montgomery form, squared after every use.
+    mutable std::mutex  m_BlindingMutex;
+    mutable Limbs       m_Blind, m_Unblind;
+    mutable uint32_t    m_BlindingUses    = 0;
+
+    // ASN.1 DER helpers.
+    static void         DerAppendLength(std::vector<uint8_t> &oData, size_t len);
+    static void         DerAppendInteger(std::vector<uint8_t> &oData, const Limbs &value);
+    static bool         DerReadHeader(const std::vector<uint8_t> &iData, size_t &pos, uint8_t tag, size_t &len);
+    static bool         DerReadInteger(const std::vector<uint8_t> &iData, size_t &pos, Limbs &value);
+
+    bool                PEM_Encode(KeyType type, std::vector<uint8_t> &data) const;
+    bool                PEM_Decode(KeyType type, std::vector<uint8_t> &data) const;
+
+    static Limbs        GeneratePrime(size_t bits);
+    static bool         IsProbablePrime(const Limbs &candidate, size_t rounds);
+    static Limbs        InverseSmall(const Limbs &modulus, BigNum::Limb e);
+    bool                SetupKey(bool isPrivate);
+
+    Limbs               CrtCombine(const Limbs &m1, const Limbs &m2) const;
+    bool                NewBlinding(Limbs &blind, Limbs &unblind) const;
+    bool                NextBlinding(Limbs &blind, Limbs &unblind) const;
+    bool                PublicOp(const Limbs &input, Limbs &output) const;
+    bool                PrivateOp(const Limbs &input, Limbs &output) const;
+
+    static void         MGF1(const uint8_t *seed, size_t seedLen, uint8_t *mask, size_t maskLen);
+    bool                OAEP_Encode(const std::vector<uint8_t> &message, std::vector<uint8_t> &encoded) const;
+    bool                OAEP_Decode(const std::vector<uint8_t> &encoded, std::vector<uint8_t> &message) const;
+    bool                SignatureBlock(const std::vector<uint8_t> &message, std::vector<uint8_t> &block) const;
+
+    template <typename Op>
+    static bool         RunBatch(size_t count, ThreadPool *pool, const Op &op);
+
+public:
+                        PortableRSA(bool usePadding = false) : m_ExplicitPadding(usePadding) {}
+                        PortableRSA(const PortableRSA&)        = delete;
+                        PortableRSA(const PortableRSA&&)       = delete;
+              auto     &operator=(const PortableRSA&)  = delete;
+              auto     &operator=(const PortableRSA&&) = delete;
+                        ~PortableRSA() { ReleaseKeyPair(); }
+
+    bool                GenerateKeyPair(uint16_t keySize);
+    bool                ImportKeyInfo(KeyType type, const std::vector<uint8_t> &keyData);
+    bool                ExportKeyInfo(KeyType type, std::vector<uint8_t> &keyData);
+    bool                Encrypt(const std::vector<uint8_t> &iString, std::vector<uint8_t> &oString) const;
+    bool                Decrypt(const std::vector<uint8_t> &iString, std::vector<uint8_t> &oString) const;
+    // PKCS#1 v1.5 signature over SHA-256 of message.
+    bool                Sign(const std::vector<uint8_t> &iMessage, std::vector<uint8_t> &oSignature) const;
+    bool                Verify(const std::vector<uint8_t> &iMessage, const std::vector<uint8_t> &iSignature) const;
+
+    // Batch versions spread messages over pool workers. Result is false if any single operation failed,
+    // VerifyBatch reports each signature in oResults (1 - valid).
+    bool                EncryptBatch(const std::vector<std::vector<uint8_t>> &iData, std::vector<std::vector<uint8_t>> &oData, ThreadPool *pool = ThreadPool::GLobalInstance()) const;
+    bool                DecryptBatch(const std::vector<std::vector<uint8_t>> &iData, std::vector<std::vector<uint8_t>> &oData, ThreadPool *pool = ThreadPool::GLobalInstance()) const;
+    bool                SignBatch(const std::vector<std::vector<uint8_t>> &iMessages, std::vector<std::vector<uint8_t>> &oSignatures, ThreadPool *pool = ThreadPool::GLobalInstance()) const;
+    bool                VerifyBatch(const std::vector<std::vector<uint8_t>> &iMessages, const std::vector<std::vector<uint8_t>> &iSignatures,
+                                    std::vector<uint8_t> &oResults, ThreadPool *pool = ThreadPool::GLobalInstance()) const;
+    void                ReleaseKeyPair();
+};
+
+inline void PortableRSA::DerAppendLength(std::vector<uint8_t> &oData, size_t len)
+{
+    if (len < 0x80)
+    {
+        oData.push_back(static_cast<uint8_t>(len));
+        return;
+    }
+    uint8_t bytes[sizeof(size_t)] = {};
+    size_t  count = 0;
+    for (; len; len >>= 8)
+    {
+        bytes[count++] = static_cast<uint8_t>(len);
+    }
+    oData.push_back(static_cast<uint8_t>(0x80 | count));
+    while (count)
+    {
+        oData.push_back(bytes[--count]);
+    }
+}
+
+inline void PortableRSA::DerAppendInteger(std::vector<uint8_t> &oData, const Limbs &value)
+{
+    std::vector<uint8_t> bytes = BigNum::ToBytes(value);
+    // Positive INTEGER: keep sign bit clear, zero is single 0x00.
+    if (bytes.empty() || (bytes[0] & 0x80))
+    {
+        bytes.insert(bytes.begin(), 0x00);
+    }
+    oData.push_back(0x02);
+    DerAppendLength(oData, bytes.size());
+    oData.insert(oData.end(), bytes.begin(), bytes.end());
+}
+
+inline bool PortableRSA::DerReadHeader(const std::vector<uint8_t> &iData, size_t &pos, uint8_t tag, size_t &len)
+{
+    if (pos + 2 > iData.size() || iData[pos] != tag)
+    {
+        return false;
+    }
+    pos++;
+    len = iData[pos++];
+    if (len & 0x80)
+    {
+        const size_t count = len & 0x7F;
+        if (!count || count > sizeof(size_t) || pos + count > iData.size())
+        {
+            return false;
+        }
+        len = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            len = (len << 8) | iData[pos++];
+        }
+    }
+    return len <= iData.size() - pos;
+}
+
+inline bool PortableRSA::DerReadInteger(const std::vector<uint8_t> &iData, size_t &pos, Limbs &value)
+{
+    size_t len = 0;
+    if (!DerReadHeader(iData, pos, 0x02, len) || !len || (iData[pos] & 0x80))
+    {
+        return false;
+    }
+    value = BigNum::FromBytes(ByteView(iData.data() + pos, len));
+    BigNum::Trim(value);
+    pos += len;
+    return true;
+}
+
+inline bool PortableRSA::PEM_Encode(KeyType type, std::vector<uint8_t> &data) const
+{
+    const std::string key_id = (type & KeyType_Full) ? c_PrivateKeyId : c_PublicKeyId;
+    const std::string body   = Base64::Encode(data);
+    std::string pem = std::string(c_PemAddition) + c_PemBegin + " " + key_id + c_PemAddition + "\n";
+    for (size_t offset = 0; offset < body.size(); offset += c_PemLineSize)
+    {
+        pem += body.substr(offset, c_PemLineSize) + "\n";
+    }
+    pem += std::string(c_PemAddition) + c_PemEnd + " " + key_id + c_PemAddition + "\n";
+    data.assign(pem.begin(), pem.end());
+    return true;
+}
+
+inline bool PortableRSA::PEM_Decode(KeyType type, std::vector<uint8_t> &data) const
+{
+    const std::string key_id = (type & KeyType_Full) ? c_PrivateKeyId : c_PublicKeyId;
+    const std::string begin  = std::string(c_PemAddition) + c_PemBegin + " " + key_id + c_PemAddition;
+    const std::string end    = std::string(c_PemAddition) + c_PemEnd + " " + key_id + c_PemAddition;
+    const std::string pem(data.begin(), data.end());
+    const size_t begin_pos = pem.find(begin);
+    const size_t end_pos   = pem.find(end);
+    if (begin_pos == std::string::npos || end_pos == std::string::npos || end_pos < begin_pos)
+    {
+        return false;
+    }
+    std::string body;
+    for (size_t i = begin_pos + begin.size(); i < end_pos; i++)
+    {
+        if (pem[i] != '\r' && pem[i] != '\n' && pem[i] != ' ' && pem[i] != '\t')
+        {
+            body.push_back(pem[i]);
+        }
+    }
+    return Base64::Decode(body, data);
+}
+
+inline PortableRSA::Limbs PortableRSA::GeneratePrime(size_t bits)
+{
+    // Small primes for trial division, sieved once.
+    static const std::vector<uint32_t> small_primes = []()
+    {
+        constexpr uint32_t limit = 4096;
+        std::vector<bool>     composite(limit, false);
+        std::vector<uint32_t> primes;
+        for (uint32_t i = 3; i < limit; i += 2)
+        {
+            if (composite[i])
+            {
+                continue;
+            }
+            primes.push_back(i);
+            for (uint32_t j = i * i; j < limit; j += 2 * i)
+            {
+                composite[j] = true;
+            }
+        }
+        return primes;
+    }();
+
+    const size_t limbs = (bits + BigNum::c_LimbBits - 1) / BigNum::c_LimbBits;
+    std::vector<uint8_t> random(limbs * sizeof(BigNum::Limb));
+    while (true)
+    {
+        if (!SecureRandom::Fill(random))
+        {
+            return {};
+        }
+        Limbs candidate = BigNum::FromBytes(random, limbs);
+        const size_t top_bits = bits % BigNum::c_LimbBits ? bits % BigNum::c_LimbBits : BigNum::c_LimbBits;
+        if (top_bits < BigNum::c_LimbBits)
+        {
+            candidate[limbs - 1] &= (BigNum::Limb(1) << top_bits) - 1;
+        }
+        // Two top bits set, so product of two primes has exactly 2 * bits.
+        candidate[limbs - 1] |= BigNum::Limb(3) << (top_bits - 2);
+        candidate[0]         |= 1;
+
+        bool divisible = false;
+        for (const auto prime : small_primes)
+        {
+            if (BigNum::ModSmall(candidate, prime) == 0)
+            {
+                divisible = true;
+                break;
+            }
+        }
+        // gcd(e, p - 1) must be 1, e is prime.
+        if (divisible || BigNum::ModSmall(candidate, c_PublicExponent) == 1)
+        {
+            continue;
+        }
+        if (IsProbablePrime(candidate, bits >= 1024 ? 5 : 8))
+        {
+            return candidate;
+        }
+    }
+}
+
+inline bool PortableRSA::IsProbablePrime(const Limbs &candidate, size_t rounds)
+{
+    BigNum::Montgomery mont;
+    if (!mont.Init(candidate))
+    {
+        return false;
+    }
+    const Limbs one       = { 1 };
+    const Limbs minus_one = BigNum::Sub(candidate, one);
+    size_t shift = 0;
+    while (!((minus_one[shift / BigNum::c_LimbBits] >> (shift % BigNum::c_LimbBits)) & 1))
+    {
+        shift++;
+    }
+    const Limbs odd_part = BigNum::ShiftRight(minus_one, shift);
+    std::vector<uint8_t> random(candidate.size() * sizeof(BigNum::Limb));
+    for (size_t round = 0; round < rounds; round++)
+    {
+        Limbs base;
+        do
+        {
+            if (!SecureRandom::Fill(random))
+            {
+                return false;
+            }
+            base = mont.Reduce(BigNum::FromBytes(random));
+        } while (BigNum::Compare(base, Limbs{ 2 }) < 0 || BigNum::Compare(base, minus_one) >= 0);
+
+        Limbs x = mont.Exp(base, odd_part);
+        if (BigNum::Compare(x, one) == 0 || BigNum::Compare(x, minus_one) == 0)
+        {
+            continue;
+        }
+        bool witness = true;
+        Limbs x_mont = mont.ToMont(x);
+        for (size_t i = 1; i < shift && witness; i++)
+        {
+            x_mont = mont.Mul(x_mont, x_mont);
+            witness = BigNum::Compare(mont.FromMont(x_mont), minus_one) != 0;
+        }
+        if (witness)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// e ^ -1 mod modulus for small e: d = (1 + k * modulus) / e, where k * modulus = -1 mod e.
+inline PortableRSA::Limbs PortableRSA::InverseSmall(const Limbs &modulus, BigNum::Limb e)
+{
+    const int64_t r = static_cast<int64_t>(BigNum::ModSmall(modulus, e));
+    // Extended Euclid over machine words: inv * r = 1 mod e.
+    int64_t old_r = r, cur_r = static_cast<int64_t>(e), old_s = 1, cur_s = 0;
+    while (cur_r)
+    {
+        const int64_t q = old_r / cur_r;
+        std::swap(old_r, cur_r); cur_r -= q * old_r;
+        std::swap(old_s, cur_s); cur_s -= q * old_s;
+    }
+    if (old_r != 1)
+    {
+        return {};
+    }
+    const int64_t inv = ((old_s % static_cast<int64_t>(e)) + static_cast<int64_t>(e)) % static_cast<int64_t>(e);
+    const BigNum::Limb k = (e - static_cast<BigNum::Limb>(inv)) % e;
+    Limbs d = BigNum::Add(BigNum::MulSmall(modulus, k), Limbs{ 1 });
+    if (BigNum::DivSmall(d, e) != 0)
+    {
+        return {};
+    }
+    return d;
+}
+
+inline bool PortableRSA::SetupKey(bool isPrivate)
+{
+    if (!m_MontN.Init(m_N) || BigNum::IsZero(m_E))
+    {
+        return false;
+    }
+    m_ModulusSize = (BigNum::BitLength(m_N) + 7) / 8;
+    if (!isPrivate)
+    {
+        return true;
+    }
+    if (!m_MontP.Init(m_P) || !m_MontQ.Init(m_Q))
+    {
+        return false;
+    }
+    m_QInvMont = m_MontP.ToMont(m_QInv);
+    return true;
+}
+
+inline bool PortableRSA::PublicOp(const Limbs &input, Limbs &output) const
+{
+    if (!m_MontN.Size() || BigNum::Compare(input, m_N) >= 0)
+    {
+        return false;
+    }
+    output = m_MontN.ExpPublic(input, m_E);
+    return true;
+}
+
+// Garner: h = qinv * (m1 - m2) mod p, m = m2 + h * q.
+inline PortableRSA::Limbs PortableRSA::CrtCombine(const Limbs &m1, const Limbs &m2) const
+{
+    const Limbs h = m_MontP.Mul(m_MontP.SubMod(m1, m_MontP.Reduce(m2)), m_QInvMont);
+    return BigNum::Add(m2, BigNum::Mul(h, m_Q));
+}
+
+inline bool PortableRSA::NewBlinding(Limbs &blind, Limbs &unblind) const
+{
+    const Limbs one = { 1 };
+    std::vector<uint8_t> random(m_ModulusSize);
+    for (size_t attempt = 0; attempt < 8; attempt++)
+    {
+        if (!SecureRandom::Fill(random))
+        {
+            return false;
+        }
+        const Limbs r = m_MontN.Reduce(BigNum::FromBytes(random));
+        // p & q are prime: r ^ -1 = r ^ (p - 2) mod p, r ^ (q - 2) mod q, joined through CRT.
+        const Limbs inv_p = m_MontP.Exp(m_MontP.Reduce(r), BigNum::Sub(m_P, Limbs{ 2 }));
+        const Limbs inv_q = m_MontQ.Exp(m_MontQ.Reduce(r), BigNum::Sub(m_Q, Limbs{ 2 }));
+        const Limbs inv   = m_MontN.Reduce(CrtCombine(inv_p, inv_q));
+        // r sharing factor with n (or zero) has no inverse, product check catches it.
+        if (BigNum::Compare(m_MontN.FromMont(m_MontN.Mul(m_MontN.ToMont(r), m_MontN.ToMont(inv))), one) != 0)
+        {
+            continue;
+        }
+        blind   = m_MontN.ToMont(m_MontN.ExpPublic(r, m_E));
+        unblind = m_MontN.ToMont(inv);
+        return true;
+    }
+    return false;
+}
+
+inline bool PortableRSA::NextBlinding(Limbs &blind, Limbs &unblind) const
+{
+    std::lock_guard<std::mutex> lock(m_BlindingMutex);
+    if (m_Blind.empty() || m_BlindingUses >= c_BlindingRefresh)
+    {
+        if (!NewBlinding(m_Blind, m_Unblind))
+        {
+            return false;
+        }
+        m_BlindingUses = 0;
+    }
+    else
+    {
+        // (r ^ 2) ^ e & (r ^ 2) ^ -1, pair stays matched without new inversion.
+        m_MontN.Sqr(m_Blind.data(), m_Blind.data());
+        m_MontN.Sqr(m_Unblind.data(), m_Unblind.data());
+    }
+    m_BlindingUses++;
+    blind   = m_Blind;
+    unblind = m_Unblind;
+    return true;
+}
+
+inline bool PortableRSA::PrivateOp(const Limbs &input, Limbs &output) const
+{
+    if (!(m_Keytype & KeyType_Full) || !m_MontP.Size() || BigNum::Compare(input, m_N) >= 0)
+    {
+        return false;
+    }
+    Limbs blind, unblind;
+    if (!NextBlinding(blind, unblind))
+    {
+        return false;
+    }
+    // Exponentiation runs on c * r ^ e, so its timing & power trace are not tied to attacker chosen c.
+    Limbs c = input;
+    c.resize(m_MontN.Size(), 0);
+    const Limbs blinded = m_MontN.Mul(c, blind);
+    // CRT: m1 = c ^ dp mod p, m2 = c ^ dq mod q.
+    const Limbs m1 = m_MontP.Exp(m_MontP.Reduce(blinded), m_DP);
+    const Limbs m2 = m_MontQ.Exp(m_MontQ.Reduce(blinded), m_DQ);
+    Limbs m = CrtCombine(m1, m2);
+    m.resize(m_MontN.Size(), 0);
+    m = m_MontN.Mul(m, unblind);
+    // Fault in one CRT half would give gcd(m ^ e - c, n) = p or q (Bellcore), faulty result never leaves.
+    if (BigNum::Compare(m_MontN.ExpPublic(m, m_E), input) != 0)
+    {
+        BigNum::SecureZero(m);
+        return false;
+    }
+    output = std::move(BigNum::Trim(m));
+    return true;
+}
+
+inline void PortableRSA::MGF1(const uint8_t *seed, size_t seedLen, uint8_t *mask, size_t maskLen)
+{
+    Sha256::Context ctx;
+    for (uint32_t counter = 0; maskLen; counter++)
+    {
+        const uint8_t counter_be[4] = { static_cast<uint8_t>(counter >> 24), static_cast<uint8_t>(counter >> 16),
+                                        static_cast<uint8_t>(counter >> 8),  static_cast<uint8_t>(counter) };
+        ctx.Update(seed, seedLen);
+        ctx.Update(counter_be, sizeof(counter_be));
+        const Sha256::Digest digest = ctx.Final();
+        const size_t take = std::min(maskLen, digest.size());
+        for (size_t i = 0; i < take; i++)
+        {
+            mask[i] ^= digest[i];
+        }
+        mask    += take;
+        maskLen -= take;
+    }
+}
+
+inline bool PortableRSA::OAEP_Encode(const std::vector<uint8_t> &message, std::vector<uint8_t> &encoded) const
+{
+    constexpr size_t h_len = Sha256::c_DigestSize;
+    const size_t     k     = m_ModulusSize;
+    if (k < 2 * h_len + 2 || message.size() > k - 2 * h_len - 2)
+    {
+        return false;
+    }
+    // EM = 0x00 || maskedSeed || maskedDB, DB = lHash || PS || 0x01 || M, label is empty.
+    encoded.assign(k, 0x00);
+    uint8_t *seed = encoded.data() + 1;
+    uint8_t *db   = seed + h_len;
+    const size_t db_len = k - h_len - 1;
+    const Sha256::Digest label_hash = Sha256::Calculate(nullptr, 0);
+    memcpy(db, label_hash.data(), h_len);
+    db[db_len - message.size() - 1] = 0x01;
+    if (!message.empty())
+    {
+        memcpy(db + db_len - message.size(), message.data(), message.size());
+    }
+    if (!SecureRandom::Fill({ seed, h_len }))
+    {
+        return false;
+    }
+    MGF1(seed, h_len, db, db_len);
+    MGF1(db, db_len, seed, h_len);
+    return true;
+}
+
+inline bool PortableRSA::OAEP_Decode(const std::vector<uint8_t> &encoded, std::vector<uint8_t> &message) const
+{
+    constexpr size_t h_len = Sha256::c_DigestSize;
+    const size_t     k     = m_ModulusSize;
+    if (encoded.size() != k || k < 2 * h_len + 2)
+    {
+        return false;
+    }
+    std::vector<uint8_t> em = encoded;
+    uint8_t *seed = em.data() + 1;
+    uint8_t *db   = seed + h_len;
+    const size_t db_len = k - h_len - 1;
+    MGF1(db, db_len, seed, h_len);
+    MGF1(seed, h_len, db, db_len);
+    const Sha256::Digest label_hash = Sha256::Calculate(nullptr, 0);
+    // Whole block is scanned regardless of where it breaks, to not leak padding errors via timing.
+    uint8_t bad = em[0];
+    for (size_t i = 0; i < h_len; i++)
+    {
+        bad |= db[i] ^ label_hash[i];
+    }
+    size_t   separator = 0;
+    uint8_t  found     = 0;
+    for (size_t i = h_len; i < db_len; i++)
+    {
+        const uint8_t is_one  = static_cast<uint8_t>(db[i] == 0x01);
+        const uint8_t is_zero = static_cast<uint8_t>(db[i] == 0x00);
+        const uint8_t take    = is_one & static_cast<uint8_t>(!found);
+        separator |= (0 - static_cast<size_t>(take)) & i;
+        found     |= take;
+        bad       |= static_cast<uint8_t>(!found & !is_zero & !is_one);
+    }
+    if (bad || !found)
+    {
+        return false;
+    }
+    message.assign(db + separator + 1, db + db_len);
+    return true;
+}
+
+inline bool PortableRSA::SignatureBlock(const std::vector<uint8_t> &message, std::vector<uint8_t> &block) const
+{
+    // EM = 0x00 || 0x01 || PS (0xFF) || 0x00 || DigestInfo || H
+    const size_t t_len = sizeof(c_Sha256DigestInfo) + Sha256::c_DigestSize;
+    if (m_ModulusSize < t_len + 11)
+    {
+        return false;
+    }
+    block.assign(m_ModulusSize, 0xFF);
+    block[0] = 0x00;
+    block[1] = 0x01;
+    const size_t t_pos = m_ModulusSize - t_len;
+    block[t_pos - 1] = 0x00;
+    memcpy(&block[t_pos], c_Sha256DigestInfo, sizeof(c_Sha256DigestInfo));
+    const Sha256::Digest digest = Sha256::Calculate(message.data(), message.size());
+    memcpy(&block[t_pos + sizeof(c_Sha256DigestInfo)], digest.data(), digest.size());
+    return true;
+}
+
+template <typename Op>
+inline bool PortableRSA::RunBatch(size_t count, ThreadPool *pool, const Op &op)
+{
+    std::atomic<bool> result = true;
+    const auto run = [&](size_t idx)
+    {
+        if (!op(idx))
+        {
+            result = false;
+        }
+    };
+    if (!pool)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            run(i);
+        }
+        return result;
+    }
+    pool->ParallelFor("RSA batch", count, run);
+    return result;
+}
+
+inline bool PortableRSA::GenerateKeyPair(uint16_t keySize)
+{
+    TRACE_SCOPE("Crypto", "RSA generate");
+    if (keySize < 512 || keySize % 128 || keySize > BigNum::c_MaxLimbs * BigNum::c_LimbBits)
+    {
+        return false;
+    }
+    ReleaseKeyPair();
+    do
+    {
+        // Empty prime means RNG failure, two of them would compare equal & loop forever.
+        m_P = GeneratePrime(keySize / 2);
+        m_Q = BigNum::IsZero(m_P) ? Limbs{} : GeneratePrime(keySize / 2);
+        if (BigNum::IsZero(m_P) || BigNum::IsZero(m_Q))
+        {
+            ReleaseKeyPair();
+            return false;
+        }
+    } while (BigNum::Compare(m_P, m_Q) == 0);
+    if (BigNum::Compare(m_P, m_Q) < 0)
+    {
+        std::swap(m_P, m_Q);
+    }
+    const Limbs one = { 1 };
+    const Limbs p_1 = BigNum::Sub(m_P, one), q_1 = BigNum::Sub(m_Q, one);
+    m_N  = BigNum::Mul(m_P, m_Q);
+    m_E  = { c_PublicExponent };
+    m_D  = InverseSmall(BigNum::Mul(p_1, q_1), c_PublicExponent);
+    m_DP = InverseSmall(p_1, c_PublicExponent);
+    m_DQ = InverseSmall(q_1, c_PublicExponent);
+    if (BigNum::IsZero(m_D) || BigNum::IsZero(m_DP) || BigNum::IsZero(m_DQ) || !m_MontP.Init(m_P))
+    {
+        ReleaseKeyPair();
+        return false;
+    }
+    // p is prime: q ^ -1 = q ^ (p - 2) mod p.
+    m_QInv    = m_MontP.Exp(m_MontP.Reduce(m_Q), BigNum::Sub(m_P, Limbs{ 2 }));
+    m_Keytype = KeyType_Full;
+    if (!SetupKey(true))
+    {
+        ReleaseKeyPair();
+        return false;
+    }
+    return true;
+}
+
+inline bool PortableRSA::ImportKeyInfo(KeyType type, const std::vector<uint8_t> &keyData)
+{
+    if (!ValidKeyType(type))
+    {
+        return false;
+    }
+    ReleaseKeyPair();
+    std::vector<uint8_t> der = keyData;
+    if ((type & KeyType_PEM) && !PEM_Decode(type, der))
+    {
+        return false;
+    }
+    size_t pos = 0, len = 0;
+    if (!DerReadHeader(der, pos, 0x30, len))
+    {
+        return false;
+    }
+    const bool is_private = type & KeyType_Full;
+    bool result = true;
+    if (is_private)
+    {
+        // RSAPrivateKey ::= SEQUENCE { version, n, e, d, p, q, dp, dq, qinv }
+        Limbs version;
+        result = DerReadInteger(der, pos, version) && BigNum::IsZero(version) &&
+                 DerReadInteger(der, pos, m_N)  && DerReadInteger(der, pos, m_E)  && DerReadInteger(der, pos, m_D)  &&
+                 DerReadInteger(der, pos, m_P)  && DerReadInteger(der, pos, m_Q)  &&
+                 DerReadInteger(der, pos, m_DP) && DerReadInteger(der, pos, m_DQ) && DerReadInteger(der, pos, m_QInv);
+    }
+    else
+    {
+        // RSAPublicKey ::= SEQUENCE { n, e }
+        result = DerReadInteger(der, pos, m_N) && DerReadInteger(der, pos, m_E);
+    }
+    if (!result || !SetupKey(is_private))
+    {
+        ReleaseKeyPair();
+        return false;
+    }
+    m_Keytype = is_private ? KeyType_Full : KeyType_Public;
+    return true;
+}
+
+inline bool PortableRSA::ExportKeyInfo(KeyType type, std::vector<uint8_t> &keyData)
+{
+    if (!ValidKeyType(type) || !m_MontN.Size())
+    {
+        return false;
+    }
+    const bool is_private = type & KeyType_Full;
+    if (is_private && !(m_Keytype & KeyType_Full))
+    {
+        return false;
+    }
+    std::vector<uint8_t> body;
+    if (is_private)
+    {
+        DerAppendInteger(body, Limbs{});
+        for (const Limbs *value : { &m_N, &m_E, &m_D, &m_P, &m_Q, &m_DP, &m_DQ, &m_QInv })
+        {
+            DerAppendInteger(body, *value);
+        }
+    }
+    else
+    {
+        DerAppendInteger(body, m_N);
+        DerAppendInteger(body, m_E);
+    }
+    keyData = { 0x30 };
+    DerAppendLength(keyData, body.size());
+    keyData.insert(keyData.end(), body.begin(), body.end());
+    return !(type & KeyType_PEM) || PEM_Encode(type, keyData);
+}
+
+inline bool PortableRSA::Encrypt(const std::vector<uint8_t> &iString, std::vector<uint8_t> &oString) const
+{
+    TRACE_SCOPE("Crypto", "RSA encrypt");
+    std::vector<uint8_t> block;
+    if (m_ExplicitPadding)
+    {
+        if (!OAEP_Encode(iString, block))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        if (iString.size() > m_ModulusSize)
+        {
+            return false;
+        }
+        block.assign(m_ModulusSize - iString.size(), 0x00);
+        block.insert(block.end(), iString.begin(), iString.end());
+    }
+    Limbs output;
+    if (!PublicOp(BigNum::FromBytes(block), output))
+    {
+        return false;
+    }
+    oString.resize(m_ModulusSize);
+    return BigNum::ToBytes(output, oString.data(), oString.size());
+}
+
+inline bool PortableRSA::Decrypt(const std::vector<uint8_t> &iString, std::vector<uint8_t> &oString) const
+{
+    TRACE_SCOPE("Crypto", "RSA decrypt");
+    Limbs output;
+    if (iString.size() != m_ModulusSize || !PrivateOp(BigNum::FromBytes(iString), output))
+    {
+        return false;
+    }
+    std::vector<uint8_t> block(m_ModulusSize);
+    if (!BigNum::ToBytes(output, block.data(), block.size()))
+    {
+        return false;
+    }
+    if (m_ExplicitPadding)
+    {
+        return OAEP_Decode(block, oString);
+    }
+    oString = std::move(block);
+    return true;
+}
+
+inline bool PortableRSA::Sign(const std::vector<uint8_t> &iMessage, std::vector<uint8_t> &oSignature) const
+{
+    TRACE_SCOPE("Crypto", "RSA sign");
+    std::vector<uint8_t> block;
+    Limbs output;
+    if (!SignatureBlock(iMessage, block) || !PrivateOp(BigNum::FromBytes(block), output))
+    {
+        return false;
+    }
+    oSignature.resize(m_ModulusSize);
+    return BigNum::ToBytes(output, oSignature.data(), oSignature.size());
+}
+
+inline bool PortableRSA::Verify(const std::vector<uint8_t> &iMessage, const std::vector<uint8_t> &iSignature) const
+{
+    TRACE_SCOPE("Crypto", "RSA verify");
+    std::vector<uint8_t> expected, block(m_ModulusSize);
+    Limbs output;
+    if (iSignature.size() != m_ModulusSize || !SignatureBlock(iMessage, expected) ||
+        !PublicOp(BigNum::FromBytes(iSignature), output) || !BigNum::ToBytes(output, block.data(), block.size()))
+    {
+        return false;
+    }
+    return block == expected;
+}
+
+inline bool PortableRSA::EncryptBatch(const std::vector<std::vector<uint8_t>> &iData, std::vector<std::vector<uint8_t>> &oData, ThreadPool *pool) const
+{
+    oData.assign(iData.size(), {});
+    return RunBatch(iData.size(), pool, [&](size_t idx) { return Encrypt(iData[idx], oData[idx]); });
+}
+
+inline bool PortableRSA::DecryptBatch(const std::vector<std::vector<uint8_t>> &iData, std::vector<std::vector<uint8_t>> &oData, ThreadPool *pool) const
+{
+    oData.assign(iData.size(), {});
+    return RunBatch(iData.size(), pool, [&](size_t idx) { return Decrypt(iData[idx], oData[idx]); });
+}
+
+inline bool PortableRSA::SignBatch(const std::vector<std::vector<uint8_t>> &iMessages, std::vector<std::vector<uint8_t>> &oSignatures, ThreadPool *pool) const
+{
+    oSignatures.assign(iMessages.size(), {});
+    return RunBatch(iMessages.size(), pool, [&](size_t idx) { return Sign(iMessages[idx], oSignatures[idx]); });
+}
+
+inline bool PortableRSA::VerifyBatch(const std::vector<std::vector<uint8_t>> &iMessages, const std::vector<std::vector<uint8_t>> &iSignatures,
+                                     std::vector<uint8_t> &oResults, ThreadPool *pool) const
+{
+    if (iMessages.size() != iSignatures.size())
+    {
+        return false;
+    }
+    oResults.assign(iMessages.size(), 0);
+    return RunBatch(iMessages.size(), pool, [&](size_t idx)
+    {
+        oResults[idx] = Verify(iMessages[idx], iSignatures[idx]);
+        return oResults[idx] != 0;
+    });
+}
+
+inline void PortableRSA::ReleaseKeyPair()
+{
+    for (Limbs *value : { &m_N, &m_E, &m_D, &m_P, &m_Q, &m_DP, &m_DQ, &m_QInv, &m_QInvMont })
+    {
+        BigNum::SecureZero(*value);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_BlindingMutex);
+        BigNum::SecureZero(m_Blind);
+        BigNum::SecureZero(m_Unblind);
+        m_BlindingUses = 0;
+    }
+    m_MontN       = {};
+    m_MontP       = {};
+    m_MontQ       = {};
+    m_ModulusSize = 0;
+    m_Keytype     = KeyType_Undefined;
+}
@@ -0,0 +1,439 @@
+#pragma once
+
+// Portable SHA-256, bit exact with BCRYPT_SHA256_ALGORITHM.
+// Besides plain streaming context has multi-buffer mode: up to 8 independent messages
+// are compressed at once with AVX2 lanes, selected in runtime, scalar code otherwise.
+
+#include <array>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <numeric>
+
+#include "Common.h"
+#include "CpuFeatures.hpp"
+#include "Trace.hpp"
+
+namespace Sha256
+{
+    constexpr size_t c_DigestSize = 32;
+    constexpr size_t c_BlockSize  = 64;
+    constexpr size_t c_Lanes      = 8;
+
+    using Digest = std::array<uint8_t, c_DigestSize>;
+
+    namespace Detail
+    {
+        alignas(32) inline constexpr uint32_t c_K[64] =
+        {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+        };
+
+        inline constexpr uint32_t c_InitState[8] =
+        {
+            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+        };
+
+        inline uint32_t Rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+        inline uint32_t LoadBE32(const uint8_t *p)
+        {
+            return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+                   (static_cast<uint32_t>(p[2]) << 8)  |  static_cast<uint32_t>(p[3]);
+        }
+
+        inline void StoreBE32(uint8_t *p, uint32_t v)
+        {
+            p[0] = static_cast<uint8_t>(v >> 24); p[1] = static_cast<uint8_t>(v >> 16);
+            p[2] = static_cast<uint8_t>(v >> 8);  p[3] = static_cast<uint8_t>(v);
+        }
+
+        inline void CompressBlock(uint32_t state[8], const uint8_t *block)
+        {
+            uint32_t w[64];
+            for (size_t t = 0; t < 16; t++)
+            {
+                w[t] = LoadBE32(block + t * 4);
+            }
+            for (size_t t = 16; t < 64; t++)
+            {
+                const uint32_t s0 = Rotr(w[t - 15], 7) ^ Rotr(w[t - 15], 18) ^ (w[t - 15] >> 3);
+                const uint32_t s1 = Rotr(w[t - 2], 17) ^ Rotr(w[t - 2], 19)  ^ (w[t - 2] >> 10);
+                w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+            }
+            uint32_t a = state[0], b = state[1], c = state[2], d = state[3],
+                     e = state[4], f = state[5], g = state[6], h = state[7];
+            for (size_t t = 0; t < 64; t++)
+            {
+                const uint32_t t1 = h + (Rotr(e, 6) ^ Rotr(e, 11) ^ Rotr(e, 25)) + ((e & f) ^ (~e & g)) + c_K[t] + w[t];
+                const uint32_t t2 = (Rotr(a, 2) ^ Rotr(a, 13) ^ Rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+                h = g; g = f; f = e; e = d + t1;
+                d = c; c = b; b = a; a = t1 + t2;
+            }
+            state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+            state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+        }
+
+        // Message is processed as len / 64 blocks in place and 1 or 2 padded tail blocks.
+        struct PaddedMessage
+        {
+            const uint8_t *data       = nullptr;
+            size_t         fullBlocks = 0;
+            size_t         tailBlocks = 0;
+            alignas(16) uint8_t tail[c_BlockSize * 2] = {};
+
+            // prefixLen: bytes already compressed into starting state, they count in encoded length.
+            void Init(const uint8_t *iData, size_t iLen, uint64_t prefixLen = 0)
+            {
+                data       = iData;
+                fullBlocks = iLen / c_BlockSize;
+                const size_t rem = iLen % c_BlockSize;
+                tailBlocks = rem + 9 > c_BlockSize ? 2 : 1;
+                memset(tail, 0x00, sizeof(tail));
+                if (rem)
+                {
+                    memcpy(tail, iData + fullBlocks * c_BlockSize, rem);
+                }
+                tail[rem] = 0x80;
+                const uint64_t bit_len = (static_cast<uint64_t>(iLen) + prefixLen) * 8;
+                uint8_t *len_pos = tail + tailBlocks * c_BlockSize - 8;
+                StoreBE32(len_pos,     static_cast<uint32_t>(bit_len >> 32));
+                StoreBE32(len_pos + 4, static_cast<uint32_t>(bit_len));
+            }
+
+            size_t Blocks() const { return fullBlocks + tailBlocks; }
+
+            const uint8_t *Block(size_t idx) const
+            {
+                return idx < fullBlocks ? data + idx * c_BlockSize : tail + (idx - fullBlocks) * c_BlockSize;
+            }
+        };
+
+#if defined CPU_X86
+        CPU_TARGET("avx2") inline __m256i Rotr8(__m256i x, int n)
+        {
+            return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+        }
+
+        // Loads 8 words of each lane block and transposes them, so out[i] holds word i of every lane.
+        CPU_TARGET("avx2") inline void LoadTransposed(const uint8_t *const blocks[c_Lanes], size_t offset, __m256i out[8])
+        {
+            const __m256i bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                                   3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+            __m256i r[8];
+            for (size_t l = 0; l < c_Lanes; l++)
+            {
+                r[l] = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(blocks[l] + offset)), bswap);
+            }
+            const __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]), t1 = _mm256_unpackhi_epi32(r[0], r[1]),
+                          t2 = _mm256_unpacklo_epi32(r[2], r[3]), t3 = _mm256_unpackhi_epi32(r[2], r[3]),
+                          t4 = _mm256_unpacklo_epi32(r[4], r[5]), t5 = _mm256_unpackhi_epi32(r[4], r[5]),
+                          t6 = _mm256_unpacklo_epi32(r[6], r[7]), t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+            const __m256i u0 = _mm256_unpacklo_epi64(t0, t2), u1 = _mm256_unpackhi_epi64(t0, t2),
+                          u2 = _mm256_unpacklo_epi64(t1, t3), u3 = _mm256_unpackhi_epi64(t1, t3),
+                          u4 = _mm256_unpacklo_epi64(t4, t6), u5 = _mm256_unpackhi_epi64(t4, t6),
+                          u6 = _mm256_unpacklo_epi64(t5, t7), u7 = _mm256_unpackhi_epi64(t5, t7);
+            out[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+            out[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+            out[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+            out[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+            out[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+            out[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+            out[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+            out[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+        }
+
+        // One block for each of 8 lanes, lanes outside of activeMask keep their state.
+        CPU_TARGET("avx2") inline void CompressBlockX8(__m256i state[8], const uint8_t *const blocks[c_Lanes], __m256i activeMask)
+        {
+            __m256i w[64];
+            LoadTransposed(blocks, 0,  w);
+            LoadTransposed(blocks, 32, w + 8);
+            for (size_t t = 16; t < 64; t++)
+            {
+                const __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(Rotr8(w[t - 15], 7), Rotr8(w[t - 15], 18)), _mm256_srli_epi32(w[t - 15], 3));
+                const __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(Rotr8(w[t - 2], 17), Rotr8(w[t - 2], 19)),  _mm256_srli_epi32(w[t - 2], 10));
+                w[t] = _mm256_add_epi32(_mm256_add_epi32(w[t - 16], s0), _mm256_add_epi32(w[t - 7], s1));
+            }
+            __m256i a = state[0], b = state[1], c = state[2], d = state[3],
+                    e = state[4], f = state[5], g = state[6], h = state[7];
+            for (size_t t = 0; t < 64; t++)
+            {
+                const __m256i big_s1 = _mm256_xor_si256(_mm256_xor_si256(Rotr8(e, 6), Rotr8(e, 11)), Rotr8(e, 25));
+                const __m256i ch     = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+                const __m256i t1     = _mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(h, big_s1), _mm256_add_epi32(ch, w[t])),
+                                                        _mm256_set1_epi32(static_cast<int>(c_K[t])));
+                const __m256i big_s0 = _mm256_xor_si256(_mm256_xor_si256(Rotr8(a, 2), Rotr8(a, 13)), Rotr8(a, 22));
+                const __m256i maj    = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+                const __m256i t2     = _mm256_add_epi32(big_s0, maj);
+                h = g; g = f; f = e; e = _mm256_add_epi32(d, t1);
+                d = c; c = b; b = a; a = _mm256_add_epi32(t1, t2);
+            }
+            const __m256i fresh[8] = { a, b, c, d, e, f, g, h };
+            for (size_t i = 0; i < 8; i++)
+            {
+                state[i] = _mm256_blendv_epi8(state[i], _mm256_add_epi32(state[i], fresh[i]), activeMask);
+            }
+        }
+
+        CPU_TARGET("avx2") inline void DigestX8(const PaddedMessage *const msgs[c_Lanes], Digest *const out[c_Lanes], const uint32_t initState[8] = c_InitState)
+        {
+            alignas(64) static const uint8_t zero_block[c_BlockSize] = {};
+            __m256i state[8];
+            for (size_t i = 0; i < 8; i++)
+            {
+                state[i] = _mm256_set1_epi32(static_cast<int>(initState[i]));
+            }
+            size_t max_blocks = 0;
+            for (size_t l = 0; l < c_Lanes; l++)
+            {
+                max_blocks = msgs[l] ? std::max(max_blocks, msgs[l]->Blocks()) : max_blocks;
+            }
+            for (size_t blk = 0; blk < max_blocks; blk++)
+            {
+                const uint8_t *blocks[c_Lanes];
+                alignas(32) int32_t active[c_Lanes];
+                for (size_t l = 0; l < c_Lanes; l++)
+                {
+                    const bool lane_active = msgs[l] && blk < msgs[l]->Blocks();
+                    blocks[l] = lane_active ? msgs[l]->Block(blk) : zero_block;
+                    active[l] = lane_active ? -1 : 0;
+                }
+                CompressBlockX8(state, blocks, _mm256_load_si256(reinterpret_cast<const __m256i *>(active)));
+            }
+            alignas(32) uint32_t words[8][c_Lanes];
+            for (size_t i = 0; i < 8; i++)
+            {
+                _mm256_store_si256(reinterpret_cast<__m256i *>(words[i]), state[i]);
+            }
+            for (size_t l = 0; l < c_Lanes; l++)
+            {
+                if (out[l])
+                {
+                    for (size_t i = 0; i < 8; i++)
+                    {
+                        StoreBE32(out[l]->data() + i * 4, words[i][l]);
+                    }
+                }
+            }
+        }
+#endif
+    }
+
+    // Streaming SHA-256, may be reused after Final via Reset.
+    class Context
+    {
+    private:
+        uint32_t m_State[8];
+        uint8_t  m_Buffer[c_BlockSize] = {};
+        size_t   m_Buffered = 0;
+        uint64_t m_Total    = 0;
+
+    public:
+        Context() { Reset(); }
+
+        void Reset()
+        {
+            memcpy(m_State, Detail::c_InitState, sizeof(m_State));
+            m_Buffered = 0;
+            m_Total    = 0;
+        }
+
+        void Update(const uint8_t *iData, size_t iLen)
+        {
+            m_Total += iLen;
+            if (m_Buffered)
+            {
+                const size_t take = std::min(iLen, c_BlockSize - m_Buffered);
+                memcpy(m_Buffer + m_Buffered, iData, take);
+                m_Buffered += take;
+                iData      += take;
+                iLen       -= take;
+                if (m_Buffered < c_BlockSize)
+                {
+                    return;
+                }
+                Detail::CompressBlock(m_State, m_Buffer);
+                m_Buffered = 0;
+            }
+            for (; iLen >= c_BlockSize; iData += c_BlockSize, iLen -= c_BlockSize)
+            {
+                Detail::CompressBlock(m_State, iData);
+            }
+            if (iLen)
+            {
+                memcpy(m_Buffer, iData, iLen);
+                m_Buffered = iLen;
+            }
+        }
+
+        void Update(const std::vector<uint8_t> &iData) { Update(iData.data(), iData.size()); }
+
+        Digest Final()
+        {
+            Detail::PaddedMessage tail;
+            tail.Init(m_Buffer, m_Buffered);
+            // Bit length must cover whole stream, not only buffered part.
+            const uint64_t bit_len = m_Total * 8;
+            uint8_t *len_pos = tail.tail + tail.tailBlocks * c_BlockSize - 8;
+            Detail::StoreBE32(len_pos,     static_cast<uint32_t>(bit_len >> 32));
+            Detail::StoreBE32(len_pos + 4, static_cast<uint32_t>(bit_len));
+            for (size_t i = 0; i < tail.tailBlocks; i++)
+            {
+                Detail::CompressBlock(m_State, tail.tail + i * c_BlockSize);
+            }
+            Digest result;
+            for (size_t i = 0; i < 8; i++)
+            {
+                Detail::StoreBE32(result.data() + i * 4, m_State[i]);
+            }
+            Reset();
+            return result;
+        }
+    };
+
+    inline Digest Calculate(const uint8_t *iData, size_t iLen)
+    {
+        TRACE_SCOPE("Crypto", "SHA-256");
+        Context ctx;
+        ctx.Update(iData, iLen);
+        return ctx.Final();
+    }
+
+    // Hashes count independent messages. With AVX2 messages are sorted by length and
+    // compressed 8 at a time, so lanes of one pass wait as little as possible for each other.
+    // With iPrefixBlock every message is hashed as prefix block (c_BlockSize bytes) followed by message,
+    // prefix is compressed once for all of them (domain separation of tree leaves etc.).
+    inline void CalculateBatch(const uint8_t *const *iData, const size_t *iLens, size_t count, Digest *oDigests, const uint8_t *iPrefixBlock = nullptr)
+    {
+        TRACE_SCOPE("Crypto", "SHA-256 batch");
+        uint32_t init_state[8];
+        memcpy(init_state, Detail::c_InitState, sizeof(init_state));
+        if (iPrefixBlock)
+        {
+            Detail::CompressBlock(init_state, iPrefixBlock);
+        }
+        const uint64_t prefix_len = iPrefixBlock ? c_BlockSize : 0;
+#if defined CPU_X86
+        if (count >= c_Lanes / 2 && CpuFeatures::HasAvx2())
+        {
+            std::vector<size_t> order(count);
+            std::iota(order.begin(), order.end(), 0);
+            std::sort(order.begin(), order.end(), [iLens](size_t l, size_t r) { return iLens[l] > iLens[r]; });
+            std::array<Detail::PaddedMessage, c_Lanes> msgs;
+            for (size_t first = 0; first < count; first += c_Lanes)
+            {
+                const Detail::PaddedMessage *lanes[c_Lanes] = {};
+                Digest                      *outs[c_Lanes]  = {};
+                for (size_t l = 0; l < c_Lanes && first + l < count; l++)
+                {
+                    const size_t idx = order[first + l];
+                    msgs[l].Init(iData[idx], iLens[idx], prefix_len);
+                    lanes[l] = &msgs[l];
+                    outs[l]  = &oDigests[idx];
+                }
+                Detail::DigestX8(lanes, outs, init_state);
+            }
+            return;
+        }
+#endif
+        for (size_t i = 0; i < count; i++)
+        {
+            Context ctx;
+            if (iPrefixBlock)
+            {
+                ctx.Update(iPrefixBlock, c_BlockSize);
+            }
+            ctx.Update(iData[i], iLens[i]);
+            oDigests[i] = ctx.Final();
+        }
+    }
+
+    inline std::vector<Digest> CalculateBatch(const std::vector<std::vector<uint8_t>> &iData)
+    {
+        std::vector<const uint8_t *> ptrs(iData.size());
+        std::vector<size_t>          lens(iData.size());
+        for (size_t i = 0; i < iData.size(); i++)
+        {
+            ptrs[i] = iData[i].data();
+            lens[i] = iData[i].size();
+        }
+        std::vector<Digest> result(iData.size());
+        CalculateBatch(ptrs.data(), lens.data(), iData.size(), result.data());
+        return result;
+    }
+
+    // HMAC-SHA256 (RFC 2104). Key pads are compressed once, every Final restores keyed state,
+    // so one object authenticates any number of messages. Copy is cheap, one per thread.
+    class Hmac
+    {
+    private:
+        Context m_Inner;
+        Context m_Outer;
+        Context m_InnerKeyed;
+        Context m_OuterKeyed;
+
+    public:
+        Hmac() { SetKey(nullptr, 0); }
+        Hmac(const uint8_t *iKey, size_t iLen) { SetKey(iKey, iLen); }
+
+        void SetKey(const uint8_t *iKey, size_t iLen)
+        {
+            uint8_t block[c_BlockSize] = {};
+            if (iLen > c_BlockSize)
+            {
+                const Digest digest = Calculate(iKey, iLen);
+                memcpy(block, digest.data(), digest.size());
+            }
+            else if (iLen)
+            {
+                memcpy(block, iKey, iLen);
+            }
+            uint8_t pad[c_BlockSize];
+            for (size_t i = 0; i < c_BlockSize; i++)
+            {
+                pad[i] = block[i] ^ 0x36;
+            }
+            m_InnerKeyed.Reset();
+            m_InnerKeyed.Update(pad, c_BlockSize);
+            for (size_t i = 0; i < c_BlockSize; i++)
+            {
+                pad[i] = block[i] ^ 0x5c;
+            }
+            m_OuterKeyed.Reset();
+            m_OuterKeyed.Update(pad, c_BlockSize);
+            Reset();
+        }
+
+        void Reset()
+        {
+            m_Inner = m_InnerKeyed;
+            m_Outer = m_OuterKeyed;
+        }
+
+        void Update(const uint8_t *iData, size_t iLen) { m_Inner.Update(iData, iLen); }
+
+        Digest Final()
+        {
+            const Digest inner = m_Inner.Final();
+            m_Outer.Update(inner.data(), inner.size());
+            const Digest result = m_Outer.Final();
+            Reset();
+            return result;
+        }
+    };
+
+    inline Digest CalculateHmac(const uint8_t *iKey, size_t iKeyLen, const uint8_t *iData, size_t iLen)
+    {
+        Hmac mac(iKey, iKeyLen);
+        mac.Update(iData, iLen);
+        return mac.Final();
+    }
+}
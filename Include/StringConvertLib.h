@@ -1,15 +1,28 @@
 #pragma once
+#include <cstdlib>
+#include <cwchar>
+
 #include "Common.h"
 
 namespace
 {
+    // Output is sized for worst case of current locale, so long or non ASCII input is not truncated.
+    // Converted size includes terminator on every platform, same as wcstombs_s / mbstowcs_s report it.
     template<typename T>
     std::string UTF8_EncodeEx(const T &data)
     {
-        const size_t result_size = (data.size() / sizeof(T::value_type)) + 1;
+        const wchar_t *source      = reinterpret_cast<const wchar_t *>(data.data());
+        const size_t   source_size = data.size() * sizeof(typename T::value_type) / sizeof(wchar_t);
+        const size_t   result_size = source_size * MB_CUR_MAX + 1;
         std::string result_string(result_size, 0x00);
         size_t converted_data = 0;
-        auto err = wcstombs_s(&converted_data, result_string.data(), result_size, reinterpret_cast<const wchar_t *>(data.data()), _TRUNCATE);
+#if defined COMPILER_MSVC
+        auto err = wcstombs_s(&converted_data, result_string.data(), result_size, source, _TRUNCATE);
+#else
+        mbstate_t state = {};
+        converted_data = wcsnrtombs(result_string.data(), &source, source_size, result_size - 1, &state);
+        converted_data = converted_data == static_cast<size_t>(-1) ? 0 : converted_data + 1;
+#endif
         result_string.resize(converted_data);
         return result_string;
     }
@@ -17,10 +30,18 @@ namespace
     template<typename T>
     std::wstring UTF8_DecodeEx(const T &data)
     {
-        const size_t result_size = (data.size() / sizeof(T::value_type)) + 1;
+        const char  *source      = reinterpret_cast<const char *>(data.data());
+        const size_t source_size = data.size() * sizeof(typename T::value_type);
+        const size_t result_size = source_size + 1;
         std::wstring result_string(result_size, 0x00);
         size_t converted_data = 0;
-        auto err = mbstowcs_s(&converted_data, result_string.data(), result_size, reinterpret_cast<const char *>(data.data()), _TRUNCATE);
+#if defined COMPILER_MSVC
+        auto err = mbstowcs_s(&converted_data, result_string.data(), result_size, source, _TRUNCATE);
+#else
+        mbstate_t state = {};
+        converted_data = mbsnrtowcs(result_string.data(), &source, source_size, result_size - 1, &state);
+        converted_data = converted_data == static_cast<size_t>(-1) ? 0 : converted_data + 1;
+#endif
         result_string.resize(converted_data);
         return result_string;
     }
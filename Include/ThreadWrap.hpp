@@ -1,11 +1,17 @@
 #pragma once
 
 #include <any>
+#include <atomic>
 #include <thread>
 #include <future>
+#include <sstream>
+#include "Allocators.hpp"
 #include "Common.h"
 #include "LogLib.h"
+#include "Trace.hpp"
 
+#include <deque>
+#include <memory_resource>
 #include <unordered_map>
 #include <queue>
 
@@ -53,6 +59,7 @@ private:
         std::string                 m_TaskName;
         std::function<void()>       m_VoidFoo = EmptyVoidPlaceHolder;
         std::function<std::any()>   m_AnyFoo = EmptyIntPlaceHolder;
+        uint64_t                    m_FlowId = 0;       // Trace arrow from submitter, 0 when tracing was off.
 
         Task() : m_Result(CallableType::Undecided) {}
     public:
@@ -68,9 +75,13 @@ private:
         Task(const std::string &taskName, std::function<std::any()> anyFunction) :
             m_Result(CallableType::ResultAny), m_TaskName(taskName), m_AnyFoo(anyFunction) {}
 
+        void SetFlow(uint64_t flowId) { m_FlowId = flowId; }
+
         void operator() ()
         {
-            const auto tast_start = std::chrono::steady_clock::now();
+            [[maybe_unused]] const auto tast_start = std::chrono::steady_clock::now();
+            TRACE_SCOPE_DETAIL("ThreadPool", "Task", m_TaskName);
+            Trace::FlowEnd("ThreadPool", "Task", m_FlowId);
             if (m_Result.type == CallableType::Voidable)
             {
                 m_VoidFoo();
@@ -126,7 +137,7 @@ private:
         ThreadContext        context;
 
         PoolWorker(ThreadPool &parent, const std::string &taskName) :
-            parent(parent), awaitTime(defaultAwaitTime)
+            awaitTime(defaultAwaitTime), parent(parent)
         {
             context.name = taskName;
             context.thread = std::thread(&PoolWorker::WorkerLoop, this);
@@ -166,6 +177,7 @@ private:
         void WorkerLoop()
         {
             std::unique_lock lock(context.mutex);
+            Trace::SetThreadName(context.name);
             static const auto empty_task_data = std::pair<uint64_t, Task>(0, Task::GetEmptyTask());
             state.store(State::Started);
             while (state < State::Stopped)
@@ -190,14 +202,20 @@ private:
     friend struct PoolWorker;
 
     std::mutex                                                  m_PullMutex;
+    std::mutex                                                  m_ResultMutex;
     std::condition_variable_any                                 m_ResultCV;
 
+    using QueuedTask = std::pair<uint64_t, std::shared_ptr<Task>>;
+    using TaskQueue  = std::queue<QueuedTask, std::pmr::deque<QueuedTask>>;
+
     size_t                                                      m_MaxWorkers;
     uint64_t                                                    m_TaskIdx = 0;
+    uint64_t                                                    m_Unfinished = 0;   // Queued & running tasks, detached included. Guarded by m_ResultMutex.
+    std::pmr::memory_resource                                  *m_Resource;         // Tasks, queue & results, thread cached pool by default.
     std::recursive_mutex                                        m_RequestMutex;
-    std::queue<std::pair<uint64_t, std::shared_ptr<Task>>>      m_QueuedTasks;      // Any task`ll be placed here before execution.
+    TaskQueue                                                   m_QueuedTasks;      // Any task`ll be placed here before execution.
 
-    std::unordered_map<uint64_t, std::any>                      m_ResultKeeper;
+    std::pmr::unordered_map<uint64_t, std::any>                 m_ResultKeeper;
     std::unordered_map<size_t, std::shared_ptr<PoolWorker>>     m_StartedWorkers;   // Container of an active threads.
 
     std::pair<uint64_t, std::shared_ptr<Task>> PullTask(PoolWorker &worker)
@@ -219,26 +237,50 @@ private:
         }
         auto front = m_QueuedTasks.front();
         m_QueuedTasks.pop();
+        TRACE_COUNTER("ThreadPool", "Queued tasks", m_QueuedTasks.size());
         return front;
     }
 
     void AddResult(uint64_t taskIdx, TaskResult &&result)
     {
-        m_ResultKeeper[taskIdx] = std::move(result);
+        {
+            std::lock_guard lock(m_ResultMutex);
+            // Detached tasks (id 0) keep nothing, they are only counted.
+            if (taskIdx)
+            {
+                m_ResultKeeper[taskIdx] = std::move(result);
+            }
+            m_Unfinished--;
+        }
         m_ResultCV.notify_all();
     }
 
-    // We need to make sure we have at least 1 thread await or we have to create new, because old one dies.
+    // We need to make sure we have enough threads await for queued tasks or we have to create new, because old one dies.
     void SignalOrAddMorWorker()
     {
+        size_t queued_tasks = 0;
+        {
+            std::lock_guard lock(m_PullMutex);
+            queued_tasks = m_QueuedTasks.size();
+        }
+        size_t awaiting_workers = 0;
         for (size_t i = 0; i < m_MaxWorkers; i++)
         {
-            const auto *i_worker = m_StartedWorkers[i].get();
+            auto *i_worker = m_StartedWorkers[i].get();
             if (i_worker && i_worker->GetState() == PoolWorker::State::Await)
             {
-                break;
+                i_worker->context.conditional.notify_one();
+                awaiting_workers++;
             }
-            else if (!i_worker || i_worker->IsTaskDead())
+        }
+        if (awaiting_workers >= queued_tasks)
+        {
+            return;
+        }
+        for (size_t i = 0; i < m_MaxWorkers; i++)
+        {
+            const auto *i_worker = m_StartedWorkers[i].get();
+            if (!i_worker || i_worker->IsTaskDead())
             {
                 std::stringstream ss; ss << "Worker " << i;
                 m_StartedWorkers[i] = std::make_shared<PoolWorker>(*this, ss.str());
@@ -247,6 +289,25 @@ private:
         }
     }
 
+    uint64_t QueueTask(std::shared_ptr<Task> &&task, bool detached = false)
+    {
+        TRACE_SCOPE("ThreadPool", "Submit");
+        task->SetFlow(Trace::FlowBegin("ThreadPool", "Task"));
+        std::lock_guard lock(m_RequestMutex);
+        const auto task_id = detached ? 0 : ++m_TaskIdx;
+        {
+            std::lock_guard result_lock(m_ResultMutex);
+            m_Unfinished++;
+        }
+        {
+            std::lock_guard pull_lock(m_PullMutex);
+            m_QueuedTasks.push({ task_id, std::move(task) });
+            TRACE_COUNTER("ThreadPool", "Queued tasks", m_QueuedTasks.size());
+        }
+        SignalOrAddMorWorker();
+        return task_id;
+    }
+
 public:
     static ThreadPool *GLobalInstance()
     {
@@ -254,7 +315,8 @@ public:
         return &instance;
     }
 
-    ThreadPool(uint32_t workersSize = 0)
+    ThreadPool(uint32_t workersSize = 0, std::pmr::memory_resource *resource = Memory::ThreadCachePool::Instance()) :
+        m_Resource(resource), m_QueuedTasks(std::pmr::polymorphic_allocator<QueuedTask>(resource)), m_ResultKeeper(resource)
     {
         if (workersSize == 0)
         {
@@ -278,24 +340,75 @@ public:
     template <typename CallableR, typename ...CallableT, typename ...ArgT>
     uint64_t AddTask(const std::string &taskName, CallableR(&&func)(CallableT...), ArgT &&...args)
     {
-        std::lock_guard lock(m_RequestMutex);
-        const auto task_id = ++m_TaskIdx;
-        m_QueuedTasks.push({ task_id, std::make_shared<Task>(taskName, Task::WarpCallable(std::forward<decltype(func)>(func), std::forward<ArgT>(args)...)) });
-        SignalOrAddMorWorker();
-        return task_id;
+        return QueueTask(std::allocate_shared<Task>(std::pmr::polymorphic_allocator<Task>(m_Resource), taskName, Task::WarpCallable(std::forward<decltype(func)>(func), std::forward<ArgT>(args)...)));
+    }
+
+    uint64_t AddTask(const std::string &taskName, std::function<void()> func)
+    {
+        return QueueTask(std::allocate_shared<Task>(std::pmr::polymorphic_allocator<Task>(m_Resource), taskName, std::move(func)));
+    }
+
+    // Fire & forget: no id, no result kept, so pool state does not grow with number of tasks.
+    // Use for internal fan out, WaitAllTasks still waits for these.
+    void AddDetachedTask(const std::string &taskName, std::function<void()> func)
+    {
+        QueueTask(std::allocate_shared<Task>(std::pmr::polymorphic_allocator<Task>(m_Resource), taskName, std::move(func)), true);
+    }
+
+    // Runs body(0) .. body(count - 1) over pool workers, calling thread takes part as well.
+    // Returns once every index is processed, so body may reference caller`s stack.
+    void ParallelFor(const std::string &taskName, size_t count, const std::function<void(size_t)> &body)
+    {
+        struct ForContext
+        {
+            std::atomic<size_t>     next = 0;
+            std::atomic<size_t>     done = 0;
+            size_t                  count = 0;
+            std::mutex              mutex;
+            std::condition_variable finished;
+        };
+        auto ctx = std::make_shared<ForContext>();
+        ctx->count = count;
+        // Late workers may still pull the task after we return, they only touch ctx and never body.
+        const auto runner = [ctx, &body]()
+        {
+            size_t idx = 0;
+            while ((idx = ctx->next.fetch_add(1)) < ctx->count)
+            {
+                body(idx);
+                if (ctx->done.fetch_add(1) + 1 == ctx->count)
+                {
+                    std::lock_guard lock(ctx->mutex);
+                    ctx->finished.notify_all();
+                }
+            }
+        };
+        const size_t helpers = std::min(count > 0 ? count - 1 : 0, m_MaxWorkers);
+        for (size_t i = 0; i < helpers; i++)
+        {
+            AddDetachedTask(taskName, runner);
+        }
+        runner();
+        std::unique_lock lock(ctx->mutex);
+        ctx->finished.wait(lock, [&ctx]() { return ctx->done.load() == ctx->count; });
     }
 
     void ClearQueue()
     {
         std::lock_guard lock_request(m_RequestMutex);
         std::lock_guard lock_pull(m_PullMutex);
-        m_QueuedTasks.swap(std::queue<std::pair<uint64_t, std::shared_ptr<Task>>>());
+        {
+            // Dropped tasks never finish, take them out of the count.
+            std::lock_guard lock_result(m_ResultMutex);
+            m_Unfinished -= m_QueuedTasks.size();
+        }
+        m_QueuedTasks = TaskQueue(std::pmr::polymorphic_allocator<QueuedTask>(m_Resource));
+        m_ResultCV.notify_all();
     }
 
     void WaitTask(const uint64_t taskId)
     {
-        std::mutex mux;
-        std::unique_lock lock(mux);
+        std::unique_lock lock(m_ResultMutex);
         const auto pred = [=]()
         {
             return m_ResultKeeper.find(taskId) != m_ResultKeeper.end();
@@ -306,17 +419,10 @@ public:
         }
     }
 
+    // Counts completions, not stored results, so detached tasks are covered too.
     void WaitAllTasks()
     {
-        std::unique_lock lock(m_RequestMutex);
-        const uint64_t last_task_id = m_TaskIdx;
-        const auto pred = [=]()
-        {
-            return m_ResultKeeper.size() == last_task_id;
-        };
-        if (!pred())
-        {
-            m_ResultCV.wait(lock, pred);
-        }
+        std::unique_lock lock(m_ResultMutex);
+        m_ResultCV.wait(lock, [this]() { return m_Unfinished == 0; });
     }
 };
\ No newline at end of file
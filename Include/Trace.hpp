@@ -0,0 +1,459 @@
+#pragma once
+
+// Scoped tracing with Chrome / Perfetto JSON export (chrome://tracing, ui.perfetto.dev).
+// Spans, counters & flow arrows go into per thread ring buffers (flight recorder: oldest events are
+// overwritten), Dump collects every thread on demand. Off by default, Start() / Stop() toggle it at runtime.
+// Disabled cost is one relaxed load per site. TRACE_DISABLED compiles TRACE_* macros to nothing.
+//
+//     TRACE_SCOPE("Crypto", "AES CTR");
+//     TRACE_SCOPE_DETAIL("ThreadPool", "Task", taskName);     // Detail must outlive the scope.
+//     TRACE_COUNTER("ThreadPool", "Queued tasks", queue.size());
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Common.h"
+
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace Trace
+{
+    static constexpr size_t c_DefaultCapacity = 16 * 1024;     // Events per thread, 1 MiB.
+
+    enum class Phase : char
+    {
+        Complete  = 'X',    // Span, Value is duration.
+        Counter   = 'C',    // Value is counter value.
+        FlowStart = 's',    // Value is flow id.
+        FlowEnd   = 'f',
+        Instant   = 'i'
+    };
+
+    struct Event
+    {
+        static constexpr size_t c_DetailSize = 31;
+
+        int64_t         Timestamp = 0;                  // ns since Detail::Epoch()
+        int64_t         Value     = 0;
+        const char     *Category  = nullptr;            // Category & name are string literals, only pointers are kept.
+        const char     *Name      = nullptr;
+        Phase           Type      = Phase::Instant;
+        char            Text[c_DetailSize] = {};        // Truncated copy of dynamic detail (task name etc.), NUL terminated.
+    };
+    static_assert(sizeof(Event) == 64, "Trace event must stay in one cache line");
+
+    namespace Detail
+    {
+        inline std::atomic<bool>     s_Enabled  = false;
+        inline std::atomic<uint64_t> s_NextFlow = 1;
+
+        inline std::chrono::steady_clock::time_point Epoch()
+        {
+            static const auto epoch = std::chrono::steady_clock::now();
+            return epoch;
+        }
+
+        inline int64_t Now()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - Epoch()).count();
+        }
+
+        // Ring of one thread. Lock is taken by owner on every event & by Dump / Clear, so it is uncontended
+        // outside of dumps.
+        class Buffer
+        {
+            std::mutex          m_Mutex;
+            std::vector<Event>  m_Events;
+            uint64_t            m_Mask    = 0;
+            uint64_t            m_Written = 0;
+            std::string         m_Name;
+            std::atomic<bool>   m_Retired = false;      // Owner thread exited, kept for Dump until Clear.
+
+        public:
+            const uint32_t      Tid;
+
+            Buffer(size_t capacity, uint32_t tid, std::string name) : m_Name(std::move(name)), Tid(tid)
+            {
+                Reset(capacity);
+            }
+
+            void Push(const Event &event)
+            {
+                std::lock_guard lock(m_Mutex);
+                m_Events[m_Written++ & m_Mask] = event;
+            }
+
+            // Capacity is rounded up to power of 2.
+            void Reset(size_t capacity)
+            {
+                size_t size = 2;
+                while (size < capacity)
+                {
+                    size <<= 1;
+                }
+                std::lock_guard lock(m_Mutex);
+                m_Events.assign(size, Event());
+                m_Mask    = size - 1;
+                m_Written = 0;
+            }
+
+            void Rename(std::string name)
+            {
+                std::lock_guard lock(m_Mutex);
+                m_Name = std::move(name);
+            }
+
+            // Oldest to newest.
+            void Snapshot(std::vector<Event> &oEvents, std::string &oName)
+            {
+                std::lock_guard lock(m_Mutex);
+                const uint64_t count = std::min<uint64_t>(m_Written, m_Events.size());
+                for (uint64_t i = m_Written - count; i < m_Written; i++)
+                {
+                    oEvents.push_back(m_Events[i & m_Mask]);
+                }
+                oName = m_Name;
+            }
+
+            void Retire()        { m_Retired.store(true, std::memory_order_release); }
+            bool Retired() const { return m_Retired.load(std::memory_order_acquire); }
+        };
+
+        struct Registry
+        {
+            std::mutex                              Mutex;
+            std::vector<std::shared_ptr<Buffer>>    Buffers;
+            size_t                                  Capacity = c_DefaultCapacity;
+            uint32_t                                NextTid  = 1;
+
+            static Registry &Instance()
+            {
+                static Registry instance;
+                return instance;
+            }
+        };
+
+        struct ThreadState
+        {
+            std::string             Name;
+            std::shared_ptr<Buffer> Events;         // Created on first event while tracing is on.
+
+            ~ThreadState()
+            {
+                if (Events)
+                {
+                    Events->Retire();
+                }
+            }
+
+            static ThreadState &Current()
+            {
+                thread_local ThreadState state;
+                return state;
+            }
+        };
+
+        inline Buffer &ThreadBuffer()
+        {
+            auto &state = ThreadState::Current();
+            if (!state.Events)
+            {
+                auto &registry = Registry::Instance();
+                std::lock_guard lock(registry.Mutex);
+                const uint32_t tid = registry.NextTid++;
+                state.Events = std::make_shared<Buffer>(registry.Capacity, tid, state.Name.empty() ? "Thread " + std::to_string(tid) : state.Name);
+                registry.Buffers.push_back(state.Events);
+            }
+            return *state.Events;
+        }
+
+        inline void Emit(Phase type, const char *category, const char *name, int64_t timestamp, int64_t value, std::string_view text = {})
+        {
+            Event event;
+            event.Type      = type;
+            event.Category  = category;
+            event.Name      = name;
+            event.Timestamp = timestamp;
+            event.Value     = value;
+            const size_t length = std::min(text.size(), Event::c_DetailSize - 1);
+            if (length)
+            {
+                memcpy(event.Text, text.data(), length);
+            }
+            ThreadBuffer().Push(event);
+        }
+
+        inline void AppendEscaped(std::string &out, std::string_view text)
+        {
+            for (const char c : text)
+            {
+                if (c == '"' || c == '\\')
+                {
+                    out += '\\';
+                    out += c;
+                }
+                else if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    char code[8];
+                    snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned>(c));
+                    out += code;
+                }
+                else
+                {
+                    out += c;
+                }
+            }
+        }
+
+        // JSON time unit is microsecond, ns precision is kept as fraction.
+        inline void AppendMicros(std::string &out, int64_t ns)
+        {
+            char value[32];
+            snprintf(value, sizeof(value), "%lld.%03lld", static_cast<long long>(ns / 1000), static_cast<long long>(ns % 1000));
+            out += value;
+        }
+
+        inline int ProcessId()
+        {
+#if defined PLATFORM_WIN32 || defined PLATFORM_WIN64
+            return _getpid();
+#else
+            return static_cast<int>(getpid());
+#endif
+        }
+    }
+
+    inline bool Enabled()
+    {
+#if defined TRACE_DISABLED
+        return false;
+#else
+        return Detail::s_Enabled.load(std::memory_order_relaxed);
+#endif
+    }
+
+    // Starts recording, already recorded events are kept. eventsPerThread applies to buffers created from now on,
+    // Clear applies it to existing ones.
+    inline void Start(size_t eventsPerThread = c_DefaultCapacity)
+    {
+        auto &registry = Detail::Registry::Instance();
+        {
+            std::lock_guard lock(registry.Mutex);
+            registry.Capacity = eventsPerThread;
+        }
+        Detail::Epoch();
+        Detail::s_Enabled.store(true, std::memory_order_relaxed);
+    }
+
+    // Drops recorded events & buffers of exited threads.
+    inline void Clear()
+    {
+        auto &registry = Detail::Registry::Instance();
+        std::lock_guard lock(registry.Mutex);
+        registry.Buffers.erase(std::remove_if(registry.Buffers.begin(), registry.Buffers.end(), [](const auto &buffer) { return buffer->Retired(); }),
+                               registry.Buffers.end());
+        for (const auto &buffer : registry.Buffers)
+        {
+            buffer->Reset(registry.Capacity);
+        }
+    }
+
+    // Recorded events stay available for Dump.
+    inline void Stop()
+    {
+        Detail::s_Enabled.store(false, std::memory_order_relaxed);
+    }
+
+    // Name shown for calling thread, may be called before tracing starts.
+    inline void SetThreadName(std::string name)
+    {
+        auto &state = Detail::ThreadState::Current();
+        if (state.Events)
+        {
+            state.Events->Rename(name);
+        }
+        state.Name = std::move(name);
+    }
+
+    inline void Counter(const char *category, const char *name, int64_t value)
+    {
+        if (Enabled())
+        {
+            Detail::Emit(Phase::Counter, category, name, Detail::Now(), value);
+        }
+    }
+
+    inline void Instant(const char *category, const char *name, std::string_view detail = {})
+    {
+        if (Enabled())
+        {
+            Detail::Emit(Phase::Instant, category, name, Detail::Now(), 0, detail);
+        }
+    }
+
+    // Arrow from enclosing span of FlowBegin to enclosing span of FlowEnd, possibly on other thread.
+    // Returns 0 when tracing is off, FlowEnd ignores it.
+    inline uint64_t FlowBegin(const char *category, const char *name)
+    {
+        if (!Enabled())
+        {
+            return 0;
+        }
+        const uint64_t id = Detail::s_NextFlow.fetch_add(1, std::memory_order_relaxed);
+        Detail::Emit(Phase::FlowStart, category, name, Detail::Now(), static_cast<int64_t>(id));
+        return id;
+    }
+
+    inline void FlowEnd(const char *category, const char *name, uint64_t id)
+    {
+        if (id && Enabled())
+        {
+            Detail::Emit(Phase::FlowEnd, category, name, Detail::Now(), static_cast<int64_t>(id));
+        }
+    }
+
+    // Same shape as ScopeGuard, records complete event on scope exit. Nothing is kept when tracing was off at entry.
+    class Span
+    {
+    private:
+        const char         *m_Category = nullptr;
+        const char         *m_Name     = nullptr;
+        std::string_view    m_Detail;
+        int64_t             m_Start    = 0;
+
+    public:
+        Span(const char *category, const char *name, std::string_view detail = {})
+        {
+            if (Enabled())
+            {
+                m_Category = category;
+                m_Name     = name;
+                m_Detail   = detail;
+                m_Start    = Detail::Now();
+            }
+        }
+        Span(const Span&)                   = delete;
+        Span(const Span&&)                  = delete;
+        const Span &operator= (const Span&)  = delete;
+        const Span &operator= (const Span&&) = delete;
+
+        ~Span()
+        {
+            if (m_Category)
+            {
+                Detail::Emit(Phase::Complete, m_Category, m_Name, m_Start, Detail::Now() - m_Start, m_Detail);
+            }
+        }
+    };
+
+    // Chrome trace event format (JSON object form), loads in chrome://tracing & ui.perfetto.dev.
+    // Safe while other threads keep recording, each thread buffer is copied under its lock.
+    inline std::string Dump()
+    {
+        std::vector<std::shared_ptr<Detail::Buffer>> buffers;
+        {
+            auto &registry = Detail::Registry::Instance();
+            std::lock_guard lock(registry.Mutex);
+            buffers = registry.Buffers;
+        }
+        const std::string pid = std::to_string(Detail::ProcessId());
+        std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool first = true;
+        const auto begin_event = [&](const char *name, const char *category, Phase type, uint32_t tid)
+        {
+            out += first ? "\n{" : ",\n{";
+            first = false;
+            out += "\"name\":\"";
+            Detail::AppendEscaped(out, name ? name : "");
+            if (category)
+            {
+                out += "\",\"cat\":\"";
+                Detail::AppendEscaped(out, category);
+            }
+            out += "\",\"ph\":\"";
+            out += static_cast<char>(type);
+            out += "\",\"pid\":" + pid + ",\"tid\":" + std::to_string(tid);
+        };
+        std::vector<Event> events;
+        std::string        thread_name;
+        for (const auto &buffer : buffers)
+        {
+            events.clear();
+            buffer->Snapshot(events, thread_name);
+            begin_event("thread_name", nullptr, static_cast<Phase>('M'), buffer->Tid);
+            out += ",\"args\":{\"name\":\"";
+            Detail::AppendEscaped(out, thread_name);
+            out += "\"}}";
+            for (const auto &event : events)
+            {
+                begin_event(event.Name, event.Category, event.Type, buffer->Tid);
+                out += ",\"ts\":";
+                Detail::AppendMicros(out, event.Timestamp);
+                switch (event.Type)
+                {
+                case Phase::Complete:
+                    out += ",\"dur\":";
+                    Detail::AppendMicros(out, event.Value);
+                    break;
+                case Phase::Counter:
+                    out += ",\"args\":{\"value\":" + std::to_string(event.Value) + "}";
+                    break;
+                case Phase::FlowEnd:
+                    out += ",\"bp\":\"e\"";
+                    [[fallthrough]];
+                case Phase::FlowStart:
+                    out += ",\"id\":" + std::to_string(event.Value);
+                    break;
+                case Phase::Instant:
+                    out += ",\"s\":\"t\"";
+                    break;
+                }
+                if (event.Text[0] && event.Type != Phase::Counter)
+                {
+                    out += ",\"args\":{\"detail\":\"";
+                    Detail::AppendEscaped(out, event.Text);
+                    out += "\"}";
+                }
+                out += "}";
+            }
+        }
+        out += "\n]}\n";
+        return out;
+    }
+
+    inline bool Dump(const std::filesystem::path &path)
+    {
+        const std::string json = Dump();
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(json.data(), static_cast<std::streamsize>(json.size()));
+        return static_cast<bool>(file);
+    }
+}
+
+#if defined TRACE_DISABLED
+#define TRACE_SCOPE(category, name)                 ((void)0)
+#define TRACE_SCOPE_DETAIL(category, name, detail)  ((void)0)
+#define TRACE_COUNTER(category, name, value)        ((void)0)
+#else
+#define TRACE_SCOPE(category, name) \
+    const Trace::Span CONCAT(trace_span_, __LINE__)(category, name)
+#define TRACE_SCOPE_DETAIL(category, name, detail) \
+    const Trace::Span CONCAT(trace_span_, __LINE__)(category, name, detail)
+// Value expression is evaluated only while tracing is on.
+#define TRACE_COUNTER(category, name, value) \
+    do { if (Trace::Enabled()) { Trace::Counter(category, name, static_cast<int64_t>(value)); } } while (0)
+#endif
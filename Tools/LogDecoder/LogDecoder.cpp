@@ -0,0 +1,230 @@
+// Offline decoder for binary AsyncLog files (LOG_BINARY).
+// Usage: LogDecoder <log.bin> [out.txt]
+// Output matches text mode of AsyncLog: "[time] [LEVEL] [thread] message".
+
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "AsyncLog.hpp"
+
+namespace
+{
+    struct FormatInfo
+    {
+        AsyncLog::Level Severity = AsyncLog::Level::Debug;
+        std::string     Format;
+        std::string     Signature;
+    };
+
+    // Renders raw arguments of one record by signature, same text as AsyncLog::Detail::AppendArg.
+    bool DecodeArgs(AsyncLog::Binary::Reader &reader, const std::string &signature, std::vector<std::string> &oArgs)
+    {
+        oArgs.clear();
+        for (size_t i = 0; i < signature.size() && reader.Ok(); i++)
+        {
+            std::string value;
+            switch (signature[i])
+            {
+            case 'b':
+                value = reader.Byte() ? "true" : "false";
+                break;
+            case 'c':
+                value = static_cast<char>(reader.Byte());
+                break;
+            case 'i':
+                value = std::to_string(reader.Zigzag());
+                break;
+            case 'u':
+                value = std::to_string(reader.Varint());
+                break;
+            case 'f':
+            {
+                uint64_t raw = 0;
+                for (int byte = 0; byte < 8; byte++)
+                {
+                    raw |= static_cast<uint64_t>(reader.Byte()) << (8 * byte);
+                }
+                double number = 0;
+                memcpy(&number, &raw, sizeof(number));
+                AsyncLog::Detail::AppendDouble(value, number);
+                break;
+            }
+            case 's':
+            case 't':
+                value = reader.String();
+                break;
+            case 'p':
+                AsyncLog::Detail::AppendPointer(value, reinterpret_cast<const void*>(static_cast<uintptr_t>(reader.Varint())));
+                break;
+            case 'D':
+            {
+                const size_t suffix = i + 1 < signature.size() ? static_cast<size_t>(signature[++i] - '0') : 0;
+                if (suffix >= sizeof(AsyncLog::Detail::c_DurationSuffixes) / sizeof(AsyncLog::Detail::c_DurationSuffixes[0]))
+                {
+                    return false;
+                }
+                value = std::to_string(reader.Zigzag()) + AsyncLog::Detail::c_DurationSuffixes[suffix];
+                break;
+            }
+            default:
+                return false;
+            }
+            oArgs.push_back(std::move(value));
+        }
+        return reader.Ok();
+    }
+
+    bool Decode(const std::vector<uint8_t> &iData, FILE *out)
+    {
+        AsyncLog::Binary::Reader reader(iData.data(), iData.size());
+        AsyncLog::Detail::LinePrefix prefix;
+        std::unordered_map<uint32_t, FormatInfo>  formats;
+        std::unordered_map<uint64_t, std::string> threads;
+        std::vector<std::string> args;
+        std::string line;
+        int64_t timestamp = 0;
+        bool    session   = false;
+
+        while (!reader.AtEnd())
+        {
+            // Every session starts with header, files may hold several appended sessions.
+            if (reader.Expect(AsyncLog::Binary::c_Magic, sizeof(AsyncLog::Binary::c_Magic)))
+            {
+                if (reader.Byte() != AsyncLog::Binary::c_Version)
+                {
+                    fprintf(stderr, "Unsupported log version.\n");
+                    return false;
+                }
+                formats.clear();
+                threads.clear();
+                timestamp = 0;
+                session   = true;
+                continue;
+            }
+            if (!session)
+            {
+                fprintf(stderr, "Not a binary log.\n");
+                return false;
+            }
+            line.clear();
+            const uint8_t kind = reader.Byte();
+            switch (kind)
+            {
+            case AsyncLog::Binary::Entry_Format:
+            {
+                const uint32_t id = reader.Fixed32();
+                FormatInfo info;
+                info.Severity  = static_cast<AsyncLog::Level>(reader.Byte());
+                reader.Varint();                                            // Line & file identify site, not needed for text.
+                reader.String();
+                info.Format    = reader.String();
+                info.Signature = reader.String();
+                formats[id] = std::move(info);
+                break;
+            }
+            case AsyncLog::Binary::Entry_Thread:
+            {
+                const uint64_t index = reader.Varint();
+                threads[index] = reader.String();
+                break;
+            }
+            case AsyncLog::Binary::Entry_Record:
+            {
+                const uint32_t id     = reader.Fixed32();
+                const uint64_t thread = reader.Varint();
+                timestamp += reader.Zigzag();
+                const auto format = formats.find(id);
+                if (format == formats.end())
+                {
+                    fprintf(stderr, "Record with unknown format id %08x.\n", id);
+                    return false;
+                }
+                // Unknown signature code means record length is unknown too, nothing after it can be trusted.
+                if (!DecodeArgs(reader, format->second.Signature, args))
+                {
+                    if (reader.Ok())
+                    {
+                        fprintf(stderr, "Record with format id %08x has corrupted argument signature.\n", id);
+                    }
+                    else
+                    {
+                        fprintf(stderr, "Log is truncated or corrupted.\n");
+                    }
+                    return false;
+                }
+                prefix.Append(line, timestamp, format->second.Severity, threads[thread]);
+                AsyncLog::Detail::FormatTo(line, format->second.Format, [&args](std::string &o, size_t idx) { o += args[idx]; }, args.size());
+                break;
+            }
+            case AsyncLog::Binary::Entry_Text:
+            {
+                const auto     level  = static_cast<AsyncLog::Level>(reader.Byte());
+                const uint64_t thread = reader.Varint();
+                timestamp += reader.Zigzag();
+                const std::string_view message = reader.String();
+                prefix.Append(line, timestamp, level, threads[thread]);
+                line += message;
+                break;
+            }
+            case AsyncLog::Binary::Entry_Dropped:
+            {
+                const uint64_t thread  = reader.Varint();
+                const uint64_t dropped = reader.Varint();
+                line = "[AsyncLog] [" + threads[thread] + "] " + std::to_string(dropped) + " records dropped";
+                break;
+            }
+            default:
+                fprintf(stderr, "Unknown entry kind 0x%02x.\n", kind);
+                return false;
+            }
+            if (!reader.Ok())
+            {
+                fprintf(stderr, "Log is truncated or corrupted.\n");
+                return false;
+            }
+            if (!line.empty())
+            {
+                line += '\n';
+                fwrite(line.data(), 1, line.size(), out);
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "Usage: %s <log.bin> [out.txt]\n", argv[0]);
+        return 1;
+    }
+    FILE *in = fopen(argv[1], "rb");
+    if (!in)
+    {
+        fprintf(stderr, "Can`t open %s.\n", argv[1]);
+        return 1;
+    }
+    std::vector<uint8_t> data;
+    uint8_t chunk[1 << 16];
+    for (size_t read = 0; (read = fread(chunk, 1, sizeof(chunk), in)) > 0;)
+    {
+        data.insert(data.end(), chunk, chunk + read);
+    }
+    fclose(in);
+
+    FILE *out = argc == 3 ? fopen(argv[2], "wb") : stdout;
+    if (!out)
+    {
+        fprintf(stderr, "Can`t open %s.\n", argv[2]);
+        return 1;
+    }
+    const bool result = Decode(data, out);
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    return result ? 0 : 1;
+}